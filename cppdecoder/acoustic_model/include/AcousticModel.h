@@ -8,6 +8,8 @@
 
 #include <Utils.h>
 
+#include "HMMTopology.h"
+
 #include <cmath>
 #include <fstream>
 #include <iostream>
@@ -19,6 +21,32 @@
 #include <unordered_map>
 #include <vector>
 
+/**
+ * @brief The work shared by every senone scored for a block of frames (such
+ * as the Gaussian selection codeword of each frame), done once by
+ * AcousticModel::prepare_frames and then read by frame index. It belongs to
+ * the caller, so the model keeps no state per frame, and its storage is
+ * reused from one block to the next.
+ */
+struct PreparedFrames {
+  // The frames, n_frames x dim values, one frame after the other, with their
+  // dimensions in the order the model scores them.
+  const float *frames = nullptr;
+  uint32_t n_frames = 0;
+  uint32_t dim = 0;
+  // Storage of the frames if the model reorders their dimensions.
+  std::vector<float> reordered;
+  // Gaussian selection codeword of each frame, empty without a selection.
+  std::vector<uint32_t> codewords;
+  // Fast match scores, n_fm_scores for each frame one after the other, and
+  // the best score of each frame; empty without a fast match.
+  std::vector<float> fm_scores;
+  std::vector<float> fm_best;
+  uint32_t n_fm_scores = 0;
+
+  const float *getFrame(const uint32_t f) const { return frames + f * dim; }
+};
+
 class AcousticModel {
  public:
   virtual ~AcousticModel() {}
@@ -73,6 +101,212 @@ class AcousticModel {
   virtual float calc_logprob(const std::string &state, const int q,
                              const std::vector<float> &frame) = 0;
 
+  /**
+   * @brief Provides the log probability for a frame F, being in the symbol
+   * with a dense index and the state Q of the HMM, without string lookups.
+   *
+   * @param[in] symbol Symbol index, from getSymbolId.
+   * @param[in] q Hidden Markov Model state.
+   * @param[in] frame getDim() values.
+   * @return float Log probability of the frame, INFINITY if the symbol or Q do
+   * not exist.
+   */
+  virtual float calc_logprob(const uint32_t symbol, const int q,
+                             const float *frame) = 0;
+
+  /**
+   * @brief Provides the log probability of several consecutive frames, being
+   * in a state S and the state Q of the HMM. Models override it to go over
+   * their parameters once for the whole block.
+   *
+   * @param[in] state Acoustic Model state.
+   * @param[in] q Hidden Markov Model state.
+   * @param[in] frames n_frames x getDim() values, one frame after the other.
+   * @param[in] n_frames Number of frames.
+   * @param[out] out n_frames log probabilities, the same values calc_logprob
+   * provides for each frame.
+   */
+  virtual void calc_logprob_block(const std::string &state, const int q,
+                                  const float *frames, const uint32_t n_frames,
+                                  float *out) {
+    std::vector<float> frame(getDim());
+    for (uint32_t f = 0; f < n_frames; f++) {
+      frame.assign(frames + f * getDim(), frames + (f + 1) * getDim());
+      out[f] = calc_logprob(state, q, frame);
+    }
+  }
+
+  /**
+   * Symbols and HMM states that share an emission distribution map to the same
+   * senone, so scores can be cached or computed once for all of them.
+   *
+   * @brief Get the number of senones, the emission distributions of the model.
+   *
+   * @return uint32_t The number of senones.
+   */
+  virtual uint32_t getNSenones() const = 0;
+
+  /**
+   * @brief Get the dense index of the senone of a symbol and HMM state.
+   *
+   * @param[in] state Acoustic Model state.
+   * @param[in] q Hidden Markov Model state.
+   * @return int The senone index in [0, getNSenones()), -1 if it does not
+   * exist.
+   */
+  virtual int getSenoneId(const std::string &state, const int q) const = 0;
+
+  /**
+   * @brief Get the senone of a symbol, by its dense index, and HMM state.
+   *
+   * @param[in] symbol Symbol index, from getSymbolId.
+   * @param[in] q Hidden Markov Model state.
+   * @return int The senone index in [0, getNSenones()), -1 if it does not
+   * exist.
+   */
+  virtual int getSenoneId(const uint32_t symbol, const int q) const = 0;
+
+  /**
+   * Symbols are resolved once to a dense index, then scored and looked up by
+   * that index in flat arrays.
+   *
+   * @brief Get the number of symbols (HMMs) of the model.
+   *
+   * @return uint32_t The number of symbols.
+   */
+  virtual uint32_t getNSymbols() const = 0;
+
+  /**
+   * @brief Get the dense index of a symbol.
+   *
+   * @param[in] state Acoustic Model state.
+   * @return int The symbol index in [0, getNSymbols()), -1 if it does not
+   * exist.
+   */
+  virtual int getSymbolId(const std::string &state) const = 0;
+
+  /**
+   * @brief Do the work shared by every senone scored for a block of frames.
+   * The frames must outlive prepared. The model writes nothing after it, so
+   * calc_prepared_logprob can be called for these frames from several
+   * threads at once.
+   *
+   * @param[in] frames n_frames x getDim() values, one frame after the other.
+   * @param[in] n_frames Number of frames.
+   * @param[out] prepared The frames and the work done for them.
+   */
+  virtual void prepare_frames(const float *frames, const uint32_t n_frames,
+                              PreparedFrames *prepared) {
+    prepared->frames = frames;
+    prepared->n_frames = n_frames;
+    prepared->dim = getDim();
+    prepared->codewords.clear();
+    prepared->fm_scores.clear();
+    prepared->fm_best.clear();
+    prepared->n_fm_scores = 0;
+  }
+
+  /**
+   * @brief calc_senone_logprob (with a floor) for frame f of a block
+   * prepared by this model with its current settings.
+   *
+   * @param[in] senone Senone index, from getSenoneId.
+   * @param[in] prepared Frames prepared by prepare_frames.
+   * @param[in] f Frame index in the block.
+   * @param[in] floor Log probability threshold, -HUGE_VAL for none.
+   * @return float Log probability of the frame; -HUGE_VAL may stand for any
+   * value not above floor.
+   */
+  virtual float calc_prepared_logprob(const uint32_t senone,
+                                      const PreparedFrames &prepared,
+                                      const uint32_t f,
+                                      const float floor = -HUGE_VAL) {
+    return calc_senone_logprob(senone, prepared.getFrame(f), floor);
+  }
+
+  /**
+   * @brief calc_senone_logprob_block for frames [first, first + n_frames) of
+   * a block prepared by this model with its current settings.
+   *
+   * @param[in] senone Senone index, from getSenoneId.
+   * @param[in] prepared Frames prepared by prepare_frames.
+   * @param[in] first First frame index in the block.
+   * @param[in] n_frames Number of frames.
+   * @param[out] out n_frames log probabilities.
+   */
+  virtual void calc_prepared_logprob_block(const uint32_t senone,
+                                           const PreparedFrames &prepared,
+                                           const uint32_t first,
+                                           const uint32_t n_frames,
+                                           float *out) {
+    calc_senone_logprob_block(senone, prepared.getFrame(first), n_frames,
+                              out);
+  }
+
+  /**
+   * @brief Provides the log probability for a frame in a senone, the same
+   * value calc_logprob provides for every symbol and HMM state of the senone.
+   *
+   * @param[in] senone Senone index, from getSenoneId.
+   * @param[in] frame getDim() values.
+   * @return float Log probability of the frame.
+   */
+  virtual float calc_senone_logprob(const uint32_t senone,
+                                    const float *frame) = 0;
+
+  /**
+   * The decoder passes the score under which the hypotheses of the senone
+   * fall out of the beam, so models that score with partial distance
+   * elimination can drop hopeless senones early.
+   *
+   * @brief calc_senone_logprob, for a caller that is not interested in log
+   * probabilities not above floor.
+   *
+   * @param[in] senone Senone index, from getSenoneId.
+   * @param[in] frame getDim() values.
+   * @param[in] floor Log probability threshold, -HUGE_VAL for none.
+   * @return float Log probability of the frame; -HUGE_VAL may stand for any
+   * value not above floor.
+   */
+  virtual float calc_senone_logprob(const uint32_t senone, const float *frame,
+                                    const float /*floor*/) {
+    return calc_senone_logprob(senone, frame);
+  }
+
+  /**
+   * @brief Provides the log probability of several consecutive frames in a
+   * senone. Models override it to go over their parameters once for the whole
+   * block.
+   *
+   * @param[in] senone Senone index, from getSenoneId.
+   * @param[in] frames n_frames x getDim() values, one frame after the other.
+   * @param[in] n_frames Number of frames.
+   * @param[out] out n_frames log probabilities.
+   */
+  virtual void calc_senone_logprob_block(const uint32_t senone,
+                                         const float *frames,
+                                         const uint32_t n_frames, float *out) {
+    for (uint32_t f = 0; f < n_frames; f++)
+      out[f] = calc_senone_logprob(senone, frames + f * getDim());
+  }
+
+  /**
+   * @brief Log probability of every senone for a block of frames. Models
+   * override it with kernels that score the whole model at once.
+   *
+   * @param[in] frames n_frames x getDim() values, one frame after the other.
+   * @param[in] n_frames Number of frames.
+   * @param[out] out n_frames x getNSenones() values, out[f * getNSenones() +
+   * s] is the log probability of frame f in senone s.
+   */
+  virtual void calc_logprob_block(const float *frames, const uint32_t n_frames,
+                                  float *out) {
+    const uint32_t n_senones = getNSenones();
+    for (uint32_t f = 0; f < n_frames; f++)
+      for (uint32_t s = 0; s < n_senones; s++)
+        out[f * n_senones + s] = calc_senone_logprob(s, frames + f * getDim());
+  }
+
   /**
    * @brief Get the State Trans Type from symbol/state
    *
@@ -88,6 +322,104 @@ class AcousticModel {
    * @return std::vector<float>
    */
   virtual std::vector<float> &getStateTrans(const std::string &state) = 0;
+
+  /**
+   * @brief Get the State Trans Type of a symbol by its dense index.
+   *
+   * @param[in] symbol Symbol index, from getSymbolId.
+   * @return const std::string&
+   */
+  virtual const std::string &getStateTransType(const uint32_t symbol) const = 0;
+
+  /**
+   * @brief Get the state transitions of a symbol by its dense index.
+   *
+   * @param[in] symbol Symbol index, from getSymbolId.
+   * @return const std::vector<float>&
+   */
+  virtual const std::vector<float> &getStateTrans(
+      const uint32_t symbol) const = 0;
+
+  /**
+   * @brief Get the HMM topology of every symbol, compiled when the model was
+   * read.
+   *
+   * @return const HMMTopology& The topology, indexed by symbol index.
+   */
+  const HMMTopology &getTopology() const { return topology; }
+
+  /**
+   * @brief Set how the mixture log-sum-exp is computed in calc_logprob. Models
+   * with a single Gaussian per state ignore it.
+   *
+   * @param[in] mode LogAddMode::Exact (default), LogAddMode::FastExp or
+   * LogAddMode::Max (best component only).
+   */
+  virtual void setLogAddMode(const LogAddMode mode) { log_add_mode = mode; }
+
+  LogAddMode getLogAddMode() const { return log_add_mode; }
+
+  /**
+   * With LogAddMode::Max every component must only beat the best one so far,
+   * so its distance can stop early. The checks are branches, so with short
+   * frames and wide SIMD kernels (48 dimensions and AVX-512) the branch-free
+   * loop is faster; it pays off with longer frames or scalar kernels.
+   *
+   * @brief Use partial distance elimination in LogAddMode::Max.
+   *
+   * @param[in] enable True to use it, false (default) otherwise.
+   */
+  void setPartialDistance(const bool enable) { partial_distance = enable; }
+
+  bool getPartialDistance() const { return partial_distance; }
+
+ protected:
+  /**
+   * @brief Compile the topology of every symbol from its transitions and
+   * senones. Models call it once their symbol indices are built.
+   */
+  void compile_topology() {
+    topology.clear();
+
+    std::vector<int> senones;
+    std::vector<float> matrix;
+    for (uint32_t symbol = 0; symbol < getNSymbols(); symbol++) {
+      const std::string &type = getStateTransType(symbol);
+
+      // TransP shares the left-to-right transitions of another symbol.
+      if (type == "Trans" || type == "TransP") {
+        const std::vector<float> &trans = getStateTrans(symbol);
+        senones.clear();
+        for (uint32_t q = 0; q < trans.size(); q++)
+          senones.push_back(getSenoneId(symbol, q));
+        topology.addLeftToRight(trans, senones);
+      } else if (getTransitionMatrix(symbol, &matrix)) {
+        senones.clear();
+        for (int q = 0; getSenoneId(symbol, q) >= 0; q++)
+          senones.push_back(getSenoneId(symbol, q));
+        topology.addMatrix(matrix, senones);
+      } else {
+        topology.addUnsupported();
+      }
+    }
+  }
+
+  /**
+   * @brief Transition matrix of a symbol whose transitions are not a
+   * left-to-right vector (see HMMTopology::addMatrix).
+   *
+   * @param[in] symbol Symbol index.
+   * @param[out] matrix (Q + 2) x (Q + 2) log probabilities.
+   * @return bool False if the model has no matrix for the symbol.
+   */
+  virtual bool getTransitionMatrix(const uint32_t /*symbol*/,
+                                   std::vector<float> * /*matrix*/) const {
+    return false;
+  }
+
+  LogAddMode log_add_mode = LogAddMode::Exact;
+  bool partial_distance = false;
+  HMMTopology topology;
 };
 
 #endif  // ACOUSTICMODEL_H_
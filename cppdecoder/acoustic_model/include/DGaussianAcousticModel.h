@@ -12,6 +12,7 @@
 #include <vector>
 
 #include "AcousticModel.h"
+#include "GaussianKernels.h"
 
 class GaussianState {
   std::vector<float> mu;
@@ -52,6 +53,17 @@ class GaussianState {
    */
   void addVar(const std::string &line);
 
+  /**
+   * @brief Compute the inverse variances and Log_c of a diagonal Gaussian.
+   *
+   * @param[in] var Variances.
+   * @param[in] dim Vector's dimension.
+   * @param[out] ivar dim inverse variances.
+   * @return float Log_c.
+   */
+  static float calc_ivar_logc(const float *var, const uint32_t dim,
+                              float *ivar);
+
   /**
    * @brief Set Log_c value.
    *
@@ -107,6 +119,24 @@ class GaussianState {
    * @return float log probability.
    */
   float calc_logprob(const std::vector<float> &frame);
+
+  /**
+   * @brief Provides the log probability of the provided frame.
+   *
+   * @param[in] frame getDim() values.
+   * @return float log probability.
+   */
+  float calc_logprob(const float *frame);
+
+  /**
+   * @brief Log probability of the frame, stopping the distance as soon as it
+   * cannot be above floor (see diag_gaussian_distance_bounded).
+   *
+   * @param[in] frame getDim() values.
+   * @param[in] floor Log probability the caller is not interested in.
+   * @return float log probability, -HUGE_VAL if it is not above floor.
+   */
+  float calc_logprob(const float *frame, const float floor);
 };
 
 class DGaussianAcousticModel : public AcousticModel {
@@ -121,6 +151,19 @@ class DGaussianAcousticModel : public AcousticModel {
   uint32_t dim;
   uint32_t n_states;
 
+  // Senone s is senone_states[s], the ones of a symbol are consecutive.
+  std::vector<GaussianState *> senone_states;
+
+  // Symbol i is states[i], its senones are symbol_first_senone[i] + [0,
+  // symbol_num_q[i]).
+  std::unordered_map<std::string, uint32_t> state_to_id;
+  std::vector<uint32_t> symbol_first_senone;
+  std::vector<int> symbol_num_q;
+  std::vector<const std::string *> symbol_type;
+  std::vector<const std::vector<float> *> symbol_trans;
+
+  void index_senones();
+
  public:
   /**
    * @brief Construct a new DGaussianAcousticModel.
@@ -178,6 +221,9 @@ class DGaussianAcousticModel : public AcousticModel {
   float calc_logprob(const std::string &state, const int q,
                      const std::vector<float> &frame) override;
 
+  float calc_logprob(const uint32_t symbol, const int q,
+                     const float *frame) override;
+
   /**
    * @brief Get the State Trans Type from symbol/state
    *
@@ -193,6 +239,47 @@ class DGaussianAcousticModel : public AcousticModel {
    * @return std::vector<float>&
    */
   std::vector<float> &getStateTrans(const std::string &state) override;
+
+  const std::string &getStateTransType(const uint32_t symbol) const override {
+    return *symbol_type[symbol];
+  }
+
+  const std::vector<float> &getStateTrans(
+      const uint32_t symbol) const override {
+    return *symbol_trans[symbol];
+  }
+
+  uint32_t getNSymbols() const override { return symbol_first_senone.size(); }
+
+  int getSymbolId(const std::string &state) const override;
+
+  /**
+   * @brief Get the number of senones, one for each state Q of each symbol.
+   *
+   * @return uint32_t The number of senones.
+   */
+  uint32_t getNSenones() const override { return senone_states.size(); }
+
+  /**
+   * @brief Get the dense index of the senone of a symbol and HMM state.
+   *
+   * @param[in] state Acoustic Model state.
+   * @param[in] q Hidden Markov Model state.
+   * @return int The senone index, -1 if it does not exist.
+   */
+  int getSenoneId(const std::string &state, const int q) const override;
+
+  int getSenoneId(const uint32_t symbol, const int q) const override;
+
+  float calc_senone_logprob(const uint32_t senone, const float *frame) override;
+
+  /**
+   * @brief calc_senone_logprob with a floor, only used with partial distance
+   * elimination. There is a single Gaussian per state, so every log add mode
+   * can use it.
+   */
+  float calc_senone_logprob(const uint32_t senone, const float *frame,
+                            const float floor) override;
 };
 
 #endif  // DGAUSSIANACOUSTICMODEL_H_
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2020 Javier Jorge. All rights reserved.
+ * License: https://github.com/JJorgeDSIC/CppDecoder#license
+ */
+
+#ifndef DIMENSIONORDER_H_
+#define DIMENSIONORDER_H_
+
+#include <Utils.h>
+
+#include <vector>
+
+class GaussianMixtureState;
+
+/**
+ * @brief Order of the dimensions in which the Gaussians of a model are scored.
+ * The partial distance elimination kernels stop a component as soon as its
+ * partial distance is hopeless, so the dimensions that add the most to the
+ * distance should come first. The parameters of the model are reordered once
+ * (see GaussianMixtureState::permute_dims) and every frame is reordered the
+ * same way before scoring.
+ */
+class DimensionOrder {
+ public:
+  DimensionOrder();
+
+  /**
+   * Dimension i is ranked by its expected contribution to the distance of a
+   * frame drawn from the model: (variance of the means + average variance)
+   * times the average inverse variance, over every component of the senones.
+   *
+   * @brief Sort the dimensions by decreasing contribution.
+   *
+   * @param[in] senones Mixture of each senone, with float parameters.
+   * @return int 0 if everything is OK, 1 if there was a problem.
+   */
+  int build(const std::vector<const GaussianMixtureState *> &senones);
+
+  bool isSet() const { return !order.empty(); }
+
+  void clear();
+
+  /**
+   * @brief Get the order, dimension i of a reordered frame is dimension
+   * order[i] of the original one.
+   */
+  const std::vector<uint32_t> &getOrder() const { return order; }
+
+  /**
+   * @brief Get the inverse permutation, which restores the original order.
+   */
+  std::vector<uint32_t> getInverse() const;
+
+  /**
+   * @brief Reorder a block of consecutive frames.
+   *
+   * @param[in] frames n_frames frames with the original order.
+   * @param[in] n_frames Number of frames.
+   * @param[out] buffer Storage of the reordered frames.
+   * @return const float* The reordered frames, or frames if no order is set.
+   */
+  const float *apply_block(const float *frames, const uint32_t n_frames,
+                           std::vector<float> *buffer) const;
+
+ private:
+  uint32_t dim;
+  std::vector<uint32_t> order;
+};
+
+#endif  // DIMENSIONORDER_H_
@@ -0,0 +1,334 @@
+/*
+ * Copyright 2020 Javier Jorge. All rights reserved.
+ * License: https://github.com/JJorgeDSIC/CppDecoder#license
+ */
+
+#ifndef GAUSSIANKERNELS_H_
+#define GAUSSIANKERNELS_H_
+
+#include <cstdint>
+
+/**
+ * Relative tolerance between any SIMD variant and the scalar reference of the
+ * diagonal Gaussian distance. All the terms of the sum are non-negative, so
+ * reordering the additions (and fusing them with FMA) bounds the relative error
+ * by roughly dim * FLT_EPSILON / 2, that is below 1e-5 for dim <= 128.
+ */
+const float DIAG_GAUSSIAN_KERNEL_TOLERANCE = 1e-5f;
+
+/**
+ * @brief Instruction sets that can be used by the Gaussian kernels, from the
+ * most portable to the widest one.
+ */
+enum class SimdLevel { Scalar = 0, SSE4 = 1, AVX2 = 2, AVX512 = 3 };
+
+/**
+ * @brief Signature of the diagonal Gaussian distance kernels, that compute
+ * sum_i (x_i - mu_i)^2 * ivar_i over the first dim positions.
+ */
+typedef float (*DiagGaussianKernel)(const float *x, const float *mu,
+                                    const float *ivar, const uint32_t dim);
+
+/**
+ * @brief Reference implementation of the diagonal Gaussian distance.
+ *
+ * @param[in] x Frame.
+ * @param[in] mu Gaussian mean.
+ * @param[in] ivar Gaussian inverse variance.
+ * @param[in] dim Number of dimensions to use.
+ * @return float sum_i (x_i - mu_i)^2 * ivar_i
+ */
+float diag_gaussian_distance_scalar(const float *x, const float *mu,
+                                    const float *ivar, const uint32_t dim);
+
+/**
+ * @brief Diagonal Gaussian distance using the widest instruction set supported
+ * by this CPU. The kernel is selected once, the first time it is required.
+ *
+ * @param[in] x Frame.
+ * @param[in] mu Gaussian mean.
+ * @param[in] ivar Gaussian inverse variance.
+ * @param[in] dim Number of dimensions to use.
+ * @return float sum_i (x_i - mu_i)^2 * ivar_i
+ */
+float diag_gaussian_distance(const float *x, const float *mu,
+                             const float *ivar, const uint32_t dim);
+
+/**
+ * Dimensions accumulated between the checks of the bounded kernels.
+ */
+const uint32_t PDE_BLOCK = 16;
+
+/**
+ * @brief Signature of the bounded (partial distance elimination) kernels: the
+ * diagonal Gaussian distance accumulated in blocks of PDE_BLOCK dimensions,
+ * stopping as soon as the partial sum is over the bound (every term is
+ * non-negative, so it can only grow). They return the distance if it is not
+ * over bound, otherwise a partial sum over bound.
+ */
+typedef float (*DiagGaussianBoundedKernel)(const float *x, const float *mu,
+                                           const float *ivar,
+                                           const uint32_t dim,
+                                           const float bound);
+
+/**
+ * @brief Reference implementation of the bounded diagonal Gaussian distance.
+ *
+ * @param[in] x Frame.
+ * @param[in] mu Gaussian mean.
+ * @param[in] ivar Gaussian inverse variance.
+ * @param[in] dim Number of dimensions to use.
+ * @param[in] bound Distance the caller is no longer interested in.
+ * @return float The distance, or a partial sum over bound.
+ */
+float diag_gaussian_distance_bounded_scalar(const float *x, const float *mu,
+                                            const float *ivar,
+                                            const uint32_t dim,
+                                            const float bound);
+
+/**
+ * @brief Bounded diagonal Gaussian distance using the widest instruction set
+ * supported by this CPU.
+ *
+ * @param[in] x Frame.
+ * @param[in] mu Gaussian mean.
+ * @param[in] ivar Gaussian inverse variance.
+ * @param[in] dim Number of dimensions to use.
+ * @param[in] bound Distance the caller is no longer interested in.
+ * @return float The distance, or a partial sum over bound.
+ */
+float diag_gaussian_distance_bounded(const float *x, const float *mu,
+                                     const float *ivar, const uint32_t dim,
+                                     const float bound);
+
+/**
+ * Largest dimension of the quantized kernels: with the ranges below, no sum of
+ * the int32 accumulator can overflow up to it.
+ */
+const uint32_t QUANTIZED_MAX_DIM = 224;
+
+/**
+ * Largest magnitude of a quantized frame value, frames are clamped to it.
+ */
+const int16_t QUANTIZED_FRAME_LIMIT = 2047;
+
+/**
+ * @brief Signature of the fixed-point diagonal Gaussian distance kernels, that
+ * compute sum_i d_i * ((d_i * w_i + 2^14) >> 15) with d_i = x_i - mu_i, that
+ * is, sum_i d_i^2 * w_i with the weights w_i in Q15. Frame and means share
+ * per-dimension scales (|x_i| <= QUANTIZED_FRAME_LIMIT, |mu_i| <= 1023) and
+ * the inverse variances are folded into the weights, so the caller rescales
+ * the result by a single factor per Gaussian. The SIMD variants get exactly
+ * the same value as the scalar reference.
+ */
+typedef int32_t (*QuantizedGaussianKernel)(const int16_t *x, const int16_t *mu,
+                                           const int16_t *w,
+                                           const uint32_t dim);
+
+/**
+ * Int8 means are in steps 2^QUANTIZED_MEAN_SHIFT8 times larger than the ones
+ * of the frame, so the frame keeps the 16-bit resolution.
+ */
+const uint32_t QUANTIZED_MEAN_SHIFT8 = 3;
+
+/**
+ * @brief Same as QuantizedGaussianKernel with 8-bit storage: |mu_i| <= 127, in
+ * the units of the frame after mu_i << QUANTIZED_MEAN_SHIFT8, and the weights
+ * in Q7 (w_i << 8 is the Q15 weight).
+ */
+typedef int32_t (*QuantizedGaussianKernel8)(const int16_t *x, const int8_t *mu,
+                                            const int8_t *w,
+                                            const uint32_t dim);
+
+/**
+ * @brief Reference implementation of the 16-bit fixed-point distance.
+ *
+ * @param[in] x Quantized frame.
+ * @param[in] mu Quantized Gaussian mean.
+ * @param[in] w Q15 weights, inverse variance times squared scale.
+ * @param[in] dim Number of dimensions to use, up to QUANTIZED_MAX_DIM.
+ * @return int32_t sum_i d_i * ((d_i * w_i + 2^14) >> 15)
+ */
+int32_t quantized_gaussian_distance_scalar(const int16_t *x, const int16_t *mu,
+                                           const int16_t *w,
+                                           const uint32_t dim);
+
+/**
+ * @brief Reference implementation of the 8-bit fixed-point distance.
+ *
+ * @param[in] x Quantized frame.
+ * @param[in] mu Quantized Gaussian mean.
+ * @param[in] w Q7 weights, inverse variance times squared scale.
+ * @param[in] dim Number of dimensions to use, up to QUANTIZED_MAX_DIM.
+ * @return int32_t sum_i d_i * ((d_i * (w_i << 8) + 2^14) >> 15) with
+ * d_i = x_i - (mu_i << QUANTIZED_MEAN_SHIFT8)
+ */
+int32_t quantized_gaussian_distance8_scalar(const int16_t *x, const int8_t *mu,
+                                            const int8_t *w,
+                                            const uint32_t dim);
+
+/**
+ * @brief 16-bit fixed-point distance using the widest instruction set
+ * supported by this CPU.
+ */
+int32_t quantized_gaussian_distance(const int16_t *x, const int16_t *mu,
+                                    const int16_t *w, const uint32_t dim);
+
+/**
+ * @brief 8-bit fixed-point distance using the widest instruction set
+ * supported by this CPU.
+ */
+int32_t quantized_gaussian_distance8(const int16_t *x, const int8_t *mu,
+                                     const int8_t *w, const uint32_t dim);
+
+/**
+ * @brief Signature of the diagonal Gaussian distance kernels with 16-bit
+ * float parameters (IEEE half precision or bfloat16), converted to float on
+ * the fly: sum_i (x_i - mu_i)^2 * ivar_i over the first dim positions.
+ */
+typedef float (*HalfGaussianKernel)(const float *x, const uint16_t *mu,
+                                    const uint16_t *ivar, const uint32_t dim);
+
+/**
+ * @brief Convert to IEEE half precision, rounding to nearest even.
+ *
+ * @param[in] value Value to convert.
+ * @return uint16_t Bits of the half precision value (+-65504 is the largest
+ * finite one).
+ */
+uint16_t float_to_half(const float value);
+
+/**
+ * @brief Convert from IEEE half precision, exactly.
+ *
+ * @param[in] half Bits of the half precision value.
+ * @return float The value.
+ */
+float half_to_float(const uint16_t half);
+
+/**
+ * @brief Convert to bfloat16 (the upper half of a float), rounding to nearest
+ * even.
+ *
+ * @param[in] value Value to convert.
+ * @return uint16_t Bits of the bfloat16 value.
+ */
+uint16_t float_to_bfloat16(const float value);
+
+/**
+ * @brief Convert from bfloat16, exactly.
+ *
+ * @param[in] bfloat16 Bits of the bfloat16 value.
+ * @return float The value.
+ */
+float bfloat16_to_float(const uint16_t bfloat16);
+
+/**
+ * @brief Reference implementation of the distance with half precision
+ * parameters.
+ *
+ * @param[in] x Frame.
+ * @param[in] mu Gaussian mean, half precision.
+ * @param[in] ivar Gaussian inverse variance, half precision.
+ * @param[in] dim Number of dimensions to use.
+ * @return float sum_i (x_i - mu_i)^2 * ivar_i
+ */
+float half_gaussian_distance_scalar(const float *x, const uint16_t *mu,
+                                    const uint16_t *ivar, const uint32_t dim);
+
+/**
+ * @brief Reference implementation of the distance with bfloat16 parameters.
+ *
+ * @param[in] x Frame.
+ * @param[in] mu Gaussian mean, bfloat16.
+ * @param[in] ivar Gaussian inverse variance, bfloat16.
+ * @param[in] dim Number of dimensions to use.
+ * @return float sum_i (x_i - mu_i)^2 * ivar_i
+ */
+float bfloat16_gaussian_distance_scalar(const float *x, const uint16_t *mu,
+                                        const uint16_t *ivar,
+                                        const uint32_t dim);
+
+/**
+ * @brief Distance with half precision parameters using the widest instruction
+ * set supported by this CPU (F16C conversions with AVX2).
+ */
+float half_gaussian_distance(const float *x, const uint16_t *mu,
+                             const uint16_t *ivar, const uint32_t dim);
+
+/**
+ * @brief Distance with bfloat16 parameters using the widest instruction set
+ * supported by this CPU.
+ */
+float bfloat16_gaussian_distance(const float *x, const uint16_t *mu,
+                                 const uint16_t *ivar, const uint32_t dim);
+
+/**
+ * @brief Get the kernel for a given instruction set.
+ *
+ * @param[in] level Instruction set.
+ * @return DiagGaussianKernel The kernel, or nullptr if it was not compiled in
+ * or this CPU does not support it.
+ */
+DiagGaussianKernel get_diag_gaussian_kernel(const SimdLevel level);
+
+/**
+ * @brief Get the bounded kernel for a given instruction set. There is no SSE4
+ * variant, the scalar one is returned instead.
+ *
+ * @param[in] level Instruction set.
+ * @return DiagGaussianBoundedKernel The kernel, or nullptr if it was not
+ * compiled in or this CPU does not support it.
+ */
+DiagGaussianBoundedKernel get_diag_gaussian_bounded_kernel(
+    const SimdLevel level);
+
+/**
+ * @brief Get the fixed-point kernels for a given instruction set. There are
+ * only AVX2 variants (also used by AVX512), the scalar ones are returned for
+ * SSE4.
+ *
+ * @param[in] level Instruction set.
+ * @return The kernel, or nullptr if it was not compiled in or this CPU does
+ * not support it.
+ */
+QuantizedGaussianKernel get_quantized_gaussian_kernel(const SimdLevel level);
+
+QuantizedGaussianKernel8 get_quantized_gaussian_kernel8(const SimdLevel level);
+
+/**
+ * @brief Get the kernels with 16-bit float parameters for a given instruction
+ * set. There is no SSE4 variant, the scalar one is returned instead.
+ *
+ * @param[in] level Instruction set.
+ * @return HalfGaussianKernel The kernel, or nullptr if it was not compiled in
+ * or this CPU does not support it.
+ */
+HalfGaussianKernel get_half_gaussian_kernel(const SimdLevel level);
+
+HalfGaussianKernel get_bfloat16_gaussian_kernel(const SimdLevel level);
+
+/**
+ * @brief Detect the widest instruction set supported by this CPU (and built
+ * into this binary).
+ *
+ * @return SimdLevel Instruction set detected.
+ */
+SimdLevel detect_simd_level();
+
+/**
+ * @brief Get the instruction set used by diag_gaussian_distance.
+ *
+ * @return SimdLevel Instruction set in use.
+ */
+SimdLevel active_simd_level();
+
+/**
+ * @brief Get a printable name for an instruction set.
+ *
+ * @param[in] level Instruction set.
+ * @return const char* Name (i.e: "avx2").
+ */
+const char *simd_level_name(const SimdLevel level);
+
+#endif  // GAUSSIANKERNELS_H_
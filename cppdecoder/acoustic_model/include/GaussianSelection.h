@@ -0,0 +1,184 @@
+/*
+ * Copyright 2020 Javier Jorge. All rights reserved.
+ * License: https://github.com/JJorgeDSIC/CppDecoder#license
+ */
+
+#ifndef GAUSSIANSELECTION_H_
+#define GAUSSIANSELECTION_H_
+
+#include <Utils.h>
+
+#include <string>
+#include <vector>
+
+class GaussianMixtureState;
+
+/**
+ * Default number of codewords of the codebook.
+ */
+const uint32_t GS_DEFAULT_CODEWORDS = 256;
+
+/**
+ * Default beam (in log-likelihood) that selects the shortlist of a codeword:
+ * the components that score the codeword within this beam of the best one.
+ */
+const float GS_DEFAULT_BEAM = 20.0;
+
+/**
+ * Default number of k-means iterations to build the codebook.
+ */
+const uint32_t GS_DEFAULT_ITERATIONS = 10;
+
+/**
+ * @brief Gaussian selection through a vector quantization codebook. All the
+ * Gaussians of a model are clustered into codewords; for each codeword and
+ * senone, the shortlist keeps the components that are likely for the frames
+ * close to the codeword. A frame is scored by finding its nearest codeword and
+ * evaluating only the shortlisted components, the rest of them contribute
+ * their weight times a floor likelihood.
+ *
+ * The codebook and shortlists are built offline (see BuildGaussianSelection)
+ * and stored next to the model in a text file:
+ *
+ * GSELECTION
+ * D <dim>
+ * K <codewords>
+ * S <senones>
+ * Floor <floor>
+ * IVar <dim values>
+ * CW <dim values>                        (K lines)
+ * SL <rest weight> <n> <c_1> ... <c_n>   (K x S lines, codeword major)
+ */
+class GaussianSelection {
+ public:
+  GaussianSelection();
+
+  /**
+   * @brief Cluster the Gaussians of the senones with k-means and select the
+   * shortlist of each codeword and senone.
+   *
+   * @param[in] senones Mixture of each senone, indexed by senone id.
+   * @param[in] n_codewords Size of the codebook.
+   * @param[in] beam Components that score a codeword within this beam of the
+   * best component of the senone are shortlisted.
+   * @param[in] iterations k-means iterations.
+   * @return int 0 if everything is OK, 1 if there was a problem.
+   */
+  int build(const std::vector<const GaussianMixtureState *> &senones,
+            const uint32_t n_codewords = GS_DEFAULT_CODEWORDS,
+            const float beam = GS_DEFAULT_BEAM,
+            const uint32_t iterations = GS_DEFAULT_ITERATIONS);
+
+  /**
+   * @brief Read the codebook and shortlists from text file.
+   *
+   * @param[in] filename File location.
+   * @return int 0 if everything is OK, 1 if there was a problem.
+   */
+  int read_selection(const std::string &filename);
+
+  /**
+   * @brief Write the codebook and shortlists to text file.
+   *
+   * @param[in] filename File location.
+   * @return int 0 if everything is OK, 1 if there was a problem.
+   */
+  int write_selection(const std::string &filename);
+
+  /**
+   * @brief Check that the shortlists were built for these senones.
+   *
+   * @param[in] senones Mixture of each senone, indexed by senone id.
+   * @return bool True if dimension, number of senones and components agree.
+   */
+  bool matches(const std::vector<const GaussianMixtureState *> &senones) const;
+
+  bool isLoaded() const { return n_codewords > 0; }
+
+  void clear();
+
+  uint32_t getDim() const { return dim; }
+
+  uint32_t getNCodewords() const { return n_codewords; }
+
+  uint32_t getNSenones() const { return n_senones; }
+
+  /**
+   * @brief Set the log-likelihood of the components out of the shortlist,
+   * relative to the best shortlisted one.
+   *
+   * @param[in] floor Log-likelihood offset, -HUGE_VAL ignores them.
+   */
+  void setFloor(const float floor) { this->floor = floor; }
+
+  float getFloor() const { return floor; }
+
+  VectorView<float> getCodeword(const uint32_t codeword) const {
+    return VectorView<float>(&codewords[codeword * stride], dim);
+  }
+
+  /**
+   * @brief Get the shortlist of a codeword and senone.
+   *
+   * @param[in] codeword Codeword index.
+   * @param[in] senone Senone index.
+   * @return VectorView<uint32_t> Indices of the shortlisted components.
+   */
+  VectorView<uint32_t> getShortlist(const uint32_t codeword,
+                                    const uint32_t senone) const {
+    const uint32_t cell = codeword * n_senones + senone;
+    return VectorView<uint32_t>(&shortlists[offsets[cell]],
+                                offsets[cell + 1] - offsets[cell]);
+  }
+
+  /**
+   * @brief Log of the summed weights of the components out of a shortlist.
+   *
+   * @return float The log weight, -HUGE_VAL if every component is in it.
+   */
+  float getRestLogWeight(const uint32_t codeword, const uint32_t senone) const {
+    return rest_logw[codeword * n_senones + senone];
+  }
+
+  /**
+   * @brief Find the codeword closest to a frame.
+   *
+   * @param[in] frame Frame with getDim() values.
+   * @return uint32_t Codeword index.
+   */
+  uint32_t nearest_codeword(const float *frame) const;
+
+  /**
+   * @brief Log probability of a senone, scoring only the shortlist of the
+   * codeword of the frame.
+   *
+   * @param[in] state Mixture of the senone.
+   * @param[in] senone Senone index.
+   * @param[in] codeword Codeword of the frame, from nearest_codeword.
+   * @param[in] frame Frame with getDim() values.
+   * @param[in] mode How the exponentials of the log-sum-exp are computed.
+   * @return float Log probability of the frame.
+   */
+  float calc_logprob(const GaussianMixtureState &state, const uint32_t senone,
+                     const uint32_t codeword, const float *frame,
+                     const LogAddMode mode = LogAddMode::Exact) const;
+
+ private:
+  uint32_t dim;
+  uint32_t stride;
+  uint32_t n_codewords;
+  uint32_t n_senones;
+  float floor;
+
+  // Inverse variances of the distance between frames and codewords.
+  AlignedVector<float> ivar;
+  AlignedVector<float> codewords;
+
+  // Shortlist of cell codeword * n_senones + senone is
+  // shortlists[offsets[cell], offsets[cell + 1]).
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> shortlists;
+  std::vector<float> rest_logw;
+};
+
+#endif  // GAUSSIANSELECTION_H_
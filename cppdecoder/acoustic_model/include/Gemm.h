@@ -0,0 +1,73 @@
+/*
+ * Copyright 2020 Javier Jorge. All rights reserved.
+ * License: https://github.com/JJorgeDSIC/CppDecoder#license
+ */
+
+#ifndef GEMM_H_
+#define GEMM_H_
+
+#include <cstdint>
+
+#include "GaussianKernels.h"
+
+/**
+ * Columns of B (and C) processed per block by the scalar kernel: a row of the
+ * C block stays in L1.
+ */
+const uint32_t SGEMM_BLOCK_N = 256;
+
+/**
+ * Rows of B processed per block: the panel of B in use by a tile of C stays in
+ * L1 while every row of A goes over it.
+ */
+const uint32_t SGEMM_BLOCK_K = 128;
+
+/**
+ * @brief Signature of the single precision matrix product kernels, C = A * B,
+ * all of them row-major: A is m x k, B is k x n and C is m x n, with lda, ldb
+ * and ldc the distance between consecutive rows.
+ */
+typedef void (*SgemmKernel)(const uint32_t m, const uint32_t n,
+                            const uint32_t k, const float *a,
+                            const uint32_t lda, const float *b,
+                            const uint32_t ldb, float *c, const uint32_t ldc);
+
+/**
+ * @brief Reference implementation of the matrix product, cache-blocked over
+ * the columns of B and the shared dimension, with an inner loop over
+ * contiguous columns the compiler can vectorize.
+ */
+void sgemm_scalar(const uint32_t m, const uint32_t n, const uint32_t k,
+                  const float *a, const uint32_t lda, const float *b,
+                  const uint32_t ldb, float *c, const uint32_t ldc);
+
+/**
+ * @brief Single precision matrix product C = A * B with the widest kernel
+ * supported by this CPU (active_simd_level()). Meant for few rows in A (a
+ * block of frames) against a wide B (model parameters): the SIMD kernels keep
+ * a tile of C in registers while a panel of B is reused by every row of A.
+ *
+ * @param[in] m Rows of A and C.
+ * @param[in] n Columns of B and C.
+ * @param[in] k Columns of A, rows of B.
+ * @param[in] a A matrix.
+ * @param[in] lda Distance between rows of A.
+ * @param[in] b B matrix.
+ * @param[in] ldb Distance between rows of B.
+ * @param[out] c C matrix.
+ * @param[in] ldc Distance between rows of C.
+ */
+void sgemm(const uint32_t m, const uint32_t n, const uint32_t k, const float *a,
+           const uint32_t lda, const float *b, const uint32_t ldb, float *c,
+           const uint32_t ldc);
+
+/**
+ * @brief Get the matrix product kernel for a given instruction set.
+ *
+ * @param[in] level Instruction set.
+ * @return SgemmKernel The kernel, or nullptr if there is no variant for it, it
+ * was not compiled in or this CPU does not support it.
+ */
+SgemmKernel get_sgemm_kernel(const SimdLevel level);
+
+#endif  // GEMM_H_
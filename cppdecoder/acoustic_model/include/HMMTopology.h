@@ -0,0 +1,138 @@
+/*
+ * Copyright 2020 Javier Jorge. All rights reserved.
+ * License: https://github.com/JJorgeDSIC/CppDecoder#license
+ */
+
+#ifndef HMMTOPOLOGY_H_
+#define HMMTOPOLOGY_H_
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Transition of a compiled topology to the HMM state dst, or out of the
+ * HMM if dst is the number of states of the symbol.
+ */
+struct HMMTopologyArc {
+  uint32_t dst;
+  float lprob;
+};
+
+/**
+ * @brief HMM state of a compiled topology: its senone and the log
+ * probabilities of staying in it and of moving to the next state (or leaving
+ * the HMM from the last one). Any other transition (skips, exits from the
+ * middle) is one of its n_arcs arcs from first_arc, left-to-right HMMs have
+ * none.
+ */
+struct HMMTopologyState {
+  int senone;
+  float loop;
+  float forward;
+  uint32_t first_arc;
+  uint32_t n_arcs;
+};
+
+/**
+ * @brief HMM topology of every symbol of an acoustic model, compiled when the
+ * model is read into a flat table indexed by the dense symbol index (see
+ * AcousticModel::getSymbolId), so the search reads the transitions of a node
+ * without string lookups, copies or logarithms.
+ */
+class HMMTopology {
+ public:
+  void clear() {
+    symbol_first.clear();
+    symbol_n_states.clear();
+    symbol_first_entry.clear();
+    symbol_n_entries.clear();
+    states.clear();
+    arcs.clear();
+  }
+
+  /**
+   * @brief Add the next symbol, a left-to-right HMM ("Trans" transitions).
+   *
+   * @param[in] forward Log probability of moving from each state to the next
+   * one, or of leaving the HMM from the last one.
+   * @param[in] senones Senone of each state, -1 if it does not exist.
+   * @return uint32_t The symbol index.
+   */
+  uint32_t addLeftToRight(const std::vector<float> &forward,
+                          const std::vector<int> &senones);
+
+  /**
+   * The transitions that skip the whole HMM (from I to F) are dropped: the
+   * search needs every symbol to emit at least one frame.
+   *
+   * @brief Add the next symbol from its transition matrix ("TransL"
+   * transitions).
+   *
+   * @param[in] matrix (n + 2) x (n + 2) log probabilities, row major, for n
+   * senones: row and column 0 are the initial state I, 1 to n the HMM states
+   * and n + 1 the final state F. -HUGE_VAL for no transition.
+   * @param[in] senones Senone of each state, -1 if it does not exist.
+   * @return uint32_t The symbol index.
+   */
+  uint32_t addMatrix(const std::vector<float> &matrix,
+                     const std::vector<int> &senones);
+
+  /**
+   * @brief Add the next symbol, with transitions the search does not support.
+   *
+   * @return uint32_t The symbol index.
+   */
+  uint32_t addUnsupported();
+
+  uint32_t getNSymbols() const { return symbol_first.size(); }
+
+  /**
+   * @brief Get the number of HMM states of a symbol.
+   *
+   * @param[in] symbol Symbol index.
+   * @return uint32_t The number of states, 0 if its transitions are not
+   * supported.
+   */
+  uint32_t getNStates(const uint32_t symbol) const {
+    return symbol_n_states[symbol];
+  }
+
+  const HMMTopologyState &getState(const uint32_t symbol,
+                                   const uint32_t q) const {
+    return states[symbol_first[symbol] + q];
+  }
+
+  /**
+   * @brief Get the transitions into the HMM of a symbol, from the search graph
+   * node that precedes it.
+   *
+   * @param[in] symbol Symbol index.
+   * @return uint32_t The number of arcs, from getEntry(symbol, 0).
+   */
+  uint32_t getNEntries(const uint32_t symbol) const {
+    return symbol_n_entries[symbol];
+  }
+
+  const HMMTopologyArc &getEntry(const uint32_t symbol,
+                                 const uint32_t i) const {
+    return arcs[symbol_first_entry[symbol] + i];
+  }
+
+  const HMMTopologyArc &getArc(const HMMTopologyState &state,
+                               const uint32_t i) const {
+    return arcs[state.first_arc + i];
+  }
+
+ private:
+  // The states of symbol i are states[symbol_first[i], symbol_first[i] +
+  // symbol_n_states[i]), its entries are arcs[symbol_first_entry[i],
+  // symbol_first_entry[i] + symbol_n_entries[i]).
+  std::vector<uint32_t> symbol_first;
+  std::vector<uint32_t> symbol_n_states;
+  std::vector<uint32_t> symbol_first_entry;
+  std::vector<uint32_t> symbol_n_entries;
+  std::vector<HMMTopologyState> states;
+  std::vector<HMMTopologyArc> arcs;
+};
+
+#endif  // HMMTOPOLOGY_H_
@@ -6,6 +6,8 @@
 #ifndef MIXTUREACOUSTICMODEL_H_
 #define MIXTUREACOUSTICMODEL_H_
 
+#include <BinaryModel.h>
+
 #include <string>
 #include <tuple>
 #include <unordered_map>
@@ -13,6 +15,9 @@
 #include <cassert>
 
 #include "DGaussianAcousticModel.h"
+#include "DimensionOrder.h"
+#include "GaussianSelection.h"
+#include "QuadraticScorer.h"
 
 class TransValue {
  public:
@@ -20,6 +25,8 @@ class TransValue {
 
   std::string &getState() { return state; }
 
+  const std::string &getState() const { return state; }
+
   float getValue() const { return value; }
 
  private:
@@ -27,6 +34,58 @@ class TransValue {
   float value;
 };
 
+/**
+ * Components scored at once by GaussianMixtureState::calc_logprob. Mixtures up
+ * to this size get exactly the same result as robust_add over all of them.
+ */
+const uint32_t MIXTURE_CHUNK = 64;
+
+/**
+ * Frames scored at once by GaussianMixtureState::calc_logprob_block, larger
+ * blocks are scored in pieces of this size.
+ */
+const uint32_t MIXTURE_BLOCK_FRAMES = 16;
+
+/**
+ * @brief How GaussianMixtureState keeps its parameters in memory.
+ *
+ * Float32: means and inverse variances as read from the model.
+ * Int16, Int8: means quantized with a step per dimension (shared by the
+ * components of the mixture and the frames) to 11 or 8 bits, and inverse
+ * variances folded with the squared steps into Q15 or Q7 weights, scored by
+ * the fixed-point kernels (see QuantizedGaussianKernel). They use about a third
+ * and a sixth of the memory of the float means, inverse variances and
+ * variances.
+ * Float16, BFloat16: means and inverse variances in IEEE half precision or
+ * bfloat16, converted to float inside the kernel (see HalfGaussianKernel).
+ * Half of the bytes streamed per Gaussian, a third of the memory.
+ */
+enum class ParamFormat { Float32, Int16, Int8, Float16, BFloat16 };
+
+/**
+ * Standard deviations around the means covered by the quantization range of
+ * each dimension.
+ */
+const float QUANTIZED_RANGE_DEVIATIONS = 4.0;
+
+/**
+ * Largest magnitude of an Int16 quantized mean (the end of the range of the
+ * dimension), the frames go up to QUANTIZED_FRAME_LIMIT, twice the range.
+ */
+const int16_t QUANTIZED_MEAN_LIMIT16 = 1023;
+
+/**
+ * Largest magnitude of an Int8 quantized mean, in steps of
+ * 2^QUANTIZED_MEAN_SHIFT8 Int16 steps.
+ */
+const int8_t QUANTIZED_MEAN_LIMIT8 = 127;
+
+/**
+ * @brief Mixture of diagonal Gaussians stored as structure of arrays: the means
+ * and inverse variances of all the components are packed row by row in
+ * aligned matrices (rows padded to aligned_stride(dim)), so scoring a frame
+ * walks contiguous memory instead of one heap block per component.
+ */
 class GaussianMixtureState {
  public:
   GaussianMixtureState();
@@ -35,7 +94,7 @@ class GaussianMixtureState {
 
   uint32_t getComponents() const { return components; }
 
-  void setComponents(const uint32_t comps) { components = comps; }
+  void setComponents(const uint32_t comps) { reserveComponents(comps); }
 
   void reserveComponents(const uint32_t comps);
 
@@ -44,31 +103,326 @@ class GaussianMixtureState {
   int addGaussianState(const uint32_t d, const std::string &mu_line,
                        const std::string &var_line);
 
-  std::vector<float> &getMuByComponent(const uint32_t component) {
-    return gstates[component].getMu();
+  /**
+   * @brief Read the components of the mixture from the lines that follow
+   * "Members" in a text model, a "MU" line and a "VAR" line for each one.
+   *
+   * @param[in] begin First character of the first "MU" line.
+   * @param[in] end One past the end of the last "VAR" line.
+   * @return int 0 if everything is OK, 1 if there was a problem.
+   */
+  int read_members(const char *begin, const char *end);
+
+  /**
+   * @brief Append the mixture to a binary model: its sizes and weights to the
+   * metadata, its float parameters to the data.
+   *
+   * @param[out] writer Binary model being built.
+   */
+  void write_binary(BinaryModelWriter *writer) const;
+
+  /**
+   * @brief Read a mixture written by write_binary. The parameters are not
+   * copied, the mixture views them in the mapped file, which must outlive it.
+   *
+   * @param[in] reader Binary model, at the mixture.
+   * @param[in] model_dim Dimension of the model the mixture belongs to.
+   * @return int 0 if everything is OK, 1 if there was a problem.
+   */
+  int read_binary(BinaryModelReader *reader, const uint32_t model_dim);
+
+  // Fewest metadata bytes of a mixture in a binary model: its three sizes,
+  // the count of its weights and the offsets of its four blocks.
+  static const std::size_t BINARY_META_BYTES = 4 * 4 + 4 * 8;
+
+  /**
+   * @brief Check whether the float parameters are viewed in a mapped model.
+   */
+  bool isMapped() const { return mus.isView(); }
+
+  // Only while hasFloatParams().
+  VectorView<float> getMuByComponent(const uint32_t component) const {
+    assert(hasFloatParams());
+    return VectorView<float>(&mus[component * stride], dim);
+  }
+  VectorView<float> getVarByComponent(const uint32_t component) const {
+    assert(hasFloatParams());
+    return VectorView<float>(&vars[component * stride], dim);
+  }
+  VectorView<float> getIVarByComponent(const uint32_t component) const {
+    assert(hasFloatParams());
+    return VectorView<float>(&ivars[component * stride], dim);
+  }
+
+  float getLogcByComponent(const uint32_t component) const {
+    return consts[2 * component];
   }
-  std::vector<float> &getVarByComponent(const uint32_t component) {
-    return gstates[component].getVar();
+
+  float getLogWeightByComponent(const uint32_t component) const {
+    return consts[2 * component + 1];
   }
 
   uint32_t getDim() const { return dim; }
 
-  void setDim(const uint32_t dim) { this->dim = dim; }
+  void setDim(const uint32_t dim);
+
+  uint32_t getStride() const { return stride; }
 
   std::vector<float> &getPMembers() { return pmembers; }
 
-  float calc_logprob(const std::vector<float> &frame);
+  /**
+   * @brief Replace the float means, inverse variances and variances by their
+   * quantized or 16-bit float version. Scoring quantizes each frame with the
+   * same steps (Int16, Int8), the log probabilities move slightly away from
+   * the float ones.
+   *
+   * @param[in] format ParamFormat::Int16, Int8, Float16 or BFloat16 (Float32
+   * does nothing).
+   * @return int 0 if everything is OK, 1 if there was a problem: the mixture
+   * is already converted, its dimension is over QUANTIZED_MAX_DIM (Int16,
+   * Int8) or an inverse variance does not fit in half precision (Float16).
+   */
+  int quantize(const ParamFormat format);
+
+  /**
+   * @brief Reorder the dimensions of the float means, inverse variances and
+   * variances, so that dimension i becomes order[i]. Frames must be reordered
+   * the same way before scoring.
+   *
+   * @param[in] order Permutation of [0, getDim()).
+   * @return int 0 if everything is OK, 1 if there was a problem (the mixture
+   * is quantized or order is not a permutation).
+   */
+  int permute_dims(const std::vector<uint32_t> &order);
+
+  /**
+   * @brief Check whether quantize(format) would succeed, printing why not.
+   *
+   * @param[in] format Target format.
+   * @return bool True if the mixture can be converted.
+   */
+  bool canQuantize(const ParamFormat format) const;
+
+  ParamFormat getParamFormat() const { return format; }
+
+  bool hasFloatParams() const { return format == ParamFormat::Float32; }
+
+  /**
+   * @brief Bytes used by the means, inverse variances and variances.
+   *
+   * @return std::size_t The size of the parameters.
+   */
+  std::size_t getParamBytes() const;
+
+  /**
+   * @brief Computes the weighted log probability of the components [begin,
+   * begin + n), in a single pass over the packed parameters.
+   *
+   * @param[in] frame Frame with getDim() values.
+   * @param[in] begin First component.
+   * @param[in] n Number of components.
+   * @param[out] lprobs n values, pmembers[i] + log N(frame; mu_i, var_i).
+   * @return float The maximum of lprobs, or -INFINITY if any of them is
+   * -INFINITY.
+   */
+  float calc_components_logprob(const float *frame, const uint32_t begin,
+                                const uint32_t n, float *lprobs) const;
+
+  /**
+   * @brief Log probability of the mixture. Scores the components in chunks of
+   * MIXTURE_CHUNK on the stack and merges the log-sum-exp of each chunk, so no
+   * memory is allocated.
+   *
+   * @param[in] frame Frame with getDim() values.
+   * @param[in] mode How the exponentials of the log-sum-exp are computed.
+   * @return float Log probability of the frame.
+   */
+  float calc_logprob(const float *frame,
+                     const LogAddMode mode = LogAddMode::Exact) const;
+
+  float calc_logprob(const std::vector<float> &frame) const {
+    return calc_logprob(frame.data());
+  }
+
+  /**
+   * @brief Log probability of the mixture for several frames. Each chunk of
+   * components is loaded once and scored against all the frames, so the
+   * parameters are streamed from memory once per block. Gets the same values
+   * as calc_logprob for each frame.
+   *
+   * @param[in] frames n_frames x getDim() values, one frame after the other.
+   * @param[in] n_frames Number of frames.
+   * @param[out] out n_frames log probabilities.
+   * @param[in] mode How the exponentials of the log-sum-exp are computed.
+   */
+  void calc_logprob_block(const float *frames, const uint32_t n_frames,
+                          float *out,
+                          const LogAddMode mode = LogAddMode::Exact) const;
+
+  /**
+   * @brief Log probability of the mixture approximated by its best weighted
+   * component (LogAddMode::Max), without any exp or log.
+   *
+   * @param[in] frame Frame with getDim() values.
+   * @param[in] partial_distance Drop each component as soon as its partial
+   * distance shows it cannot beat the best one so far, or floor (see
+   * diag_gaussian_distance_bounded), instead of the branch-free loop.
+   * @param[in] floor Log probability the caller is not interested in, only
+   * used with partial_distance.
+   * @return float max_i pmembers[i] + log N(frame; mu_i, var_i), or -HUGE_VAL
+   * if partial_distance is set and it is not above floor.
+   */
+  float calc_max_logprob(const float *frame,
+                         const bool partial_distance = false,
+                         const float floor = -HUGE_VAL) const;
+
+  /**
+   * @brief Log probability of the mixture scoring only some of the components
+   * (see GaussianSelection), the others add a single term.
+   *
+   * @param[in] frame Frame with getDim() values.
+   * @param[in] shortlist Indices of the components to score.
+   * @param[in] n Number of indices.
+   * @param[in] rest Log of the contribution of the components out of the
+   * shortlist, relative to the best one in it; -HUGE_VAL to ignore them. Not
+   * used by LogAddMode::Max.
+   * @param[in] mode How the exponentials of the log-sum-exp are computed.
+   * @return float Log probability of the frame.
+   */
+  float calc_shortlist_logprob(const float *frame, const uint32_t *shortlist,
+                               const uint32_t n, const float rest,
+                               const LogAddMode mode = LogAddMode::Exact) const;
 
  private:
-  std::vector<GaussianState> gstates;
+  void resizeStorage();
+
+  // Parse the next component from the values of its MU and VAR lines.
+  int add_gaussian(const char *mu_begin, const char *mu_end,
+                   const char *var_begin, const char *var_end);
+
+  // The best of best and the weighted log probability of component c.
+  float max_component_logprob(const float *frame, const uint32_t c,
+                              const float best) const;
+
+  // quantize to Float16 or BFloat16.
+  int convert_half(const ParamFormat format);
+
+  // Int16 and Int8 score quantized frames.
+  bool quantizedFrames() const {
+    return format == ParamFormat::Int16 || format == ParamFormat::Int8;
+  }
+
+  // Quantized frame, qstride values (only for the quantized formats).
+  void quantize_frame(const float *frame, int16_t *qframe) const;
+
+  // sum_i (x_i - mu_i)^2 * ivar_i of component c, qframe is only used by the
+  // quantized formats.
+  float component_distance(const float *frame, const int16_t *qframe,
+                           const uint32_t c) const {
+    switch (format) {
+      case ParamFormat::Int16:
+        return qfactors[c] *
+               quantized_gaussian_distance(qframe, &qparams16[2 * c * qstride],
+                                           &qparams16[(2 * c + 1) * qstride],
+                                           qstride);
+      case ParamFormat::Int8:
+        return qfactors[c] *
+               quantized_gaussian_distance8(qframe, &qparams8[2 * c * qstride],
+                                            &qparams8[(2 * c + 1) * qstride],
+                                            qstride);
+      case ParamFormat::Float16:
+        return half_gaussian_distance(frame, &hparams[2 * c * stride],
+                                      &hparams[(2 * c + 1) * stride], dim);
+      case ParamFormat::BFloat16:
+        return bfloat16_gaussian_distance(frame, &hparams[2 * c * stride],
+                                          &hparams[(2 * c + 1) * stride], dim);
+      default:
+        return diag_gaussian_distance(frame, &mus[c * stride],
+                                      &ivars[c * stride], dim);
+    }
+  }
+
+  // Owned, or viewed in a mapped binary model (see read_binary).
+  AlignedArray<float> mus;
+  AlignedArray<float> ivars;
+  // Only read when writing the model.
+  AlignedArray<float> vars;
+  // logc and log weight of each component, interleaved.
+  AlignedArray<float> consts;
   std::vector<float> pmembers;
   uint32_t components;
+  uint32_t loaded;
   uint32_t dim;
+  uint32_t stride;
+
+  ParamFormat format;
+  // Quantized frames and parameters are padded to qstride (a multiple of 16)
+  // with zeros. Component c has its means at 2 * c * qstride and its weights
+  // at (2 * c + 1) * qstride.
+  uint32_t qstride;
+  AlignedVector<int16_t> qparams16;
+  AlignedVector<int8_t> qparams8;
+  // Inverse of the step of each dimension, and the factor that turns the
+  // fixed-point distance of each component into the float one.
+  AlignedVector<float> qinv_scales;
+  std::vector<float> qfactors;
+  // Float16 and BFloat16 means at 2 * c * stride and inverse variances at
+  // (2 * c + 1) * stride.
+  AlignedVector<uint16_t> hparams;
 };
 
+/**
+ * Mixtures parsed by each task when a text model is read in parallel.
+ */
+const uint32_t TEXT_MODEL_CHUNK = 64;
+
+/**
+ * @brief Where the components of a mixture are in a text model, found by a
+ * first pass over the file that only splits lines.
+ */
+struct TextMixtureBlock {
+  GaussianMixtureState *state;
+  const char *begin;
+  const char *end;
+};
+
+/**
+ * @brief Skip the lines of the components of a mixture in a text model, the
+ * first pass of reading it, so read_text_mixtures parses them later.
+ *
+ * @param[in,out] lines Cursor over the model, right after the "Members" line.
+ * @param[in] state Mixture the components belong to.
+ * @param[in] components Number of components.
+ * @return TextMixtureBlock Where the lines are in the model.
+ */
+TextMixtureBlock skip_text_members(LineCursor *lines,
+                                   GaussianMixtureState *state,
+                                   const uint32_t components);
+
+/**
+ * The mixtures are independent, so they are parsed by a thread per core,
+ * TEXT_MODEL_CHUNK mixtures at a time, each one into its own storage, sized
+ * by the first pass.
+ *
+ * @brief Read the components of every mixture of a text model (see
+ * GaussianMixtureState::read_members).
+ *
+ * @param[in] blocks Mixtures and their lines.
+ * @return int 0 if everything is OK, 1 if there was a problem.
+ */
+int read_text_mixtures(const std::vector<TextMixtureBlock> &blocks);
+
 class MixtureAcousticModel : public AcousticModel {
  public:
-  explicit MixtureAcousticModel(const std::string &filename);
+  /**
+   * @brief Construct a new Mixture Acoustic Model object
+   *
+   * @param[in] filename file location
+   * @param[in] format How the Gaussians are kept in memory, see quantize.
+   */
+  explicit MixtureAcousticModel(
+      const std::string &filename,
+      const ParamFormat format = ParamFormat::Float32);
 
   uint32_t getDim() const override { return dim; }
 
@@ -76,18 +430,211 @@ class MixtureAcousticModel : public AcousticModel {
 
   uint32_t getNStates() const override { return n_states; }
 
+  /**
+   * @brief Read the model, from a text file or from a binary model written by
+   * write_binary_model (told apart by their first bytes).
+   *
+   * @param[in] filename File location.
+   * @return int 0 if everything is OK, 1 if there was a problem.
+   */
   int read_model(const std::string &filename) override;
 
   int write_model(const std::string &filename) override;
 
+  /**
+   * Reading it maps the file and parses only the metadata: the Gaussian
+   * parameters are used in place, so loading costs the page faults of the
+   * parameters scored, not the parsing of every float.
+   *
+   * @brief Write the model in the binary format (see BinaryModelHeader).
+   *
+   * @param[in] filename File location, overwritten if it exists.
+   * @return int 0 if everything is OK, 1 if there was a problem.
+   */
+  int write_binary_model(const std::string &filename);
+
   float calc_logprob(const std::string &state, int q,
                      const std::vector<float> &frame) override;
 
+  float calc_logprob(const uint32_t symbol, const int q,
+                     const float *frame) override;
+
+  void calc_logprob_block(const std::string &state, const int q,
+                          const float *frames, const uint32_t n_frames,
+                          float *out) override;
+
   std::string &getStateTransType(const std::string &state) override;
 
   std::vector<float> &getStateTrans(const std::string &state) override;
 
+  const std::string &getStateTransType(const uint32_t symbol) const override {
+    return *symbol_type[symbol];
+  }
+
+  const std::vector<float> &getStateTrans(
+      const uint32_t symbol) const override {
+    return *symbol_trans[symbol];
+  }
+
+  uint32_t getNSymbols() const override { return symbol_first_senone.size(); }
+
+  int getSymbolId(const std::string &state) const override;
+
+  /**
+   * @brief Get the number of senones, one for each state Q of each symbol.
+   *
+   * @return uint32_t The number of senones.
+   */
+  uint32_t getNSenones() const override { return senone_states.size(); }
+
+  /**
+   * @brief Get the dense index of the senone of a symbol and HMM state.
+   *
+   * @param[in] state Acoustic Model state.
+   * @param[in] q Hidden Markov Model state.
+   * @return int The senone index, -1 if it does not exist.
+   */
+  int getSenoneId(const std::string &state, const int q) const override;
+
+  int getSenoneId(const uint32_t symbol, const int q) const override;
+
+  /**
+   * @brief Reorder the frames, if there is a dimension order, or find the
+   * Gaussian selection codeword of every frame, if there is a selection.
+   */
+  void prepare_frames(const float *frames, const uint32_t n_frames,
+                      PreparedFrames *prepared) override;
+
+  float calc_prepared_logprob(const uint32_t senone,
+                              const PreparedFrames &prepared, const uint32_t f,
+                              const float floor = -HUGE_VAL) override;
+
+  void calc_prepared_logprob_block(const uint32_t senone,
+                                   const PreparedFrames &prepared,
+                                   const uint32_t first,
+                                   const uint32_t n_frames,
+                                   float *out) override;
+
+  /**
+   * @brief calc_senone_logprob for a single frame, preparing it first. To
+   * score several senones of the same frame, prepare it once with
+   * prepare_frames and use calc_prepared_logprob.
+   */
+  float calc_senone_logprob(const uint32_t senone, const float *frame) override;
+
+  /**
+   * @brief calc_senone_logprob with a floor, only used with LogAddMode::Max
+   * and partial distance elimination (see
+   * GaussianMixtureState::calc_max_logprob) and without Gaussian selection.
+   */
+  float calc_senone_logprob(const uint32_t senone, const float *frame,
+                            const float floor) override;
+
+  void calc_senone_logprob_block(const uint32_t senone, const float *frames,
+                                 const uint32_t n_frames,
+                                 float *out) override;
+
+  /**
+   * @brief Select how calc_logprob_block scores. ScoringMode::Gemm expands and
+   * packs the parameters the first time it is selected.
+   *
+   * @param[in] mode ScoringMode::Direct (default) or ScoringMode::Gemm.
+   */
+  void setScoringMode(const ScoringMode mode);
+
+  ScoringMode getScoringMode() const { return scoring_mode; }
+
+  /**
+   * @brief Log probability of every senone for a block of frames.
+   *
+   * @param[in] frames n_frames x getDim() values, one frame after the other.
+   * @param[in] n_frames Number of frames.
+   * @param[out] out n_frames x getNSenones() values, out[f * getNSenones() +
+   * s] is the log probability of frame f in senone s.
+   */
+  void calc_logprob_block(const float *frames, const uint32_t n_frames,
+                          float *out) override;
+
+  /**
+   * @brief Get the mixture of every senone, indexed by senone id.
+   *
+   * @return const std::vector<const GaussianMixtureState *>& The mixtures.
+   */
+  const std::vector<const GaussianMixtureState *> &getSenoneStates() const {
+    return senone_states;
+  }
+
+  /**
+   * @brief Read the Gaussian selection built for this model, from then on
+   * calc_logprob and the direct calc_logprob_block only score the shortlisted
+   * components of each mixture. ScoringMode::Gemm still scores all of them.
+   *
+   * @param[in] filename File location.
+   * @return int 0 if everything is OK, 1 if there was a problem (and Gaussian
+   * selection stays disabled).
+   */
+  int read_gaussian_selection(const std::string &filename);
+
+  /**
+   * @brief Go back to scoring every component.
+   */
+  void clearGaussianSelection() { gselection.clear(); }
+
+  GaussianSelection &getGaussianSelection() { return gselection; }
+
+  /**
+   * @brief Reorder the dimensions of every senone by decreasing contribution
+   * to the distance (see DimensionOrder), so partial distance elimination
+   * drops the hopeless components sooner. Frames are reordered when they are
+   * scored; the scores only change by rounding. The model can not be written
+   * nor get a Gaussian selection while the order is set.
+   *
+   * @return int 0 if everything is OK, 1 if there was a problem (a Gaussian
+   * selection is loaded or the model is quantized).
+   */
+  int sortDimensions();
+
+  /**
+   * @brief Go back to the original order of the dimensions.
+   */
+  void clearDimensionOrder();
+
+  bool hasDimensionOrder() const { return dim_order.isSet(); }
+
+  const DimensionOrder &getDimensionOrder() const { return dim_order; }
+
+  /**
+   * @brief Quantize the Gaussians of every senone (see
+   * GaussianMixtureState::quantize). The float parameters are dropped, so the
+   * model can no longer be written, nor packed for ScoringMode::Gemm, nor used
+   * to build a Gaussian selection; a selection read before keeps working.
+   *
+   * @param[in] format ParamFormat::Int16, Int8, Float16 or BFloat16.
+   * @return int 0 if everything is OK, 1 if there was a problem.
+   */
+  int quantize(const ParamFormat format);
+
+  ParamFormat getParamFormat() const { return param_format; }
+
+  /**
+   * @brief Bytes used by the Gaussian parameters of every senone.
+   *
+   * @return std::size_t The size of the parameters.
+   */
+  std::size_t getParamBytes() const;
+
  private:
+  int read_binary_model(const std::string &filename);
+
+  void index_senones();
+
+  // Reorder the dimensions of every mixture, repacking the Gemm scorer.
+  void permute_senones(const std::vector<uint32_t> &order);
+
+  // The TransL transitions of the symbol.
+  bool getTransitionMatrix(const uint32_t symbol,
+                           std::vector<float> *matrix) const override;
+
   typedef std::tuple<std::string, float> value_t;
   std::vector<std::string> states;
   std::unordered_map<std::string, std::vector<GaussianMixtureState>>
@@ -101,6 +648,24 @@ class MixtureAcousticModel : public AcousticModel {
   std::vector<float> smooth;
   uint32_t dim;
   uint32_t n_states;
+
+  // Senone s is senone_states[s], the ones of a symbol are consecutive.
+  std::vector<const GaussianMixtureState *> senone_states;
+
+  // Symbol i is states[i], its senones are symbol_first_senone[i] + [0,
+  // symbol_num_q[i]).
+  std::unordered_map<std::string, uint32_t> state_to_id;
+  std::vector<uint32_t> symbol_first_senone;
+  std::vector<int> symbol_num_q;
+  std::vector<const std::string *> symbol_type;
+  std::vector<const std::vector<float> *> symbol_trans;
+  ScoringMode scoring_mode = ScoringMode::Direct;
+  QuadraticScorer scorer;
+  GaussianSelection gselection;
+  DimensionOrder dim_order;
+  ParamFormat param_format = ParamFormat::Float32;
+  // Binary models whose parameters the mixtures view.
+  std::vector<MappedFile> mapped_files;
 };
 
 #endif  // MIXTUREACOUSTICMODEL_H_
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2020 Javier Jorge. All rights reserved.
+ * License: https://github.com/JJorgeDSIC/CppDecoder#license
+ */
+
+#ifndef QUADRATICSCORER_H_
+#define QUADRATICSCORER_H_
+
+#include <Utils.h>
+
+#include <vector>
+
+class GaussianMixtureState;
+
+/**
+ * How a mixture model scores a block of frames.
+ */
+enum class ScoringMode {
+  Direct,  // GaussianMixtureState::calc_logprob for each senone and frame.
+  Gemm     // QuadraticScorer: every component of every frame in one sgemm.
+};
+
+/**
+ * @brief Scores the diagonal Gaussians of a set of mixtures through their
+ * quadratic expansion:
+ *
+ *   log w + log N(x; mu, var) = [x^2, x, 1] . [-0.5 ivar, mu ivar, k]
+ *   k = log w + logc - 0.5 sum(mu^2 ivar)
+ *
+ * The parameter rows of all the components are precomputed once and packed
+ * transposed, (2 dim + 1) x components, so a block of expanded frames is
+ * scored against every component with a single sgemm, followed by a
+ * log-sum-exp per mixture.
+ */
+class QuadraticScorer {
+ public:
+  QuadraticScorer();
+
+  /**
+   * @brief Drop the parameters and prepare to receive mixtures of dimension
+   * dim.
+   *
+   * @param[in] dim Dimension of the frames.
+   */
+  void reset(const uint32_t dim);
+
+  /**
+   * @brief Expand the components of a mixture and append them.
+   *
+   * @param[in] mixture Mixture to add.
+   * @return uint32_t Index of the mixture (senone) in the scorer.
+   */
+  uint32_t addMixture(const GaussianMixtureState &mixture);
+
+  /**
+   * @brief Pack the parameters added so far, transposed, so they can be used
+   * for scoring. No more mixtures can be added after this.
+   */
+  void pack();
+
+  bool isPacked() const { return !params.empty(); }
+
+  uint32_t getNSenones() const { return offsets.size() - 1; }
+
+  uint32_t getNComponents() const { return n_components; }
+
+  uint32_t getExpandedDim() const { return expanded_dim; }
+
+  /**
+   * @brief Expand frames to [x^2, x, 1].
+   *
+   * @param[in] frames n_frames x dim values, one frame after the other.
+   * @param[in] n_frames Number of frames.
+   * @param[out] expanded n_frames x getExpandedDim() values.
+   */
+  void expand_frames(const float *frames, const uint32_t n_frames,
+                     float *expanded) const;
+
+  /**
+   * @brief Log probability of every mixture for a block of frames.
+   *
+   * @param[in] frames n_frames x dim values, one frame after the other.
+   * @param[in] n_frames Number of frames.
+   * @param[out] out n_frames x getNSenones() values, out[f * getNSenones() +
+   * s] is the log probability of frame f in the mixture s.
+   * @param[in] mode How the exponentials of the log-sum-exp are computed.
+   */
+  void calc_block_logprob(const float *frames, const uint32_t n_frames,
+                          float *out,
+                          const LogAddMode mode = LogAddMode::Exact) const;
+
+ private:
+  uint32_t dim;
+  uint32_t expanded_dim;
+  uint32_t n_components;
+  // Distance between rows of params.
+  uint32_t ldp;
+  // Components of mixture s are the columns [offsets[s], offsets[s + 1]).
+  std::vector<uint32_t> offsets;
+  // Rows of the components as they are added, before packing.
+  std::vector<float> staging;
+  // expanded_dim x ldp, transposed parameter rows.
+  AlignedVector<float> params;
+};
+
+/**
+ * @brief Log-sum-exp of the weighted log probabilities of the components of a
+ * mixture, with the same conventions as GaussianMixtureState::calc_logprob.
+ *
+ * @param[in] lprobs Weighted log probabilities.
+ * @param[in] n Number of components.
+ * @param[in] mode How the exponentials are computed.
+ * @return float Log probability of the mixture.
+ */
+float mixture_log_add(const float *lprobs, const uint32_t n,
+                      const LogAddMode mode = LogAddMode::Exact);
+
+#endif  // QUADRATICSCORER_H_
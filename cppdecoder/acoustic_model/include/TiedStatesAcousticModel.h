@@ -6,20 +6,37 @@
 #ifndef TIEDSTATESACOUSTICMODEL_H_
 #define TIEDSTATESACOUSTICMODEL_H_
 
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 #include "MixtureAcousticModel.h"
 
+/**
+ * Default beam (in log-likelihood) of the fast match: senones whose
+ * context-independent parent scores below the best parent minus the beam are
+ * not scored in full.
+ */
+const float FM_DEFAULT_BEAM = 10.0;
+
+/**
+ * Default penalty added to the parent score of the senones pruned by the fast
+ * match.
+ */
+const float FM_DEFAULT_PENALTY = -5.0;
+
 class TiedStatesAcousticModel : public AcousticModel {
  public:
   /**
    * @brief Construct a new Tied States Acoustic Model object
    *
    * @param[in] filename file location
+   * @param[in] format How the Gaussians are kept in memory, see quantize.
    */
-  explicit TiedStatesAcousticModel(const std::string &filename);
+  explicit TiedStatesAcousticModel(
+      const std::string &filename,
+      const ParamFormat format = ParamFormat::Float32);
   /**
    * @brief Get vectors's dimension.
    *
@@ -40,7 +57,8 @@ class TiedStatesAcousticModel : public AcousticModel {
    */
   void setDim(const uint32_t d) override { dim = d; };
   /**
-   * @brief Read a TiedState Acoustic model from text file.
+   * @brief Read a TiedState Acoustic model from text file, or from a binary
+   * model written by write_binary_model.
    *
    * @param[in] filename File location.
    * @return int 0 if everything is OK, 1 if there was a problem.
@@ -53,6 +71,15 @@ class TiedStatesAcousticModel : public AcousticModel {
    * @return int 0 if everything is OK, 1 if there was a problem.
    */
   int write_model(const std::string &filename) override;
+  /**
+   * @brief Write a TiedState Acoustic model in the binary format, whose
+   * Gaussian parameters are used in place from the mapped file when it is
+   * read (see BinaryModelHeader).
+   *
+   * @param[in] filename File location, overwritten if it exists.
+   * @return int 0 if everything is OK, 1 if there was a problem.
+   */
+  int write_binary_model(const std::string &filename);
   /**
    * @brief Provides the log probability for a frame F, being in a state S and
    * the state Q of the HMM.
@@ -65,6 +92,24 @@ class TiedStatesAcousticModel : public AcousticModel {
    */
   float calc_logprob(const std::string &state, const int q,
                      const std::vector<float> &frame) override;
+
+  float calc_logprob(const uint32_t symbol, const int q,
+                     const float *frame) override;
+  /**
+   * @brief Provides the log probability of several consecutive frames, being
+   * in a state S and the state Q of the HMM, going over the parameters of the
+   * senone once for the whole block.
+   *
+   * @param[in] state Acoustic Model state.
+   * @param[in] q Hidden Markov Model state.
+   * @param[in] frames n_frames x getDim() values, one frame after the other.
+   * @param[in] n_frames Number of frames.
+   * @param[out] out n_frames log probabilities, INFINITY if the state does not
+   * exist.
+   */
+  void calc_logprob_block(const std::string &state, const int q,
+                          const float *frames, const uint32_t n_frames,
+                          float *out) override;
   /**
    * @brief Get the State Trans Type from symbol/state
    *
@@ -81,7 +126,228 @@ class TiedStatesAcousticModel : public AcousticModel {
    */
   std::vector<float> &getStateTrans(const std::string &state) override;
 
+  const std::string &getStateTransType(const uint32_t symbol) const override {
+    return *symbol_type[symbol];
+  }
+
+  const std::vector<float> &getStateTrans(
+      const uint32_t symbol) const override {
+    return *symbol_trans[symbol];
+  }
+
+  uint32_t getNSymbols() const override { return symbol_type.size(); }
+
+  int getSymbolId(const std::string &state) const override;
+
+  /**
+   * @brief Get the number of senones (tied states).
+   *
+   * @return uint32_t The number of senones.
+   */
+  uint32_t getNSenones() const override { return senone_states.size(); }
+
+  /**
+   * @brief Get the dense index of the senone of a symbol and HMM state.
+   *
+   * @param[in] state Acoustic Model state.
+   * @param[in] q Hidden Markov Model state.
+   * @return int The senone index, -1 if it does not exist.
+   */
+  int getSenoneId(const std::string &state, const int q) const override;
+
+  int getSenoneId(const uint32_t symbol, const int q) const override;
+
+  /**
+   * @brief Reorder the frames, score the fast match model on every frame and
+   * find the Gaussian selection codeword of every frame, if there are any.
+   */
+  void prepare_frames(const float *frames, const uint32_t n_frames,
+                      PreparedFrames *prepared) override;
+
+  float calc_prepared_logprob(const uint32_t senone,
+                              const PreparedFrames &prepared, const uint32_t f,
+                              const float floor = -HUGE_VAL) override;
+
+  void calc_prepared_logprob_block(const uint32_t senone,
+                                   const PreparedFrames &prepared,
+                                   const uint32_t first,
+                                   const uint32_t n_frames,
+                                   float *out) override;
+
+  /**
+   * @brief calc_senone_logprob for a single frame, preparing it first. To
+   * score several senones of the same frame, prepare it once with
+   * prepare_frames and use calc_prepared_logprob.
+   */
+  float calc_senone_logprob(const uint32_t senone, const float *frame) override;
+
+  /**
+   * @brief calc_senone_logprob with a floor, only used with LogAddMode::Max
+   * and partial distance elimination (see
+   * GaussianMixtureState::calc_max_logprob) and without Gaussian selection.
+   */
+  float calc_senone_logprob(const uint32_t senone, const float *frame,
+                            const float floor) override;
+
+  void calc_senone_logprob_block(const uint32_t senone, const float *frames,
+                                 const uint32_t n_frames,
+                                 float *out) override;
+
+  /**
+   * @brief Select how calc_logprob_block scores. ScoringMode::Gemm expands and
+   * packs the parameters the first time it is selected.
+   *
+   * @param[in] mode ScoringMode::Direct (default) or ScoringMode::Gemm.
+   */
+  void setScoringMode(const ScoringMode mode);
+
+  ScoringMode getScoringMode() const { return scoring_mode; }
+
+  /**
+   * @brief Log probability of every senone for a block of frames.
+   *
+   * @param[in] frames n_frames x getDim() values, one frame after the other.
+   * @param[in] n_frames Number of frames.
+   * @param[out] out n_frames x getNSenones() values, out[f * getNSenones() +
+   * s] is the log probability of frame f in senone s.
+   */
+  void calc_logprob_block(const float *frames, const uint32_t n_frames,
+                          float *out) override;
+
+  /**
+   * @brief Get the mixture of every senone, indexed by senone id.
+   *
+   * @return const std::vector<const GaussianMixtureState *>& The mixtures.
+   */
+  const std::vector<const GaussianMixtureState *> &getSenoneStates() const {
+    return senone_states;
+  }
+
+  /**
+   * @brief Read the Gaussian selection built for this model, from then on
+   * calc_logprob and the direct calc_logprob_block only score the shortlisted
+   * components of each mixture. ScoringMode::Gemm still scores all of them.
+   *
+   * @param[in] filename File location.
+   * @return int 0 if everything is OK, 1 if there was a problem (and Gaussian
+   * selection stays disabled).
+   */
+  int read_gaussian_selection(const std::string &filename);
+
+  /**
+   * @brief Go back to scoring every component.
+   */
+  void clearGaussianSelection() { gselection.clear(); }
+
+  GaussianSelection &getGaussianSelection() { return gselection; }
+
+  /**
+   * The fast match model is scored on every frame first. A senone is only
+   * scored in full if its context-independent parent, the same HMM state of
+   * the central phone of its symbols, scores within the beam of the best
+   * parent; the rest get the parent score plus the penalty. Senones without a
+   * parent in the fast match model (or with different parents) are always
+   * scored in full, and ScoringMode::Gemm scores every senone in full.
+   *
+   * @brief Read a context-independent (monophone) model to use as fast match.
+   *
+   * @param[in] filename MixtureAcousticModel file, with the central phones of
+   * this model as symbols.
+   * @param[in] beam Beam of the parent scores.
+   * @param[in] penalty Added to the parent score of the pruned senones.
+   * @return int 0 if everything is OK, 1 if there was a problem (and fast
+   * match stays disabled).
+   */
+  int read_fast_match(const std::string &filename,
+                      const float beam = FM_DEFAULT_BEAM,
+                      const float penalty = FM_DEFAULT_PENALTY);
+
+  /**
+   * @brief Go back to scoring every senone in full.
+   */
+  void clearFastMatch();
+
+  bool hasFastMatch() const { return fm_model != nullptr; }
+
+  void setFastMatchBeam(const float beam) { fm_beam = beam; }
+
+  float getFastMatchBeam() const { return fm_beam; }
+
+  void setFastMatchPenalty(const float penalty) { fm_penalty = penalty; }
+
+  float getFastMatchPenalty() const { return fm_penalty; }
+
+  /**
+   * @brief Get the context-independent parent of a senone.
+   *
+   * @param[in] senone Senone index.
+   * @return int Senone index in the fast match model, -1 if it has none.
+   */
+  int getFastMatchParent(const uint32_t senone) const {
+    return fm_model ? fm_parents[senone] : -1;
+  }
+
+  /**
+   * @brief Get the central phone of a context-dependent symbol, without its
+   * left (l-) and right (+r) contexts.
+   *
+   * @param[in] symbol Symbol, such as l-c+r, l-c, c+r or c.
+   * @return std::string The central phone c.
+   */
+  static std::string getCentralPhone(const std::string &symbol);
+
+  /**
+   * @brief Reorder the dimensions of every senone by decreasing contribution
+   * to the distance (see MixtureAcousticModel::sortDimensions). The fast match
+   * model keeps its order.
+   *
+   * @return int 0 if everything is OK, 1 if there was a problem (a Gaussian
+   * selection is loaded or the model is quantized).
+   */
+  int sortDimensions();
+
+  /**
+   * @brief Go back to the original order of the dimensions.
+   */
+  void clearDimensionOrder();
+
+  bool hasDimensionOrder() const { return dim_order.isSet(); }
+
+  const DimensionOrder &getDimensionOrder() const { return dim_order; }
+
+  /**
+   * @brief Quantize the Gaussians of every senone (see
+   * GaussianMixtureState::quantize). The float parameters are dropped, so the
+   * model can no longer be written, nor packed for ScoringMode::Gemm, nor used
+   * to build a Gaussian selection; a selection read before keeps working.
+   *
+   * @param[in] format ParamFormat::Int16, Int8, Float16 or BFloat16.
+   * @return int 0 if everything is OK, 1 if there was a problem.
+   */
+  int quantize(const ParamFormat format);
+
+  ParamFormat getParamFormat() const { return param_format; }
+
+  /**
+   * @brief Bytes used by the Gaussian parameters of every senone.
+   *
+   * @return std::size_t The size of the parameters.
+   */
+  std::size_t getParamBytes() const;
+
  private:
+  int read_binary_model(const std::string &filename);
+
+  void index_senones();
+
+  // Reorder the dimensions of every mixture, repacking the Gemm scorer.
+  void permute_senones(const std::vector<uint32_t> &order);
+
+  // True if the fast match prunes the senone for frame f of prepared, with
+  // its score in lprob.
+  bool fast_match_pruned(const uint32_t senone, const PreparedFrames &prepared,
+                         const uint32_t f, float *lprob) const;
+
   uint32_t dim;
   uint32_t n_states;
   uint32_t n_trans;
@@ -96,6 +362,32 @@ class TiedStatesAcousticModel : public AcousticModel {
   std::unordered_map<std::string, std::vector<float>> symbol_to_transitions;
   std::unordered_map<std::string, std::vector<std::string>> symbol_to_senones;
   std::unordered_map<std::string, std::string> symbol_to_type;
+
+  // Senone s is senone_states[s], in the order of the model file.
+  std::vector<const GaussianMixtureState *> senone_states;
+  std::unordered_map<std::string, uint32_t> senone_to_id;
+
+  // Symbol i is symbols[i], its senones are
+  // symbol_senone_ids[symbol_senone_offsets[i], symbol_senone_offsets[i + 1]),
+  // -1 for a senone that does not exist.
+  std::unordered_map<std::string, uint32_t> symbol_to_id;
+  std::vector<uint32_t> symbol_senone_offsets;
+  std::vector<int> symbol_senone_ids;
+  std::vector<const std::string *> symbol_type;
+  std::vector<const std::vector<float> *> symbol_trans;
+  ScoringMode scoring_mode = ScoringMode::Direct;
+  QuadraticScorer scorer;
+  GaussianSelection gselection;
+  DimensionOrder dim_order;
+
+  std::unique_ptr<MixtureAcousticModel> fm_model;
+  // Fast match senone of each senone, -1 if it is always scored in full.
+  std::vector<int> fm_parents;
+  float fm_beam = FM_DEFAULT_BEAM;
+  float fm_penalty = FM_DEFAULT_PENALTY;
+  ParamFormat param_format = ParamFormat::Float32;
+  // Binary models whose parameters the mixtures view.
+  std::vector<MappedFile> mapped_files;
 };
 
 #endif  // TIEDSTATESACOUSTICMODEL_H_
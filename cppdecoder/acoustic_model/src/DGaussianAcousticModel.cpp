@@ -27,16 +27,21 @@ void GaussianState::addMu(const std::string &line) {
 
 void GaussianState::addVar(const std::string &line) {
   var = read_vector<float>(line);
+  ivar.resize(var.size());
+  logc = calc_ivar_logc(var.data(), var.size(), ivar.data());
+}
 
+float GaussianState::calc_ivar_logc(const float *var, const uint32_t dim,
+                                    float *ivar) {
   float lgc = 0.0f;
 
-  for (auto value : var) {
-    ivar.emplace_back(1.0 / value);
-    lgc += log(value);
+  for (uint32_t i = 0; i < dim; i++) {
+    ivar[i] = 1.0 / var[i];
+    lgc += log(var[i]);
   }
-  lgc += var.size() * LOG2PI;
+  lgc += dim * LOG2PI;
 
-  logc = -0.5 * lgc;
+  return -0.5 * lgc;
 }
 
 void GaussianState::print_state() {
@@ -45,14 +50,26 @@ void GaussianState::print_state() {
   std::cout << logc << std::endl;
 }
 
-float GaussianState::calc_logprob(const std::vector<float> &frame) {
-  float prob = 0.0;
-  float aux = 0.0;
+float GaussianState::calc_logprob(const float *frame) {
+  float prob = diag_gaussian_distance(frame, mu.data(), ivar.data(), dim);
+  return -0.5 * prob + logc;
+}
 
-  for (auto i = 0; i < frame.size(); i++) {
-    aux = frame[i] - mu[i];
-    prob += (aux * aux) * ivar[i];
-  }
+float GaussianState::calc_logprob(const float *frame, const float floor) {
+  // Only above floor if logc - 0.5 * distance > floor.
+  const float bound = 2 * (logc - floor);
+  if (bound <= 0) return -HUGE_VAL;
+
+  float distance =
+      diag_gaussian_distance_bounded(frame, mu.data(), ivar.data(), dim, bound);
+  if (distance >= bound) return -HUGE_VAL;
+
+  return -0.5 * distance + logc;
+}
+
+float GaussianState::calc_logprob(const std::vector<float> &frame) {
+  float prob =
+      diag_gaussian_distance(frame.data(), mu.data(), ivar.data(), frame.size());
   return -0.5 * prob + logc;
 }
 
@@ -126,6 +143,8 @@ int DGaussianAcousticModel::read_model(const std::string &filename) {
     }
 
     fileI.close();
+
+    index_senones();
   } else {
     std::cout << "Unable to open the file " << filename << " for reading."
               << std::endl;
@@ -224,4 +243,74 @@ std::vector<float> &DGaussianAcousticModel::getStateTrans(
     const std::string &state) {
   // TODO: Check if transL or trans
   return state_to_trans[state];
-}
\ No newline at end of file
+}
+
+void DGaussianAcousticModel::index_senones() {
+  senone_states.clear();
+  state_to_id.clear();
+  symbol_first_senone.clear();
+  symbol_num_q.clear();
+  symbol_type.clear();
+  symbol_trans.clear();
+
+  for (auto &name : states) {
+    std::vector<std::unique_ptr<GaussianState>> &gstates =
+        state_to_gstate[name];
+
+    state_to_id[name] = symbol_first_senone.size();
+    symbol_first_senone.push_back(senone_states.size());
+    symbol_num_q.push_back(gstates.size());
+    symbol_type.push_back(&state_to_type[name]);
+    symbol_trans.push_back(&state_to_trans[name]);
+    for (auto &gstate : gstates) senone_states.push_back(gstate.get());
+  }
+
+  compile_topology();
+}
+
+int DGaussianAcousticModel::getSymbolId(const std::string &state) const {
+  auto it = state_to_id.find(state);
+  if (it == state_to_id.end()) return -1;
+
+  return it->second;
+}
+
+int DGaussianAcousticModel::getSenoneId(const std::string &state,
+                                        const int q) const {
+  int symbol = getSymbolId(state);
+  if (symbol < 0) return -1;
+
+  return getSenoneId(static_cast<uint32_t>(symbol), q);
+}
+
+int DGaussianAcousticModel::getSenoneId(const uint32_t symbol,
+                                        const int q) const {
+  if (symbol >= symbol_num_q.size()) return -1;
+
+  if (q < 0 || q >= symbol_num_q[symbol]) return -1;
+
+  return symbol_first_senone[symbol] + q;
+}
+
+float DGaussianAcousticModel::calc_logprob(const uint32_t symbol, const int q,
+                                           const float *frame) {
+  int senone = getSenoneId(symbol, q);
+
+  if (senone < 0) return INFINITY;
+
+  return calc_senone_logprob(senone, frame);
+}
+
+float DGaussianAcousticModel::calc_senone_logprob(const uint32_t senone,
+                                                  const float *frame) {
+  return senone_states[senone]->calc_logprob(frame);
+}
+
+float DGaussianAcousticModel::calc_senone_logprob(const uint32_t senone,
+                                                  const float *frame,
+                                                  const float floor) {
+  if (!partial_distance || floor == -HUGE_VAL)
+    return calc_senone_logprob(senone, frame);
+
+  return senone_states[senone]->calc_logprob(frame, floor);
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2020 Javier Jorge. All rights reserved.
+ * License: https://github.com/JJorgeDSIC/CppDecoder#license
+ */
+
+#include "DimensionOrder.h"
+
+#include <algorithm>
+
+#include "MixtureAcousticModel.h"
+
+DimensionOrder::DimensionOrder() : dim(0) {}
+
+void DimensionOrder::clear() {
+  dim = 0;
+  order.clear();
+}
+
+int DimensionOrder::build(
+    const std::vector<const GaussianMixtureState *> &senones) {
+  clear();
+
+  if (senones.empty()) {
+    std::cout << "Nothing to build a dimension order from." << std::endl;
+    return 1;
+  }
+
+  if (!senones[0]->hasFloatParams()) {
+    std::cout << "Unable to build a dimension order from a quantized model."
+              << std::endl;
+    return 1;
+  }
+
+  const uint32_t n_dims = senones[0]->getDim();
+  std::vector<double> mu_sum(n_dims, 0.0), mu_sq_sum(n_dims, 0.0);
+  std::vector<double> var_sum(n_dims, 0.0), ivar_sum(n_dims, 0.0);
+  uint32_t n = 0;
+
+  for (auto state : senones) {
+    for (uint32_t c = 0; c < state->getComponents(); c++) {
+      VectorView<float> mu = state->getMuByComponent(c);
+      VectorView<float> var = state->getVarByComponent(c);
+      VectorView<float> ivar = state->getIVarByComponent(c);
+      for (uint32_t i = 0; i < n_dims; i++) {
+        mu_sum[i] += mu[i];
+        mu_sq_sum[i] += mu[i] * mu[i];
+        var_sum[i] += var[i];
+        ivar_sum[i] += ivar[i];
+      }
+      n++;
+    }
+  }
+
+  std::vector<double> contribution(n_dims);
+  for (uint32_t i = 0; i < n_dims; i++) {
+    double mean = mu_sum[i] / n;
+    double spread = mu_sq_sum[i] / n - mean * mean + var_sum[i] / n;
+    contribution[i] = spread * ivar_sum[i] / n;
+  }
+
+  dim = n_dims;
+  order.resize(dim);
+  for (uint32_t i = 0; i < dim; i++) order[i] = i;
+  std::stable_sort(order.begin(), order.end(),
+                   [&contribution](uint32_t a, uint32_t b) {
+                     return contribution[a] > contribution[b];
+                   });
+
+  return 0;
+}
+
+std::vector<uint32_t> DimensionOrder::getInverse() const {
+  std::vector<uint32_t> inverse(order.size());
+  for (uint32_t i = 0; i < order.size(); i++) inverse[order[i]] = i;
+  return inverse;
+}
+
+const float *DimensionOrder::apply_block(const float *frames,
+                                         const uint32_t n_frames,
+                                         std::vector<float> *buffer) const {
+  if (!isSet()) return frames;
+
+  buffer->resize(n_frames * dim);
+  for (uint32_t f = 0; f < n_frames; f++)
+    for (uint32_t i = 0; i < dim; i++)
+      (*buffer)[f * dim + i] = frames[f * dim + order[i]];
+
+  return buffer->data();
+}
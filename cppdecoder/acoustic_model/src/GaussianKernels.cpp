@@ -0,0 +1,386 @@
+/*
+ * Copyright 2020 Javier Jorge. All rights reserved.
+ * License: https://github.com/JJorgeDSIC/CppDecoder#license
+ */
+
+#include "GaussianKernels.h"
+
+#include <cstring>
+
+#ifdef CPPDECODER_X86_KERNELS
+// Defined in GaussianKernels{SSE4,AVX2,AVX512}.cpp, each one compiled with the
+// flags of its instruction set. They must only be called if the CPU supports
+// it.
+float diag_gaussian_distance_sse4(const float *x, const float *mu,
+                                  const float *ivar, const uint32_t dim);
+float diag_gaussian_distance_avx2(const float *x, const float *mu,
+                                  const float *ivar, const uint32_t dim);
+float diag_gaussian_distance_avx512(const float *x, const float *mu,
+                                    const float *ivar, const uint32_t dim);
+float diag_gaussian_distance_bounded_avx2(const float *x, const float *mu,
+                                          const float *ivar,
+                                          const uint32_t dim,
+                                          const float bound);
+float diag_gaussian_distance_bounded_avx512(const float *x, const float *mu,
+                                            const float *ivar,
+                                            const uint32_t dim,
+                                            const float bound);
+int32_t quantized_gaussian_distance_avx2(const int16_t *x, const int16_t *mu,
+                                         const int16_t *w, const uint32_t dim);
+int32_t quantized_gaussian_distance8_avx2(const int16_t *x, const int8_t *mu,
+                                          const int8_t *w, const uint32_t dim);
+float half_gaussian_distance_avx2(const float *x, const uint16_t *mu,
+                                  const uint16_t *ivar, const uint32_t dim);
+float half_gaussian_distance_avx512(const float *x, const uint16_t *mu,
+                                    const uint16_t *ivar, const uint32_t dim);
+float bfloat16_gaussian_distance_avx2(const float *x, const uint16_t *mu,
+                                      const uint16_t *ivar,
+                                      const uint32_t dim);
+float bfloat16_gaussian_distance_avx512(const float *x, const uint16_t *mu,
+                                        const uint16_t *ivar,
+                                        const uint32_t dim);
+#endif
+
+float diag_gaussian_distance_scalar(const float *x, const float *mu,
+                                    const float *ivar, const uint32_t dim) {
+  float prob = 0.0;
+  float aux = 0.0;
+
+  for (uint32_t i = 0; i < dim; i++) {
+    aux = x[i] - mu[i];
+    prob += (aux * aux) * ivar[i];
+  }
+  return prob;
+}
+
+float diag_gaussian_distance_bounded_scalar(const float *x, const float *mu,
+                                            const float *ivar,
+                                            const uint32_t dim,
+                                            const float bound) {
+  float distance = 0.0;
+  float aux = 0.0;
+
+  for (uint32_t begin = 0; begin < dim; begin += PDE_BLOCK) {
+    const uint32_t end = dim - begin < PDE_BLOCK ? dim : begin + PDE_BLOCK;
+    for (uint32_t i = begin; i < end; i++) {
+      aux = x[i] - mu[i];
+      distance += (aux * aux) * ivar[i];
+    }
+    if (distance > bound) break;
+  }
+  return distance;
+}
+
+int32_t quantized_gaussian_distance_scalar(const int16_t *x, const int16_t *mu,
+                                           const int16_t *w,
+                                           const uint32_t dim) {
+  int32_t distance = 0;
+
+  for (uint32_t i = 0; i < dim; i++) {
+    int32_t d = x[i] - mu[i];
+    distance += d * ((d * w[i] + (1 << 14)) >> 15);
+  }
+  return distance;
+}
+
+int32_t quantized_gaussian_distance8_scalar(const int16_t *x, const int8_t *mu,
+                                            const int8_t *w,
+                                            const uint32_t dim) {
+  int32_t distance = 0;
+
+  for (uint32_t i = 0; i < dim; i++) {
+    int32_t d = x[i] - mu[i] * (1 << QUANTIZED_MEAN_SHIFT8);
+    distance += d * ((d * (w[i] << 8) + (1 << 14)) >> 15);
+  }
+  return distance;
+}
+
+uint16_t float_to_half(const float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+
+  const uint16_t sign = (bits >> 16) & 0x8000;
+  const int32_t exponent = ((bits >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = bits & 0x7fffff;
+
+  // NaN and infinity.
+  if (((bits >> 23) & 0xff) == 0xff)
+    return sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0);
+
+  // Overflow to infinity.
+  if (exponent >= 0x1f) return sign | 0x7c00;
+
+  // Subnormal half (or zero): the implicit bit becomes explicit.
+  if (exponent <= 0) {
+    if (exponent < -10) return sign;
+    mantissa |= 0x800000;
+    const uint32_t shift = 14 - exponent;
+    uint32_t half = mantissa >> shift;
+    const uint32_t rest = mantissa & ((1u << shift) - 1);
+    const uint32_t halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (half & 1))) half++;
+    return sign | half;
+  }
+
+  // Normal: rounding may carry into the exponent, up to infinity.
+  uint32_t half = (exponent << 10) | (mantissa >> 13);
+  const uint32_t rest = mantissa & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) half++;
+  return sign | half;
+}
+
+float half_to_float(const uint16_t half) {
+  const uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+  uint32_t exponent = (half >> 10) & 0x1f;
+  uint32_t mantissa = half & 0x3ff;
+  uint32_t bits;
+
+  if (exponent == 0x1f) {
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  } else if (exponent != 0) {
+    bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+  } else if (mantissa == 0) {
+    bits = sign;
+  } else {
+    // Subnormal half, normal float.
+    exponent = 127 - 15 + 1;
+    while ((mantissa & 0x400) == 0) {
+      mantissa <<= 1;
+      exponent--;
+    }
+    bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+  }
+
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+uint16_t float_to_bfloat16(const float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+
+  // NaN stays NaN.
+  if ((bits & 0x7fffffff) > 0x7f800000) return (bits >> 16) | 0x40;
+
+  bits += 0x7fff + ((bits >> 16) & 1);
+  return bits >> 16;
+}
+
+float bfloat16_to_float(const uint16_t bfloat16) {
+  const uint32_t bits = static_cast<uint32_t>(bfloat16) << 16;
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+float half_gaussian_distance_scalar(const float *x, const uint16_t *mu,
+                                    const uint16_t *ivar, const uint32_t dim) {
+  float prob = 0.0;
+  float aux = 0.0;
+
+  for (uint32_t i = 0; i < dim; i++) {
+    aux = x[i] - half_to_float(mu[i]);
+    prob += (aux * aux) * half_to_float(ivar[i]);
+  }
+  return prob;
+}
+
+float bfloat16_gaussian_distance_scalar(const float *x, const uint16_t *mu,
+                                        const uint16_t *ivar,
+                                        const uint32_t dim) {
+  float prob = 0.0;
+  float aux = 0.0;
+
+  for (uint32_t i = 0; i < dim; i++) {
+    aux = x[i] - bfloat16_to_float(mu[i]);
+    prob += (aux * aux) * bfloat16_to_float(ivar[i]);
+  }
+  return prob;
+}
+
+static bool cpu_supports(const SimdLevel level) {
+#ifdef CPPDECODER_X86_KERNELS
+  __builtin_cpu_init();
+  switch (level) {
+    case SimdLevel::Scalar:
+      return true;
+    case SimdLevel::SSE4:
+      return __builtin_cpu_supports("sse4.1");
+    case SimdLevel::AVX2:
+      return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case SimdLevel::AVX512:
+      return __builtin_cpu_supports("avx512f");
+  }
+  return false;
+#else
+  return level == SimdLevel::Scalar;
+#endif
+}
+
+DiagGaussianKernel get_diag_gaussian_kernel(const SimdLevel level) {
+  if (!cpu_supports(level)) return nullptr;
+
+  switch (level) {
+    case SimdLevel::Scalar:
+      return diag_gaussian_distance_scalar;
+#ifdef CPPDECODER_X86_KERNELS
+    case SimdLevel::SSE4:
+      return diag_gaussian_distance_sse4;
+    case SimdLevel::AVX2:
+      return diag_gaussian_distance_avx2;
+    case SimdLevel::AVX512:
+      return diag_gaussian_distance_avx512;
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+DiagGaussianBoundedKernel get_diag_gaussian_bounded_kernel(
+    const SimdLevel level) {
+  if (!cpu_supports(level)) return nullptr;
+
+  switch (level) {
+#ifdef CPPDECODER_X86_KERNELS
+    case SimdLevel::AVX2:
+      return diag_gaussian_distance_bounded_avx2;
+    case SimdLevel::AVX512:
+      return diag_gaussian_distance_bounded_avx512;
+#endif
+    default:
+      return diag_gaussian_distance_bounded_scalar;
+  }
+}
+
+QuantizedGaussianKernel get_quantized_gaussian_kernel(const SimdLevel level) {
+  if (!cpu_supports(level)) return nullptr;
+
+  switch (level) {
+#ifdef CPPDECODER_X86_KERNELS
+    case SimdLevel::AVX2:
+    case SimdLevel::AVX512:
+      return quantized_gaussian_distance_avx2;
+#endif
+    default:
+      return quantized_gaussian_distance_scalar;
+  }
+}
+
+QuantizedGaussianKernel8 get_quantized_gaussian_kernel8(
+    const SimdLevel level) {
+  if (!cpu_supports(level)) return nullptr;
+
+  switch (level) {
+#ifdef CPPDECODER_X86_KERNELS
+    case SimdLevel::AVX2:
+    case SimdLevel::AVX512:
+      return quantized_gaussian_distance8_avx2;
+#endif
+    default:
+      return quantized_gaussian_distance8_scalar;
+  }
+}
+
+HalfGaussianKernel get_half_gaussian_kernel(const SimdLevel level) {
+  if (!cpu_supports(level)) return nullptr;
+
+  switch (level) {
+#ifdef CPPDECODER_X86_KERNELS
+    case SimdLevel::AVX2:
+      // F16C comes with every AVX2 CPU, but it is a separate flag.
+      if (!__builtin_cpu_supports("f16c")) return half_gaussian_distance_scalar;
+      return half_gaussian_distance_avx2;
+    case SimdLevel::AVX512:
+      return half_gaussian_distance_avx512;
+#endif
+    default:
+      return half_gaussian_distance_scalar;
+  }
+}
+
+HalfGaussianKernel get_bfloat16_gaussian_kernel(const SimdLevel level) {
+  if (!cpu_supports(level)) return nullptr;
+
+  switch (level) {
+#ifdef CPPDECODER_X86_KERNELS
+    case SimdLevel::AVX2:
+      return bfloat16_gaussian_distance_avx2;
+    case SimdLevel::AVX512:
+      return bfloat16_gaussian_distance_avx512;
+#endif
+    default:
+      return bfloat16_gaussian_distance_scalar;
+  }
+}
+
+SimdLevel detect_simd_level() {
+  const SimdLevel levels[] = {SimdLevel::AVX512, SimdLevel::AVX2,
+                              SimdLevel::SSE4};
+  for (auto level : levels) {
+    if (get_diag_gaussian_kernel(level) != nullptr) return level;
+  }
+  return SimdLevel::Scalar;
+}
+
+SimdLevel active_simd_level() {
+  static const SimdLevel level = detect_simd_level();
+  return level;
+}
+
+float diag_gaussian_distance(const float *x, const float *mu,
+                             const float *ivar, const uint32_t dim) {
+  static const DiagGaussianKernel kernel =
+      get_diag_gaussian_kernel(active_simd_level());
+  return kernel(x, mu, ivar, dim);
+}
+
+float diag_gaussian_distance_bounded(const float *x, const float *mu,
+                                     const float *ivar, const uint32_t dim,
+                                     const float bound) {
+  static const DiagGaussianBoundedKernel kernel =
+      get_diag_gaussian_bounded_kernel(active_simd_level());
+  return kernel(x, mu, ivar, dim, bound);
+}
+
+int32_t quantized_gaussian_distance(const int16_t *x, const int16_t *mu,
+                                    const int16_t *w, const uint32_t dim) {
+  static const QuantizedGaussianKernel kernel =
+      get_quantized_gaussian_kernel(active_simd_level());
+  return kernel(x, mu, w, dim);
+}
+
+int32_t quantized_gaussian_distance8(const int16_t *x, const int8_t *mu,
+                                     const int8_t *w, const uint32_t dim) {
+  static const QuantizedGaussianKernel8 kernel =
+      get_quantized_gaussian_kernel8(active_simd_level());
+  return kernel(x, mu, w, dim);
+}
+
+float half_gaussian_distance(const float *x, const uint16_t *mu,
+                             const uint16_t *ivar, const uint32_t dim) {
+  static const HalfGaussianKernel kernel =
+      get_half_gaussian_kernel(active_simd_level());
+  return kernel(x, mu, ivar, dim);
+}
+
+float bfloat16_gaussian_distance(const float *x, const uint16_t *mu,
+                                 const uint16_t *ivar, const uint32_t dim) {
+  static const HalfGaussianKernel kernel =
+      get_bfloat16_gaussian_kernel(active_simd_level());
+  return kernel(x, mu, ivar, dim);
+}
+
+const char *simd_level_name(const SimdLevel level) {
+  switch (level) {
+    case SimdLevel::Scalar:
+      return "scalar";
+    case SimdLevel::SSE4:
+      return "sse4";
+    case SimdLevel::AVX2:
+      return "avx2";
+    case SimdLevel::AVX512:
+      return "avx512";
+  }
+  return "unknown";
+}
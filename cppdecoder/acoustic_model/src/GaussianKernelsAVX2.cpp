@@ -0,0 +1,207 @@
+/*
+ * Copyright 2020 Javier Jorge. All rights reserved.
+ * License: https://github.com/JJorgeDSIC/CppDecoder#license
+ */
+
+#include <immintrin.h>
+
+#include <cstdint>
+
+float diag_gaussian_distance_avx2(const float *x, const float *mu,
+                                  const float *ivar, const uint32_t dim) {
+  __m256 acc0 = _mm256_setzero_ps();
+  __m256 acc1 = _mm256_setzero_ps();
+  uint32_t i = 0;
+
+  for (; i + 16 <= dim; i += 16) {
+    __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(mu + i));
+    __m256 d1 =
+        _mm256_sub_ps(_mm256_loadu_ps(x + i + 8), _mm256_loadu_ps(mu + i + 8));
+    acc0 = _mm256_fmadd_ps(_mm256_mul_ps(d0, d0), _mm256_loadu_ps(ivar + i),
+                           acc0);
+    acc1 = _mm256_fmadd_ps(_mm256_mul_ps(d1, d1),
+                           _mm256_loadu_ps(ivar + i + 8), acc1);
+  }
+  for (; i + 8 <= dim; i += 8) {
+    __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(mu + i));
+    acc0 = _mm256_fmadd_ps(_mm256_mul_ps(d0, d0), _mm256_loadu_ps(ivar + i),
+                           acc0);
+  }
+
+  __m256 acc = _mm256_add_ps(acc0, acc1);
+  __m128 acc4 =
+      _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+  acc4 = _mm_add_ps(acc4, _mm_movehl_ps(acc4, acc4));
+  acc4 = _mm_add_ss(acc4, _mm_shuffle_ps(acc4, acc4, 0x55));
+  float prob = _mm_cvtss_f32(acc4);
+
+  for (; i < dim; i++) {
+    float aux = x[i] - mu[i];
+    prob += (aux * aux) * ivar[i];
+  }
+  return prob;
+}
+
+static inline float hsum_avx2(const __m256 acc) {
+  __m128 acc4 =
+      _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+  acc4 = _mm_add_ps(acc4, _mm_movehl_ps(acc4, acc4));
+  acc4 = _mm_add_ss(acc4, _mm_shuffle_ps(acc4, acc4, 0x55));
+  return _mm_cvtss_f32(acc4);
+}
+
+float diag_gaussian_distance_bounded_avx2(const float *x, const float *mu,
+                                          const float *ivar,
+                                          const uint32_t dim,
+                                          const float bound) {
+  float distance = 0.0;
+  uint32_t i = 0;
+
+  // One check every PDE_BLOCK (16) dimensions.
+  for (; i + 16 <= dim; i += 16) {
+    __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(mu + i));
+    __m256 d1 =
+        _mm256_sub_ps(_mm256_loadu_ps(x + i + 8), _mm256_loadu_ps(mu + i + 8));
+    __m256 acc =
+        _mm256_mul_ps(_mm256_mul_ps(d0, d0), _mm256_loadu_ps(ivar + i));
+    acc = _mm256_fmadd_ps(_mm256_mul_ps(d1, d1), _mm256_loadu_ps(ivar + i + 8),
+                          acc);
+    distance += hsum_avx2(acc);
+    if (distance > bound) return distance;
+  }
+  if (i + 8 <= dim) {
+    __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(mu + i));
+    distance += hsum_avx2(
+        _mm256_mul_ps(_mm256_mul_ps(d0, d0), _mm256_loadu_ps(ivar + i)));
+    i += 8;
+  }
+  for (; i < dim; i++) {
+    float aux = x[i] - mu[i];
+    distance += (aux * aux) * ivar[i];
+  }
+  return distance;
+}
+
+static inline int32_t hsum_epi32_avx2(const __m256i acc) {
+  __m128i acc4 = _mm_add_epi32(_mm256_castsi256_si128(acc),
+                               _mm256_extracti128_si256(acc, 1));
+  acc4 = _mm_add_epi32(acc4, _mm_unpackhi_epi64(acc4, acc4));
+  acc4 = _mm_add_epi32(acc4, _mm_shuffle_epi32(acc4, 0x55));
+  return _mm_cvtsi128_si32(acc4);
+}
+
+// vpmulhrsw is (d * w + 2^14) >> 15, and vpmaddwd adds the products of
+// consecutive pairs into int32. Int8 means are shifted by
+// QUANTIZED_MEAN_SHIFT8 (3).
+int32_t quantized_gaussian_distance_avx2(const int16_t *x, const int16_t *mu,
+                                         const int16_t *w,
+                                         const uint32_t dim) {
+  __m256i acc = _mm256_setzero_si256();
+  uint32_t i = 0;
+
+  for (; i + 16 <= dim; i += 16) {
+    __m256i d = _mm256_sub_epi16(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + i)),
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(mu + i)));
+    __m256i dw = _mm256_mulhrs_epi16(
+        d, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(w + i)));
+    acc = _mm256_add_epi32(acc, _mm256_madd_epi16(d, dw));
+  }
+
+  int32_t distance = hsum_epi32_avx2(acc);
+
+  for (; i < dim; i++) {
+    int32_t d = x[i] - mu[i];
+    distance += d * ((d * w[i] + (1 << 14)) >> 15);
+  }
+  return distance;
+}
+
+int32_t quantized_gaussian_distance8_avx2(const int16_t *x, const int8_t *mu,
+                                          const int8_t *w,
+                                          const uint32_t dim) {
+  __m256i acc = _mm256_setzero_si256();
+  uint32_t i = 0;
+
+  for (; i + 16 <= dim; i += 16) {
+    __m256i m = _mm256_slli_epi16(
+        _mm256_cvtepi8_epi16(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(mu + i))),
+        3);
+    __m256i q15 = _mm256_slli_epi16(
+        _mm256_cvtepi8_epi16(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(w + i))),
+        8);
+    __m256i d = _mm256_sub_epi16(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + i)), m);
+    acc = _mm256_add_epi32(acc,
+                           _mm256_madd_epi16(d, _mm256_mulhrs_epi16(d, q15)));
+  }
+
+  int32_t distance = hsum_epi32_avx2(acc);
+
+  for (; i < dim; i++) {
+    int32_t d = x[i] - mu[i] * 8;
+    distance += d * ((d * (w[i] << 8) + (1 << 14)) >> 15);
+  }
+  return distance;
+}
+
+// Eight half precision values to float (F16C).
+static inline __m256 load_half_avx2(const uint16_t *p) {
+  return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+}
+
+// Eight bfloat16 values to float: the upper half of each float.
+static inline __m256 load_bfloat16_avx2(const uint16_t *p) {
+  return _mm256_castsi256_ps(_mm256_slli_epi32(
+      _mm256_cvtepu16_epi32(
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(p))),
+      16));
+}
+
+// The last dim % 8 values are copied to zero-padded buffers, so the tail is
+// one more vector and the result matches the full vectors.
+template <__m256 (*load)(const uint16_t *)>
+static inline float half_distance_avx2(const float *x, const uint16_t *mu,
+                                       const uint16_t *ivar,
+                                       const uint32_t dim) {
+  __m256 acc0 = _mm256_setzero_ps();
+  __m256 acc1 = _mm256_setzero_ps();
+  uint32_t i = 0;
+
+  for (; i + 16 <= dim; i += 16) {
+    __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(x + i), load(mu + i));
+    __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(x + i + 8), load(mu + i + 8));
+    acc0 = _mm256_fmadd_ps(_mm256_mul_ps(d0, d0), load(ivar + i), acc0);
+    acc1 = _mm256_fmadd_ps(_mm256_mul_ps(d1, d1), load(ivar + i + 8), acc1);
+  }
+  for (; i + 8 <= dim; i += 8) {
+    __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(x + i), load(mu + i));
+    acc0 = _mm256_fmadd_ps(_mm256_mul_ps(d0, d0), load(ivar + i), acc0);
+  }
+  if (i < dim) {
+    float xs[8] = {0};
+    uint16_t mus[8] = {0}, ivars[8] = {0};
+    for (uint32_t j = 0; i + j < dim; j++) {
+      xs[j] = x[i + j];
+      mus[j] = mu[i + j];
+      ivars[j] = ivar[i + j];
+    }
+    __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(xs), load(mus));
+    acc1 = _mm256_fmadd_ps(_mm256_mul_ps(d0, d0), load(ivars), acc1);
+  }
+
+  return hsum_avx2(_mm256_add_ps(acc0, acc1));
+}
+
+float half_gaussian_distance_avx2(const float *x, const uint16_t *mu,
+                                  const uint16_t *ivar, const uint32_t dim) {
+  return half_distance_avx2<load_half_avx2>(x, mu, ivar, dim);
+}
+
+float bfloat16_gaussian_distance_avx2(const float *x, const uint16_t *mu,
+                                      const uint16_t *ivar,
+                                      const uint32_t dim) {
+  return half_distance_avx2<load_bfloat16_avx2>(x, mu, ivar, dim);
+}
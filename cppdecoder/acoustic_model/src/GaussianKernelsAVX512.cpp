@@ -0,0 +1,124 @@
+/*
+ * Copyright 2020 Javier Jorge. All rights reserved.
+ * License: https://github.com/JJorgeDSIC/CppDecoder#license
+ */
+
+#include <immintrin.h>
+
+#include <cstdint>
+
+float diag_gaussian_distance_avx512(const float *x, const float *mu,
+                                    const float *ivar, const uint32_t dim) {
+  __m512 acc0 = _mm512_setzero_ps();
+  __m512 acc1 = _mm512_setzero_ps();
+  uint32_t i = 0;
+
+  for (; i + 32 <= dim; i += 32) {
+    __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(x + i), _mm512_loadu_ps(mu + i));
+    __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(x + i + 16),
+                              _mm512_loadu_ps(mu + i + 16));
+    acc0 = _mm512_fmadd_ps(_mm512_mul_ps(d0, d0), _mm512_loadu_ps(ivar + i),
+                           acc0);
+    acc1 = _mm512_fmadd_ps(_mm512_mul_ps(d1, d1),
+                           _mm512_loadu_ps(ivar + i + 16), acc1);
+  }
+  for (; i + 16 <= dim; i += 16) {
+    __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(x + i), _mm512_loadu_ps(mu + i));
+    acc0 = _mm512_fmadd_ps(_mm512_mul_ps(d0, d0), _mm512_loadu_ps(ivar + i),
+                           acc0);
+  }
+  if (i < dim) {
+    // Masked loads set the unused lanes to zero, so they add nothing.
+    __mmask16 mask = static_cast<__mmask16>((1u << (dim - i)) - 1);
+    __m512 d0 = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, x + i),
+                              _mm512_maskz_loadu_ps(mask, mu + i));
+    acc1 = _mm512_fmadd_ps(_mm512_mul_ps(d0, d0),
+                           _mm512_maskz_loadu_ps(mask, ivar + i), acc1);
+  }
+
+  return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+}
+
+float diag_gaussian_distance_bounded_avx512(const float *x, const float *mu,
+                                            const float *ivar,
+                                            const uint32_t dim,
+                                            const float bound) {
+  float distance = 0.0;
+  uint32_t i = 0;
+
+  // One check every PDE_BLOCK (16) dimensions, a register.
+  for (; i + 16 <= dim; i += 16) {
+    __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(x + i), _mm512_loadu_ps(mu + i));
+    distance += _mm512_reduce_add_ps(
+        _mm512_mul_ps(_mm512_mul_ps(d0, d0), _mm512_loadu_ps(ivar + i)));
+    if (distance > bound) return distance;
+  }
+  if (i < dim) {
+    __mmask16 mask = static_cast<__mmask16>((1u << (dim - i)) - 1);
+    __m512 d0 = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, x + i),
+                              _mm512_maskz_loadu_ps(mask, mu + i));
+    distance += _mm512_reduce_add_ps(_mm512_mul_ps(
+        _mm512_mul_ps(d0, d0), _mm512_maskz_loadu_ps(mask, ivar + i)));
+  }
+  return distance;
+}
+
+// Sixteen half precision values to float.
+static inline __m512 load_half_avx512(const uint16_t *p) {
+  return _mm512_cvtph_ps(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)));
+}
+
+// Sixteen bfloat16 values to float: the upper half of each float.
+static inline __m512 load_bfloat16_avx512(const uint16_t *p) {
+  return _mm512_castsi512_ps(_mm512_slli_epi32(
+      _mm512_cvtepu16_epi32(
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p))),
+      16));
+}
+
+// As the float kernel; the tail goes through zero-padded buffers because
+// masked 16-bit loads require AVX512BW.
+template <__m512 (*load)(const uint16_t *)>
+static inline float half_distance_avx512(const float *x, const uint16_t *mu,
+                                         const uint16_t *ivar,
+                                         const uint32_t dim) {
+  __m512 acc0 = _mm512_setzero_ps();
+  __m512 acc1 = _mm512_setzero_ps();
+  uint32_t i = 0;
+
+  for (; i + 32 <= dim; i += 32) {
+    __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(x + i), load(mu + i));
+    __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(x + i + 16), load(mu + i + 16));
+    acc0 = _mm512_fmadd_ps(_mm512_mul_ps(d0, d0), load(ivar + i), acc0);
+    acc1 = _mm512_fmadd_ps(_mm512_mul_ps(d1, d1), load(ivar + i + 16), acc1);
+  }
+  for (; i + 16 <= dim; i += 16) {
+    __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(x + i), load(mu + i));
+    acc0 = _mm512_fmadd_ps(_mm512_mul_ps(d0, d0), load(ivar + i), acc0);
+  }
+  if (i < dim) {
+    float xs[16] = {0};
+    uint16_t mus[16] = {0}, ivars[16] = {0};
+    for (uint32_t j = 0; i + j < dim; j++) {
+      xs[j] = x[i + j];
+      mus[j] = mu[i + j];
+      ivars[j] = ivar[i + j];
+    }
+    __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(xs), load(mus));
+    acc1 = _mm512_fmadd_ps(_mm512_mul_ps(d0, d0), load(ivars), acc1);
+  }
+
+  return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+}
+
+float half_gaussian_distance_avx512(const float *x, const uint16_t *mu,
+                                    const uint16_t *ivar, const uint32_t dim) {
+  return half_distance_avx512<load_half_avx512>(x, mu, ivar, dim);
+}
+
+float bfloat16_gaussian_distance_avx512(const float *x, const uint16_t *mu,
+                                        const uint16_t *ivar,
+                                        const uint32_t dim) {
+  return half_distance_avx512<load_bfloat16_avx512>(x, mu, ivar, dim);
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright 2020 Javier Jorge. All rights reserved.
+ * License: https://github.com/JJorgeDSIC/CppDecoder#license
+ */
+
+#include <smmintrin.h>
+
+#include <cstdint>
+
+float diag_gaussian_distance_sse4(const float *x, const float *mu,
+                                  const float *ivar, const uint32_t dim) {
+  __m128 acc0 = _mm_setzero_ps();
+  __m128 acc1 = _mm_setzero_ps();
+  uint32_t i = 0;
+
+  for (; i + 8 <= dim; i += 8) {
+    __m128 d0 = _mm_sub_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(mu + i));
+    __m128 d1 = _mm_sub_ps(_mm_loadu_ps(x + i + 4), _mm_loadu_ps(mu + i + 4));
+    acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_mul_ps(d0, d0),
+                                       _mm_loadu_ps(ivar + i)));
+    acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_mul_ps(d1, d1),
+                                       _mm_loadu_ps(ivar + i + 4)));
+  }
+  for (; i + 4 <= dim; i += 4) {
+    __m128 d0 = _mm_sub_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(mu + i));
+    acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_mul_ps(d0, d0),
+                                       _mm_loadu_ps(ivar + i)));
+  }
+
+  __m128 acc = _mm_add_ps(acc0, acc1);
+  acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+  acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 0x55));
+  float prob = _mm_cvtss_f32(acc);
+
+  for (; i < dim; i++) {
+    float aux = x[i] - mu[i];
+    prob += (aux * aux) * ivar[i];
+  }
+  return prob;
+}
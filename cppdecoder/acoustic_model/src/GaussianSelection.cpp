@@ -0,0 +1,300 @@
+/*
+ * Copyright 2020 Javier Jorge. All rights reserved.
+ * License: https://github.com/JJorgeDSIC/CppDecoder#license
+ */
+
+#include "GaussianSelection.h"
+
+#include <algorithm>
+
+#include "GaussianKernels.h"
+#include "MixtureAcousticModel.h"
+
+GaussianSelection::GaussianSelection()
+    : dim(0),
+      stride(0),
+      n_codewords(0),
+      n_senones(0),
+      floor(-GS_DEFAULT_BEAM) {}
+
+void GaussianSelection::clear() {
+  dim = 0;
+  stride = 0;
+  n_codewords = 0;
+  n_senones = 0;
+  ivar.clear();
+  codewords.clear();
+  offsets.clear();
+  shortlists.clear();
+  rest_logw.clear();
+}
+
+int GaussianSelection::build(
+    const std::vector<const GaussianMixtureState *> &senones,
+    const uint32_t n_codewords, const float beam, const uint32_t iterations) {
+  clear();
+
+  if (senones.empty() || n_codewords == 0) {
+    std::cout << "Nothing to build a Gaussian selection from." << std::endl;
+    return 1;
+  }
+
+  if (!senones[0]->hasFloatParams()) {
+    std::cout << "Unable to build a Gaussian selection from a quantized model."
+              << std::endl;
+    return 1;
+  }
+
+  dim = senones[0]->getDim();
+  stride = aligned_stride(dim);
+
+  // Every Gaussian of the model, and the average of their inverse variances
+  // as the metric of the codebook.
+  std::vector<const float *> means;
+  std::vector<double> ivar_sum(dim, 0.0);
+  for (auto state : senones) {
+    for (uint32_t c = 0; c < state->getComponents(); c++) {
+      means.push_back(state->getMuByComponent(c).data());
+      VectorView<float> component_ivar = state->getIVarByComponent(c);
+      for (uint32_t i = 0; i < dim; i++) ivar_sum[i] += component_ivar[i];
+    }
+  }
+
+  ivar.assign(stride, 0.0);
+  for (uint32_t i = 0; i < dim; i++) ivar[i] = ivar_sum[i] / means.size();
+
+  // k-means over the means, starting from Gaussians evenly spread over the
+  // model.
+  this->n_codewords =
+      std::min(n_codewords, static_cast<uint32_t>(means.size()));
+  codewords.assign(this->n_codewords * stride, 0.0);
+  for (uint32_t k = 0; k < this->n_codewords; k++) {
+    const float *mu = means[k * means.size() / this->n_codewords];
+    std::copy(mu, mu + dim, codewords.begin() + k * stride);
+  }
+
+  std::vector<double> sums(this->n_codewords * dim);
+  std::vector<uint32_t> counts(this->n_codewords);
+  for (uint32_t it = 0; it < iterations; it++) {
+    std::fill(sums.begin(), sums.end(), 0.0);
+    std::fill(counts.begin(), counts.end(), 0);
+
+    for (auto mu : means) {
+      uint32_t k = nearest_codeword(mu);
+      for (uint32_t i = 0; i < dim; i++) sums[k * dim + i] += mu[i];
+      counts[k]++;
+    }
+
+    // Empty clusters keep their codeword.
+    for (uint32_t k = 0; k < this->n_codewords; k++) {
+      if (counts[k] == 0) continue;
+      for (uint32_t i = 0; i < dim; i++)
+        codewords[k * stride + i] = sums[k * dim + i] / counts[k];
+    }
+  }
+
+  // Shortlist of each codeword and senone: the components that score the
+  // codeword within the beam of the best one.
+  n_senones = senones.size();
+  offsets.push_back(0);
+  std::vector<float> scores;
+  for (uint32_t k = 0; k < this->n_codewords; k++) {
+    const float *codeword = &codewords[k * stride];
+
+    for (auto state : senones) {
+      scores.resize(state->getComponents());
+      float best = -HUGE_VAL;
+      for (uint32_t c = 0; c < state->getComponents(); c++) {
+        float distance = diag_gaussian_distance(
+            codeword, state->getMuByComponent(c).data(),
+            state->getIVarByComponent(c).data(), dim);
+        scores[c] = state->getLogWeightByComponent(c) +
+                    state->getLogcByComponent(c) - 0.5 * distance;
+        if (scores[c] > best) best = scores[c];
+      }
+
+      double rest = 0.0;
+      for (uint32_t c = 0; c < state->getComponents(); c++) {
+        if (scores[c] >= best - beam)
+          shortlists.push_back(c);
+        else
+          rest += exp(state->getLogWeightByComponent(c));
+      }
+      offsets.push_back(shortlists.size());
+      rest_logw.push_back(rest > 0.0 ? log(rest) : -HUGE_VAL);
+    }
+  }
+
+  floor = -beam;
+
+  return 0;
+}
+
+int GaussianSelection::read_selection(const std::string &filename) {
+  std::cout << "Reading GaussianSelection from " << filename << "..."
+            << std::endl;
+
+  std::ifstream fileI(filename, std::ifstream::in);
+  std::string line;
+  const char del = ' ';
+
+  clear();
+
+  if (!fileI.is_open()) {
+    std::cout << "Unable to open the file " << filename << " for reading."
+              << std::endl;
+    return 1;
+  }
+
+  getline(fileI, line);  // GSELECTION
+  if (line != "GSELECTION") {
+    std::cout << filename << " is not a Gaussian selection file." << std::endl;
+    return 1;
+  }
+
+  getline(fileI, line, del);  // D
+  getline(fileI, line);
+  std::stringstream(line) >> dim;
+
+  getline(fileI, line, del);  // K
+  getline(fileI, line);
+  std::stringstream(line) >> n_codewords;
+
+  getline(fileI, line, del);  // S
+  getline(fileI, line);
+  std::stringstream(line) >> n_senones;
+
+  getline(fileI, line, del);  // Floor
+  getline(fileI, line);
+  if (line == "-inf")
+    floor = -HUGE_VAL;
+  else
+    std::stringstream(line) >> floor;
+
+  stride = aligned_stride(dim);
+
+  getline(fileI, line, del);  // IVar
+  getline(fileI, line);
+  std::vector<float> values = read_vector<float>(line);
+  bool ok = values.size() == dim;
+  ivar.assign(stride, 0.0);
+  if (ok) std::copy(values.begin(), values.end(), ivar.begin());
+
+  codewords.assign(n_codewords * stride, 0.0);
+  for (uint32_t k = 0; ok && k < n_codewords; k++) {
+    getline(fileI, line, del);  // CW
+    getline(fileI, line);
+    values = read_vector<float>(line);
+    ok = values.size() == dim;
+    if (ok)
+      std::copy(values.begin(), values.end(), codewords.begin() + k * stride);
+  }
+
+  offsets.push_back(0);
+  for (uint32_t cell = 0; ok && cell < n_codewords * n_senones; cell++) {
+    float rest;
+    uint32_t n, c;
+
+    getline(fileI, line, del);  // SL
+    getline(fileI, line);
+    std::istringstream iss(line);
+    ok = static_cast<bool>(iss >> rest >> n);
+    for (uint32_t i = 0; ok && i < n; i++) {
+      ok = static_cast<bool>(iss >> c);
+      shortlists.push_back(c);
+    }
+    offsets.push_back(shortlists.size());
+    rest_logw.push_back(rest > 0.0 ? log(rest) : -HUGE_VAL);
+  }
+
+  fileI.close();
+
+  if (!ok) {
+    std::cout << "Malformed Gaussian selection file " << filename << "."
+              << std::endl;
+    clear();
+    return 1;
+  }
+
+  return 0;
+}
+
+int GaussianSelection::write_selection(const std::string &filename) {
+  std::ofstream fileO(filename);
+
+  if (fileO.is_open()) {
+    fileO << "GSELECTION\n";
+    fileO << "D " << dim << std::endl;
+    fileO << "K " << n_codewords << std::endl;
+    fileO << "S " << n_senones << std::endl;
+    fileO << "Floor " << floor << std::endl;
+
+    fileO << "IVar";
+    for (uint32_t i = 0; i < dim; i++) fileO << " " << ivar[i];
+    fileO << std::endl;
+
+    for (uint32_t k = 0; k < n_codewords; k++) {
+      fileO << "CW";
+      for (uint32_t i = 0; i < dim; i++)
+        fileO << " " << codewords[k * stride + i];
+      fileO << std::endl;
+    }
+
+    for (uint32_t cell = 0; cell < n_codewords * n_senones; cell++) {
+      float rest = rest_logw[cell] == -HUGE_VAL ? 0.0 : exp(rest_logw[cell]);
+      fileO << "SL " << rest << " " << offsets[cell + 1] - offsets[cell];
+      for (uint32_t i = offsets[cell]; i < offsets[cell + 1]; i++)
+        fileO << " " << shortlists[i];
+      fileO << std::endl;
+    }
+
+    fileO.close();
+  } else {
+    std::cout << "Unable to open file for writing" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
+bool GaussianSelection::matches(
+    const std::vector<const GaussianMixtureState *> &senones) const {
+  if (senones.size() != n_senones || n_senones == 0) return false;
+  if (senones[0]->getDim() != dim) return false;
+
+  for (uint32_t k = 0; k < n_codewords; k++) {
+    for (uint32_t s = 0; s < n_senones; s++) {
+      for (auto c : getShortlist(k, s))
+        if (c >= senones[s]->getComponents()) return false;
+    }
+  }
+  return true;
+}
+
+uint32_t GaussianSelection::nearest_codeword(const float *frame) const {
+  uint32_t best = 0;
+  float best_distance = HUGE_VAL;
+
+  for (uint32_t k = 0; k < n_codewords; k++) {
+    float distance =
+        diag_gaussian_distance(frame, &codewords[k * stride], &ivar[0], dim);
+    if (distance < best_distance) {
+      best_distance = distance;
+      best = k;
+    }
+  }
+  return best;
+}
+
+float GaussianSelection::calc_logprob(const GaussianMixtureState &state,
+                                      const uint32_t senone,
+                                      const uint32_t codeword,
+                                      const float *frame,
+                                      const LogAddMode mode) const {
+  VectorView<uint32_t> shortlist = getShortlist(codeword, senone);
+  const float rest = getRestLogWeight(codeword, senone);
+
+  return state.calc_shortlist_logprob(
+      frame, shortlist.data(), shortlist.size(),
+      rest == -HUGE_VAL || floor == -HUGE_VAL ? -HUGE_VAL : rest + floor, mode);
+}
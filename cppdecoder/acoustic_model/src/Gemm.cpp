@@ -0,0 +1,86 @@
+/*
+ * Copyright 2020 Javier Jorge. All rights reserved.
+ * License: https://github.com/JJorgeDSIC/CppDecoder#license
+ */
+
+#include "Gemm.h"
+
+#include <algorithm>
+
+#ifdef CPPDECODER_X86_KERNELS
+// Defined in Gemm{AVX2,AVX512}.cpp, each one compiled with the flags of its
+// instruction set. They must only be called if the CPU supports it.
+void sgemm_avx2(const uint32_t m, const uint32_t n, const uint32_t k,
+                const float *a, const uint32_t lda, const float *b,
+                const uint32_t ldb, float *c, const uint32_t ldc);
+void sgemm_avx512(const uint32_t m, const uint32_t n, const uint32_t k,
+                  const float *a, const uint32_t lda, const float *b,
+                  const uint32_t ldb, float *c, const uint32_t ldc);
+#endif
+
+#if defined(_MSC_VER) || defined(__GNUC__)
+#define SGEMM_RESTRICT __restrict
+#else
+#define SGEMM_RESTRICT
+#endif
+
+// c[0, n) += alpha * b[0, n)
+static inline void axpy(const uint32_t n, const float alpha,
+                        const float *SGEMM_RESTRICT b,
+                        float *SGEMM_RESTRICT c) {
+  for (uint32_t j = 0; j < n; j++) c[j] += alpha * b[j];
+}
+
+void sgemm_scalar(const uint32_t m, const uint32_t n, const uint32_t k,
+                  const float *a, const uint32_t lda, const float *b,
+                  const uint32_t ldb, float *c, const uint32_t ldc) {
+  for (uint32_t jb = 0; jb < n; jb += SGEMM_BLOCK_N) {
+    const uint32_t nb = std::min(SGEMM_BLOCK_N, n - jb);
+
+    for (uint32_t i = 0; i < m; i++) std::fill_n(c + i * ldc + jb, nb, 0.0f);
+
+    for (uint32_t kb = 0; kb < k; kb += SGEMM_BLOCK_K) {
+      const uint32_t ke = std::min(kb + SGEMM_BLOCK_K, k);
+
+      for (uint32_t i = 0; i < m; i++) {
+        const float *arow = a + i * lda;
+        float *crow = c + i * ldc + jb;
+        for (uint32_t p = kb; p < ke; p++) {
+          axpy(nb, arow[p], b + p * ldb + jb, crow);
+        }
+      }
+    }
+  }
+}
+
+SgemmKernel get_sgemm_kernel(const SimdLevel level) {
+  // Same CPU requirements as the Gaussian kernel of the level.
+  if (get_diag_gaussian_kernel(level) == nullptr) return nullptr;
+
+  switch (level) {
+    case SimdLevel::Scalar:
+      return sgemm_scalar;
+#ifdef CPPDECODER_X86_KERNELS
+    case SimdLevel::AVX2:
+      return sgemm_avx2;
+    case SimdLevel::AVX512:
+      return sgemm_avx512;
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+static SgemmKernel select_sgemm_kernel() {
+  // There is no SSE4 variant, the scalar one is vectorized by the compiler.
+  SgemmKernel kernel = get_sgemm_kernel(active_simd_level());
+  if (kernel == nullptr) kernel = sgemm_scalar;
+  return kernel;
+}
+
+void sgemm(const uint32_t m, const uint32_t n, const uint32_t k, const float *a,
+           const uint32_t lda, const float *b, const uint32_t ldb, float *c,
+           const uint32_t ldc) {
+  static const SgemmKernel kernel = select_sgemm_kernel();
+  kernel(m, n, k, a, lda, b, ldb, c, ldc);
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2020 Javier Jorge. All rights reserved.
+ * License: https://github.com/JJorgeDSIC/CppDecoder#license
+ */
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <cstdint>
+
+#include "Gemm.h"
+
+// Tile of C kept in registers: MR rows x 16 columns (two registers per row).
+template <int MR>
+static inline void tile_avx2(const uint32_t k, const float *a,
+                             const uint32_t lda, const float *b,
+                             const uint32_t ldb, float *c, const uint32_t ldc,
+                             const bool accumulate) {
+  __m256 acc[MR][2];
+  for (int r = 0; r < MR; r++) {
+    if (accumulate) {
+      acc[r][0] = _mm256_loadu_ps(c + r * ldc);
+      acc[r][1] = _mm256_loadu_ps(c + r * ldc + 8);
+    } else {
+      acc[r][0] = _mm256_setzero_ps();
+      acc[r][1] = _mm256_setzero_ps();
+    }
+  }
+
+  for (uint32_t p = 0; p < k; p++) {
+    __m256 b0 = _mm256_loadu_ps(b + p * ldb);
+    __m256 b1 = _mm256_loadu_ps(b + p * ldb + 8);
+    for (int r = 0; r < MR; r++) {
+      __m256 ar = _mm256_broadcast_ss(a + r * lda + p);
+      acc[r][0] = _mm256_fmadd_ps(ar, b0, acc[r][0]);
+      acc[r][1] = _mm256_fmadd_ps(ar, b1, acc[r][1]);
+    }
+  }
+
+  for (int r = 0; r < MR; r++) {
+    _mm256_storeu_ps(c + r * ldc, acc[r][0]);
+    _mm256_storeu_ps(c + r * ldc + 8, acc[r][1]);
+  }
+}
+
+void sgemm_avx2(const uint32_t m, const uint32_t n, const uint32_t k,
+                const float *a, const uint32_t lda, const float *b,
+                const uint32_t ldb, float *c, const uint32_t ldc) {
+  const uint32_t n16 = n / 16 * 16;
+
+  for (uint32_t kb = 0; kb < k; kb += SGEMM_BLOCK_K) {
+    const uint32_t kk = std::min(SGEMM_BLOCK_K, k - kb);
+    const bool accumulate = kb > 0;
+    const float *ab = a + kb;
+    const float *bb = b + kb * ldb;
+
+    for (uint32_t j = 0; j < n16; j += 16) {
+      uint32_t i = 0;
+      for (; i + 4 <= m; i += 4)
+        tile_avx2<4>(kk, ab + i * lda, lda, bb + j, ldb, c + i * ldc + j, ldc,
+                     accumulate);
+      switch (m - i) {
+        case 3:
+          tile_avx2<3>(kk, ab + i * lda, lda, bb + j, ldb, c + i * ldc + j,
+                       ldc, accumulate);
+          break;
+        case 2:
+          tile_avx2<2>(kk, ab + i * lda, lda, bb + j, ldb, c + i * ldc + j,
+                       ldc, accumulate);
+          break;
+        case 1:
+          tile_avx2<1>(kk, ab + i * lda, lda, bb + j, ldb, c + i * ldc + j,
+                       ldc, accumulate);
+          break;
+      }
+    }
+
+    // Remaining columns.
+    for (uint32_t i = 0; i < m; i++) {
+      for (uint32_t j = n16; j < n; j++) {
+        float sum = accumulate ? c[i * ldc + j] : 0.0f;
+        for (uint32_t p = 0; p < kk; p++)
+          sum += ab[i * lda + p] * bb[p * ldb + j];
+        c[i * ldc + j] = sum;
+      }
+    }
+  }
+}
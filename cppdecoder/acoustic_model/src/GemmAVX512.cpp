@@ -0,0 +1,84 @@
+/*
+ * Copyright 2020 Javier Jorge. All rights reserved.
+ * License: https://github.com/JJorgeDSIC/CppDecoder#license
+ */
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <cstdint>
+
+#include "Gemm.h"
+
+// Tile of C kept in registers: MR rows x 32 columns (two registers per row).
+// The masks select the columns in use, for the last tile of a row.
+template <int MR>
+static inline void tile_avx512(const uint32_t k, const float *a,
+                               const uint32_t lda, const float *b,
+                               const uint32_t ldb, float *c,
+                               const uint32_t ldc, const bool accumulate,
+                               const __mmask16 mask0, const __mmask16 mask1) {
+  __m512 acc[MR][2];
+  for (int r = 0; r < MR; r++) {
+    if (accumulate) {
+      acc[r][0] = _mm512_maskz_loadu_ps(mask0, c + r * ldc);
+      acc[r][1] = _mm512_maskz_loadu_ps(mask1, c + r * ldc + 16);
+    } else {
+      acc[r][0] = _mm512_setzero_ps();
+      acc[r][1] = _mm512_setzero_ps();
+    }
+  }
+
+  for (uint32_t p = 0; p < k; p++) {
+    __m512 b0 = _mm512_maskz_loadu_ps(mask0, b + p * ldb);
+    __m512 b1 = _mm512_maskz_loadu_ps(mask1, b + p * ldb + 16);
+    for (int r = 0; r < MR; r++) {
+      __m512 ar = _mm512_set1_ps(a[r * lda + p]);
+      acc[r][0] = _mm512_fmadd_ps(ar, b0, acc[r][0]);
+      acc[r][1] = _mm512_fmadd_ps(ar, b1, acc[r][1]);
+    }
+  }
+
+  for (int r = 0; r < MR; r++) {
+    _mm512_mask_storeu_ps(c + r * ldc, mask0, acc[r][0]);
+    _mm512_mask_storeu_ps(c + r * ldc + 16, mask1, acc[r][1]);
+  }
+}
+
+void sgemm_avx512(const uint32_t m, const uint32_t n, const uint32_t k,
+                  const float *a, const uint32_t lda, const float *b,
+                  const uint32_t ldb, float *c, const uint32_t ldc) {
+  for (uint32_t kb = 0; kb < k; kb += SGEMM_BLOCK_K) {
+    const uint32_t kk = std::min(SGEMM_BLOCK_K, k - kb);
+    const bool accumulate = kb > 0;
+    const float *ab = a + kb;
+    const float *bb = b + kb * ldb;
+
+    for (uint32_t j = 0; j < n; j += 32) {
+      const uint32_t cols = std::min(32u, n - j);
+      const __mmask16 mask0 = static_cast<__mmask16>(
+          cols >= 16 ? 0xFFFF : (1u << cols) - 1);
+      const __mmask16 mask1 = static_cast<__mmask16>(
+          cols >= 32 ? 0xFFFF : (cols > 16 ? (1u << (cols - 16)) - 1 : 0));
+
+      uint32_t i = 0;
+      for (; i + 4 <= m; i += 4)
+        tile_avx512<4>(kk, ab + i * lda, lda, bb + j, ldb, c + i * ldc + j,
+                       ldc, accumulate, mask0, mask1);
+      switch (m - i) {
+        case 3:
+          tile_avx512<3>(kk, ab + i * lda, lda, bb + j, ldb, c + i * ldc + j,
+                         ldc, accumulate, mask0, mask1);
+          break;
+        case 2:
+          tile_avx512<2>(kk, ab + i * lda, lda, bb + j, ldb, c + i * ldc + j,
+                         ldc, accumulate, mask0, mask1);
+          break;
+        case 1:
+          tile_avx512<1>(kk, ab + i * lda, lda, bb + j, ldb, c + i * ldc + j,
+                         ldc, accumulate, mask0, mask1);
+          break;
+      }
+    }
+  }
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2020 Javier Jorge. All rights reserved.
+ * License: https://github.com/JJorgeDSIC/CppDecoder#license
+ */
+
+#include "HMMTopology.h"
+
+#include <cmath>
+
+uint32_t HMMTopology::addLeftToRight(const std::vector<float> &forward,
+                                     const std::vector<int> &senones) {
+  symbol_first.push_back(states.size());
+  symbol_n_states.push_back(forward.size());
+
+  // Always entered through the first state.
+  symbol_first_entry.push_back(arcs.size());
+  symbol_n_entries.push_back(forward.empty() ? 0 : 1);
+  if (!forward.empty()) arcs.push_back({0, 0.0});
+
+  for (uint32_t q = 0; q < forward.size(); q++) {
+    HMMTopologyState state;
+    state.senone = q < senones.size() ? senones[q] : -1;
+    state.forward = forward[q];
+    state.loop = log(1 - exp(forward[q]));
+    state.first_arc = arcs.size();
+    state.n_arcs = 0;
+    states.push_back(state);
+  }
+
+  return symbol_first.size() - 1;
+}
+
+uint32_t HMMTopology::addMatrix(const std::vector<float> &matrix,
+                                const std::vector<int> &senones) {
+  const uint32_t n = senones.size();
+  const uint32_t size = n + 2;
+
+  if (n == 0 || matrix.size() != size * size) return addUnsupported();
+
+  symbol_first.push_back(states.size());
+  symbol_n_states.push_back(n);
+
+  // Row 0 is I, HMM state q is row and column q + 1, n + 1 is F.
+  symbol_first_entry.push_back(arcs.size());
+  for (uint32_t dst = 1; dst <= n; dst++) {
+    if (matrix[dst] != -HUGE_VAL) arcs.push_back({dst - 1, matrix[dst]});
+  }
+  symbol_n_entries.push_back(arcs.size() - symbol_first_entry.back());
+
+  for (uint32_t q = 0; q < n; q++) {
+    const float *row = &matrix[(q + 1) * size];
+    const uint32_t forward = q + 2;
+
+    HMMTopologyState state;
+    state.senone = senones[q];
+    state.loop = row[q + 1];
+    state.forward = row[forward];
+    state.first_arc = arcs.size();
+
+    for (uint32_t dst = 1; dst <= n + 1; dst++) {
+      if (dst == q + 1 || dst == forward || row[dst] == -HUGE_VAL) continue;
+      arcs.push_back({dst - 1, row[dst]});
+    }
+    state.n_arcs = arcs.size() - state.first_arc;
+    states.push_back(state);
+  }
+
+  return symbol_first.size() - 1;
+}
+
+uint32_t HMMTopology::addUnsupported() {
+  symbol_first.push_back(states.size());
+  symbol_n_states.push_back(0);
+  symbol_first_entry.push_back(arcs.size());
+  symbol_n_entries.push_back(0);
+  return symbol_first.size() - 1;
+}
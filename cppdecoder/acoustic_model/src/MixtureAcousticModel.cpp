@@ -5,25 +5,67 @@
 
 #include "MixtureAcousticModel.h"
 
+#include <ThreadPool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+
 TransValue::TransValue(const std::string &st, const float val)
     : state(st), value(val) {}
 
-GaussianMixtureState::GaussianMixtureState() : components(0) {}
+GaussianMixtureState::GaussianMixtureState()
+    : components(0),
+      loaded(0),
+      dim(0),
+      stride(0),
+      format(ParamFormat::Float32),
+      qstride(0) {}
+
+GaussianMixtureState::GaussianMixtureState(uint32_t components, uint32_t dim)
+    : components(components),
+      loaded(0),
+      dim(dim),
+      format(ParamFormat::Float32),
+      qstride(0) {
+  stride = aligned_stride(dim);
+  resizeStorage();
+}
 
-GaussianMixtureState::GaussianMixtureState(uint32_t components, uint32_t dim) {
-  this->dim = dim;
-  this->components = components;
-  gstates.reserve(components);
+void GaussianMixtureState::resizeStorage() {
+  // Padding is zero in both matrices, so it never adds to a distance.
+  mus.resize(components * stride, 0.0);
+  ivars.resize(components * stride, 0.0);
+  vars.resize(components * stride, 0.0);
+  consts.resize(2 * components, 0.0);
+  for (uint32_t i = 0; i < pmembers.size() && i < components; i++)
+    consts[2 * i + 1] = pmembers[i];
 }
 
 void GaussianMixtureState::reserveComponents(const uint32_t comps) {
   this->components = comps;
-  gstates.reserve(components);
+  resizeStorage();
   pmembers.reserve(components);
 }
 
+void GaussianMixtureState::setDim(const uint32_t dim) {
+  if (this->dim == dim) return;
+  // Only meaningful before the components are read.
+  assert(loaded == 0);
+  this->dim = dim;
+  stride = aligned_stride(dim);
+  mus.clear();
+  ivars.clear();
+  vars.clear();
+  resizeStorage();
+}
+
 void GaussianMixtureState::addPMembers(const std::string &line) {
   pmembers = read_vector<float>(line);
+  for (uint32_t i = 0; i < pmembers.size() && i < components; i++)
+    consts[2 * i + 1] = pmembers[i];
 }
 
 int GaussianMixtureState::addGaussianState(const uint32_t d,
@@ -31,49 +73,572 @@ int GaussianMixtureState::addGaussianState(const uint32_t d,
                                            const std::string &var_line) {
   assert(dim == d);
 
-  gstates.emplace_back(dim, mu_line, var_line);
+  return add_gaussian(mu_line.data(), mu_line.data() + mu_line.size(),
+                      var_line.data(), var_line.data() + var_line.size());
+}
+
+// One past the end of the line that starts at begin.
+static const char *line_end(const char *begin, const char *end) {
+  const void *eol = std::memchr(begin, '\n', end - begin);
+  return eol != nullptr ? static_cast<const char *>(eol) : end;
+}
+
+// The rest of a line after its first token (i.e: the tag "MU").
+static const char *skip_tag(const char *begin, const char *end) {
+  while (begin < end && *begin != ' ' && *begin != '\t') begin++;
+  return begin;
+}
+
+int GaussianMixtureState::read_members(const char *begin, const char *end) {
+  while (begin < end) {
+    const char *mu_end = line_end(begin, end);
+    if (mu_end == end) {
+      std::cout << "Missing the VAR line of the Gaussian " << loaded << "."
+                << std::endl;
+      return 1;
+    }
+    const char *var_begin = mu_end + 1;
+    const char *var_end = line_end(var_begin, end);
+
+    if (add_gaussian(skip_tag(begin, mu_end), mu_end,
+                     skip_tag(var_begin, var_end), var_end) != 0)
+      return 1;
+
+    begin = var_end + 1;
+  }
+  return 0;
+}
+
+int GaussianMixtureState::add_gaussian(const char *mu_begin,
+                                       const char *mu_end,
+                                       const char *var_begin,
+                                       const char *var_end) {
+  if (loaded == components) reserveComponents(components + 1);
+
+  // Parsed straight into the packed rows, ivar and logc are computed exactly
+  // as for a single Gaussian.
+  float *var = &vars[loaded * stride];
+  if (parse_floats(mu_begin, mu_end, &mus[loaded * stride], dim) != dim ||
+      parse_floats(var_begin, var_end, var, dim) != dim) {
+    std::cout << "Expected " << dim << " values for the Gaussian "
+              << loaded << "." << std::endl;
+    return 1;
+  }
+  consts[2 * loaded] =
+      GaussianState::calc_ivar_logc(var, dim, &ivars[loaded * stride]);
+
+  loaded++;
+  return 0;
+}
+
+void GaussianMixtureState::write_binary(BinaryModelWriter *writer) const {
+  writer->putU32(components);
+  writer->putU32(dim);
+  writer->putU32(stride);
+  writer->putFloats(pmembers);
+  writer->putU64(writer->putBlock(mus.data(), mus.size()));
+  writer->putU64(writer->putBlock(ivars.data(), ivars.size()));
+  writer->putU64(writer->putBlock(vars.data(), vars.size()));
+  writer->putU64(writer->putBlock(consts.data(), consts.size()));
+}
+
+int GaussianMixtureState::read_binary(BinaryModelReader *reader,
+                                      const uint32_t model_dim) {
+  components = reader->getU32();
+  dim = reader->getU32();
+  const uint32_t file_stride = reader->getU32();
+  pmembers = reader->getFloats();
+
+  stride = aligned_stride(dim);
+  if (reader->failed() || file_stride != stride ||
+      pmembers.size() != components || dim != model_dim) {
+    std::cout << "Unable to read a mixture of the binary model." << std::endl;
+    return 1;
+  }
+
+  const std::size_t n = static_cast<std::size_t>(components) * stride;
+  uint64_t offsets[4];
+  for (auto &offset : offsets) offset = reader->getU64();
+  float *mu_block = reader->getBlock<float>(offsets[0], n);
+  float *ivar_block = reader->getBlock<float>(offsets[1], n);
+  float *var_block = reader->getBlock<float>(offsets[2], n);
+  float *const_block = reader->getBlock<float>(offsets[3], 2 * components);
+
+  if (reader->failed()) {
+    std::cout << "The parameters of a mixture are out of the binary model."
+              << std::endl;
+    return 1;
+  }
+
+  mus.view(mu_block, n);
+  ivars.view(ivar_block, n);
+  vars.view(var_block, n);
+  consts.view(const_block, 2 * components);
+  loaded = components;
+  format = ParamFormat::Float32;
+  return 0;
+}
+
+bool GaussianMixtureState::canQuantize(const ParamFormat format) const {
+  if (format == ParamFormat::Float32) return true;
+
+  if (!hasFloatParams()) {
+    std::cout << "The mixture is already quantized." << std::endl;
+    return false;
+  }
+
+  if ((format == ParamFormat::Int16 || format == ParamFormat::Int8) &&
+      dim > QUANTIZED_MAX_DIM) {
+    std::cout << "Unable to quantize mixtures of dimension " << dim
+              << ", the limit is " << QUANTIZED_MAX_DIM << "." << std::endl;
+    return false;
+  }
+
+  // Largest finite half precision value.
+  if (format == ParamFormat::Float16 && !ivars.empty() &&
+      *std::max_element(ivars.begin(), ivars.end()) > 65504) {
+    std::cout << "An inverse variance does not fit in half precision."
+              << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+int GaussianMixtureState::permute_dims(const std::vector<uint32_t> &order) {
+  if (!hasFloatParams()) {
+    std::cout << "Unable to reorder the dimensions of a quantized mixture."
+              << std::endl;
+    return 1;
+  }
+
+  std::vector<bool> seen(dim, false);
+  bool ok = order.size() == dim;
+  for (uint32_t i = 0; ok && i < dim; i++) {
+    ok = order[i] < dim && !seen[order[i]];
+    if (ok) seen[order[i]] = true;
+  }
+
+  if (!ok) {
+    std::cout << "The dimension order is not a permutation of " << dim
+              << " dimensions." << std::endl;
+    return 1;
+  }
+
+  std::vector<float> aux(dim);
+  for (auto params : {&mus, &ivars, &vars}) {
+    for (uint32_t c = 0; c < components; c++) {
+      float *values = &(*params)[c * stride];
+      for (uint32_t i = 0; i < dim; i++) aux[i] = values[order[i]];
+      std::copy(aux.begin(), aux.end(), values);
+    }
+  }
+  return 0;
+}
+
+int GaussianMixtureState::quantize(const ParamFormat format) {
+  if (format == ParamFormat::Float32) return 0;
+
+  if (!canQuantize(format)) return 1;
+
+  if (format == ParamFormat::Float16 || format == ParamFormat::BFloat16)
+    return convert_half(format);
+
+  const bool int16 = format == ParamFormat::Int16;
+  const float mean_limit =
+      int16 ? QUANTIZED_MEAN_LIMIT16 : QUANTIZED_MEAN_LIMIT8;
+  // Steps of the means, in steps of the frame.
+  const float mean_step = int16 ? 1 : 1 << QUANTIZED_MEAN_SHIFT8;
+  const float weight_limit = int16 ? 32767 : 127;
+  // The largest weight in Q15, Int8 weights are shifted by 8.
+  const float q15_limit = int16 ? 32767 : 127 * 256;
+
+  qstride = (dim + 15) / 16 * 16;
+
+  // The range of each dimension, QUANTIZED_RANGE_DEVIATIONS around every
+  // mean, maps to QUANTIZED_MEAN_LIMIT16 frame steps; frames are clamped at
+  // twice the range.
+  std::vector<float> steps(dim, 1.0);
+  qinv_scales.assign(qstride, 0.0);
+  for (uint32_t i = 0; i < dim; i++) {
+    float range = 0.0;
+    for (uint32_t c = 0; c < components; c++)
+      range = std::max(range, std::fabs(mus[c * stride + i]) +
+                                  QUANTIZED_RANGE_DEVIATIONS *
+                                      std::sqrt(vars[c * stride + i]));
+    if (range > 0.0) steps[i] = range / QUANTIZED_MEAN_LIMIT16;
+    qinv_scales[i] = 1.0 / steps[i];
+  }
+
+  if (int16)
+    qparams16.assign(2 * components * qstride, 0);
+  else
+    qparams8.assign(2 * components * qstride, 0);
+  qfactors.assign(components, 0.0);
+
+  std::vector<float> weights(dim);
+  for (uint32_t c = 0; c < components; c++) {
+    // ivar_i * scale_i^2 relative to the largest one, which is
+    // factor / 2^15 in Q15.
+    float max_weight = 0.0;
+    for (uint32_t i = 0; i < dim; i++) {
+      weights[i] = ivars[c * stride + i] * steps[i] * steps[i];
+      max_weight = std::max(max_weight, weights[i]);
+    }
+    qfactors[c] = max_weight * 32768 / q15_limit;
+
+    for (uint32_t i = 0; i < dim; i++) {
+      float mu = std::min(
+          std::max(mus[c * stride + i] * qinv_scales[i] / mean_step,
+                   -mean_limit),
+          mean_limit);
+      float w = max_weight > 0.0 ? weights[i] / max_weight * weight_limit : 0.0;
+      if (int16) {
+        qparams16[2 * c * qstride + i] = std::lrint(mu);
+        qparams16[(2 * c + 1) * qstride + i] = std::lrint(w);
+      } else {
+        qparams8[2 * c * qstride + i] = std::lrint(mu);
+        qparams8[(2 * c + 1) * qstride + i] = std::lrint(w);
+      }
+    }
+  }
+
+  AlignedArray<float>().swap(mus);
+  AlignedArray<float>().swap(ivars);
+  AlignedArray<float>().swap(vars);
+  this->format = format;
+
+  return 0;
+}
+
+int GaussianMixtureState::convert_half(const ParamFormat format) {
+  const bool half = format == ParamFormat::Float16;
+
+  hparams.assign(2 * components * stride, 0);
+  for (uint32_t c = 0; c < components; c++) {
+    for (uint32_t i = 0; i < dim; i++) {
+      const float mu = mus[c * stride + i];
+      const float ivar = ivars[c * stride + i];
+      hparams[2 * c * stride + i] =
+          half ? float_to_half(mu) : float_to_bfloat16(mu);
+      hparams[(2 * c + 1) * stride + i] =
+          half ? float_to_half(ivar) : float_to_bfloat16(ivar);
+    }
+  }
+
+  AlignedArray<float>().swap(mus);
+  AlignedArray<float>().swap(ivars);
+  AlignedArray<float>().swap(vars);
+  this->format = format;
+
   return 0;
 }
 
-float GaussianMixtureState::calc_logprob(const std::vector<float> &frame) {
-  int components = this->getComponents();
+std::size_t GaussianMixtureState::getParamBytes() const {
+  return (mus.size() + ivars.size() + vars.size()) * sizeof(float) +
+         qparams16.size() * sizeof(int16_t) + qparams8.size() +
+         (qinv_scales.size() + qfactors.size()) * sizeof(float) +
+         hparams.size() * sizeof(uint16_t);
+}
+
+void GaussianMixtureState::quantize_frame(const float *frame,
+                                          int16_t *qframe) const {
+  const float limit = QUANTIZED_FRAME_LIMIT;
+  // Rounds to nearest by truncating a positive value, without calls.
+  const int32_t offset = QUANTIZED_FRAME_LIMIT + 1;
 
-  std::vector<float> pmembers = this->getPMembers();
-  std::vector<float> pprob;
+  for (uint32_t i = 0; i < dim; i++) {
+    float value = std::min(std::max(frame[i] * qinv_scales[i], -limit), limit);
+    qframe[i] = static_cast<int32_t>(value + (offset + 0.5f)) - offset;
+  }
+  for (uint32_t i = dim; i < qstride; i++) qframe[i] = 0;
+}
+
+float GaussianMixtureState::calc_components_logprob(const float *frame,
+                                                    const uint32_t begin,
+                                                    const uint32_t n,
+                                                    float *lprobs) const {
+  int16_t qframe[QUANTIZED_MAX_DIM];
+  if (quantizedFrames()) quantize_frame(frame, qframe);
+
+  const float *c = &consts[2 * begin];
 
   float max = -HUGE_VAL;
-  float prob = 0.0, aux = 0.0;
-  for (auto i = 0; i < components; i++) {
-    // prob = this->getGaussianStateByComponent(i).calc_logprob(frame);
-    prob = gstates[i].calc_logprob(frame);
-    aux = pmembers[i] + prob;
+  for (uint32_t i = 0; i < n; i++) {
+    float distance = component_distance(frame, qframe, begin + i);
+    float prob = -0.5 * distance + c[0];
+    float aux = c[1] + prob;
+    lprobs[i] = aux;
 
-    if (aux == -INFINITY) return -HUGE_VAL;
+    if (aux == -INFINITY) return -INFINITY;
 
     if (aux > max) max = aux;
 
-    pprob.push_back(aux);
+    c += 2;
+  }
+  return max;
+}
+
+float GaussianMixtureState::max_component_logprob(const float *frame,
+                                                  const uint32_t c,
+                                                  const float best) const {
+  // c only beats best if logw + logc - 0.5 * distance > best.
+  const float bound = best == -HUGE_VAL
+                          ? HUGE_VAL
+                          : 2 * (consts[2 * c] + consts[2 * c + 1] - best);
+  if (bound <= 0) return best;
+
+  float distance = diag_gaussian_distance_bounded(
+      frame, &mus[c * stride], &ivars[c * stride], dim, bound);
+  if (distance > bound) return best;
+
+  float prob = -0.5 * distance + consts[2 * c];
+  float aux = consts[2 * c + 1] + prob;
+  return aux > best ? aux : best;
+}
+
+float GaussianMixtureState::calc_max_logprob(const float *frame,
+                                             const bool partial_distance,
+                                             const float floor) const {
+  float best = -HUGE_VAL;
+
+  // The bounded kernels are only for the float parameters.
+  if (partial_distance && hasFloatParams()) {
+    // Components must beat floor too, nothing beats it if best stays there.
+    best = floor;
+    for (uint32_t c = 0; c < components; c++)
+      best = max_component_logprob(frame, c, best);
+    return best > floor ? best : -HUGE_VAL;
+  }
+
+  int16_t qframe[QUANTIZED_MAX_DIM];
+  if (quantizedFrames()) quantize_frame(frame, qframe);
+
+  for (uint32_t c = 0; c < components; c++) {
+    float distance = component_distance(frame, qframe, c);
+    float prob = -0.5 * distance + consts[2 * c];
+    float aux = consts[2 * c + 1] + prob;
+    best = aux > best ? aux : best;
+  }
+  return best;
+}
+
+float GaussianMixtureState::calc_logprob(const float *frame,
+                                         const LogAddMode mode) const {
+  if (mode == LogAddMode::Max) return calc_max_logprob(frame);
+
+  float lprobs[MIXTURE_CHUNK];
+  float max = -HUGE_VAL;
+  float res = 0.0;
+
+  for (uint32_t begin = 0; begin < components; begin += MIXTURE_CHUNK) {
+    uint32_t n = std::min(MIXTURE_CHUNK, components - begin);
+
+    float chunk_max = calc_components_logprob(frame, begin, n, lprobs);
+
+    if (chunk_max == -INFINITY) return -HUGE_VAL;
+
+    // Online merge: the sum so far is relative to max.
+    if (chunk_max > max) {
+      if (begin > 0) res *= exp(max - chunk_max);
+      max = chunk_max;
+    }
+
+    res += exp_sum(lprobs, max, n, mode);
   }
 
   if (max != -HUGE_VAL && max != -INFINITY) {
-    float r_add = robust_add(pprob, max, components);
-    return r_add;
+    return max + log(res);
   } else {
     return -HUGE_VAL;
   }
 }
 
+void GaussianMixtureState::calc_logprob_block(const float *frames,
+                                              const uint32_t n_frames,
+                                              float *out,
+                                              const LogAddMode mode) const {
+  // The quantized formats score frame by frame.
+  if (mode == LogAddMode::Max || quantizedFrames()) {
+    for (uint32_t f = 0; f < n_frames; f++)
+      out[f] = calc_logprob(frames + f * dim, mode);
+    return;
+  }
+
+  float lprobs[MIXTURE_BLOCK_FRAMES][MIXTURE_CHUNK];
+  float max[MIXTURE_BLOCK_FRAMES];
+  float res[MIXTURE_BLOCK_FRAMES];
+  bool discarded[MIXTURE_BLOCK_FRAMES];
+
+  for (uint32_t fb = 0; fb < n_frames; fb += MIXTURE_BLOCK_FRAMES) {
+    const uint32_t nf = std::min(MIXTURE_BLOCK_FRAMES, n_frames - fb);
+    const float *block = frames + fb * dim;
+
+    for (uint32_t f = 0; f < nf; f++) {
+      max[f] = -HUGE_VAL;
+      res[f] = 0.0;
+      discarded[f] = false;
+    }
+
+    for (uint32_t begin = 0; begin < components; begin += MIXTURE_CHUNK) {
+      uint32_t n = std::min(MIXTURE_CHUNK, components - begin);
+
+      // Components outer, frames inner: each component is loaded once.
+      for (uint32_t i = 0; i < n; i++) {
+        const uint32_t c = begin + i;
+        for (uint32_t f = 0; f < nf; f++) {
+          float distance = component_distance(block + f * dim, nullptr, c);
+          float prob = -0.5 * distance + consts[2 * c];
+          lprobs[f][i] = consts[2 * c + 1] + prob;
+        }
+      }
+
+      // Same merge as calc_logprob, frame by frame.
+      for (uint32_t f = 0; f < nf; f++) {
+        if (discarded[f]) continue;
+
+        float chunk_max = -HUGE_VAL;
+        for (uint32_t i = 0; i < n; i++) {
+          if (lprobs[f][i] == -INFINITY) {
+            chunk_max = -INFINITY;
+            break;
+          }
+          if (lprobs[f][i] > chunk_max) chunk_max = lprobs[f][i];
+        }
+
+        if (chunk_max == -INFINITY) {
+          discarded[f] = true;
+          continue;
+        }
+
+        if (chunk_max > max[f]) {
+          if (begin > 0) res[f] *= exp(max[f] - chunk_max);
+          max[f] = chunk_max;
+        }
+
+        res[f] += exp_sum(lprobs[f], max[f], n, mode);
+      }
+    }
+
+    for (uint32_t f = 0; f < nf; f++) {
+      if (discarded[f] || max[f] == -HUGE_VAL || max[f] == -INFINITY)
+        out[fb + f] = -HUGE_VAL;
+      else
+        out[fb + f] = max[f] + log(res[f]);
+    }
+  }
+}
+
+float GaussianMixtureState::calc_shortlist_logprob(
+    const float *frame, const uint32_t *shortlist, const uint32_t n,
+    const float rest, const LogAddMode mode) const {
+  int16_t qframe[QUANTIZED_MAX_DIM];
+  if (quantizedFrames()) quantize_frame(frame, qframe);
+
+  if (mode == LogAddMode::Max) {
+    float best = -HUGE_VAL;
+    for (uint32_t i = 0; i < n; i++) {
+      const uint32_t c = shortlist[i];
+      float distance = component_distance(frame, qframe, c);
+      float prob = -0.5 * distance + consts[2 * c];
+      float aux = consts[2 * c + 1] + prob;
+      best = aux > best ? aux : best;
+    }
+    return best;
+  }
+
+  float lprobs[MIXTURE_CHUNK];
+  float max = -HUGE_VAL;
+  float res = 0.0;
+
+  for (uint32_t begin = 0; begin < n; begin += MIXTURE_CHUNK) {
+    uint32_t m = std::min(MIXTURE_CHUNK, n - begin);
+
+    float chunk_max = -HUGE_VAL;
+    for (uint32_t i = 0; i < m; i++) {
+      const uint32_t c = shortlist[begin + i];
+      float distance = component_distance(frame, qframe, c);
+      float prob = -0.5 * distance + consts[2 * c];
+      lprobs[i] = consts[2 * c + 1] + prob;
+
+      if (lprobs[i] == -INFINITY) return -HUGE_VAL;
+
+      if (lprobs[i] > chunk_max) chunk_max = lprobs[i];
+    }
+
+    if (chunk_max > max) {
+      if (begin > 0) res *= exp(max - chunk_max);
+      max = chunk_max;
+    }
+
+    res += exp_sum(lprobs, max, m, mode);
+  }
+
+  if (max == -HUGE_VAL || max == -INFINITY) return -HUGE_VAL;
+
+  // The components out of the shortlist, already relative to max.
+  if (rest != -HUGE_VAL) res += exp(rest);
+
+  return max + log(res);
+}
+
+TextMixtureBlock skip_text_members(LineCursor *lines,
+                                   GaussianMixtureState *state,
+                                   const uint32_t components) {
+  TextMixtureBlock block;
+  block.state = state;
+  block.begin = lines->position();
+  lines->skip_lines(2 * components);
+  block.end = lines->position();
+  return block;
+}
+
+int read_text_mixtures(const std::vector<TextMixtureBlock> &blocks) {
+  const uint32_t n_chunks =
+      (blocks.size() + TEXT_MODEL_CHUNK - 1) / TEXT_MODEL_CHUNK;
+  std::atomic<uint32_t> errors(0);
+
+  auto read_chunk = [&blocks, &errors](uint32_t c) {
+    const std::size_t last =
+        std::min<std::size_t>((c + 1) * TEXT_MODEL_CHUNK, blocks.size());
+    for (std::size_t i = c * TEXT_MODEL_CHUNK; i < last; i++) {
+      if (blocks[i].state->read_members(blocks[i].begin, blocks[i].end) != 0)
+        errors++;
+    }
+  };
+
+  const uint32_t n_threads =
+      std::min(n_chunks, std::max(1u, std::thread::hardware_concurrency()));
+  if (n_threads <= 1) {
+    for (uint32_t c = 0; c < n_chunks; c++) read_chunk(c);
+  } else {
+    ThreadPool pool(n_threads);
+    pool.run(n_chunks, read_chunk);
+  }
+
+  return errors == 0 ? 0 : 1;
+}
+
 int MixtureAcousticModel::read_model(const std::string &filename) {
+  if (BinaryModelReader::isBinaryModel(filename))
+    return read_binary_model(filename);
+
   std::cout << "Reading MixtureAcousticModel model from " << filename << "..."
             << std::endl;
 
-  std::ifstream fileI(filename, std::ifstream::in);
+  // Read with a single read, then split into lines in memory.
+  std::string contents;
+  const bool opened = read_file(filename, &contents) == 0;
+  LineCursor fileI(contents);
   std::string line;
   int i, statesIter;
   float value;
   const char del = ' ';
+  // The lines of the components of each mixture, parsed once every mixture
+  // is found.
+  std::vector<TextMixtureBlock> blocks;
 
-  if (fileI.is_open()) {
+  if (opened) {
     std::cout << "Reading..." << std::endl;
     getline(fileI, line);  // AMODEL
     getline(fileI, line);  // Mixture
@@ -149,7 +714,9 @@ int MixtureAcousticModel::read_model(const std::string &filename) {
         state_to_transL[name] = transL;
       }
 
-      std::vector<GaussianMixtureState> state_dgaussians;
+      // Reserved, so the blocks can point to the mixtures.
+      std::vector<GaussianMixtureState> &state_dgaussians =
+          symbol_to_states[name];
       state_dgaussians.reserve(n_q);
 
       for (i = 0; i < n_q; i++) {
@@ -169,23 +736,14 @@ int MixtureAcousticModel::read_model(const std::string &filename) {
 
         getline(fileI, line);  // Members
 
-        std::string mu_line, var_line;
-
-        for (auto j = 0; j < components; j++) {
-          getline(fileI, line, del);  // MU
-          getline(fileI, mu_line);    // values
-
-          getline(fileI, line, del);  // VAR
-          getline(fileI, var_line);   // values
-
-          state_dgaussians[i].addGaussianState(dim, mu_line, var_line);
-        }
+        blocks.push_back(
+            skip_text_members(&fileI, &state_dgaussians[i], components));
       }
-
-      symbol_to_states[name] = state_dgaussians;
     }
 
-    fileI.close();
+    if (read_text_mixtures(blocks) != 0) return 1;
+
+    index_senones();
   } else {
     std::cout << "Unable to open the file " << filename << " for reading."
               << std::endl;
@@ -195,6 +753,19 @@ int MixtureAcousticModel::read_model(const std::string &filename) {
 }
 
 int MixtureAcousticModel::write_model(const std::string &filename) {
+  if (param_format != ParamFormat::Float32) {
+    std::cout << "Unable to write a quantized model, the float parameters "
+                 "were dropped."
+              << std::endl;
+    return 1;
+  }
+
+  if (dim_order.isSet()) {
+    std::cout << "Unable to write a model with reordered dimensions."
+              << std::endl;
+    return 1;
+  }
+
   std::ofstream fileO(filename, std::ios::app);
 
   int n_q;
@@ -265,7 +836,7 @@ int MixtureAcousticModel::write_model(const std::string &filename) {
       int num_q = state_to_num_q[name];
 
       for (auto i = 0; i < num_q; i++) {
-        GaussianMixtureState dg_states = symbol_to_states[name][i];
+        GaussianMixtureState &dg_states = symbol_to_states[name][i];
         fileO << "I " << dg_states.getComponents() << std::endl;
         fileO << "PMembers ";
         std::vector<float> pmembers = dg_states.getPMembers();
@@ -278,8 +849,8 @@ int MixtureAcousticModel::write_model(const std::string &filename) {
 
         fileO << "Members" << std::endl;
         for (auto j = 0; j < dg_states.getComponents(); j++) {
-          std::vector<float> mu = dg_states.getMuByComponent(j);
-          std::vector<float> var = dg_states.getVarByComponent(j);
+          VectorView<float> mu = dg_states.getMuByComponent(j);
+          VectorView<float> var = dg_states.getVarByComponent(j);
 
           fileO << "MU ";
 
@@ -314,31 +885,424 @@ std::string &MixtureAcousticModel::getStateTransType(const std::string &state) {
   return state_to_type[state];
 }
 
-MixtureAcousticModel::MixtureAcousticModel(const std::string &filename)
+int MixtureAcousticModel::read_binary_model(const std::string &filename) {
+  std::cout << "Reading binary MixtureAcousticModel model from " << filename
+            << "..." << std::endl;
+
+  BinaryModelReader reader;
+  if (reader.open(filename, BinaryModelKind::Mixture) != 0) return 1;
+
+  dim = reader.getU32();
+  smooth = reader.getFloats();
+  n_states = reader.getU32();
+
+  for (uint32_t statesIter = 0; statesIter < n_states; statesIter++) {
+    const std::string name = reader.getString();
+    const uint32_t n_q =
+        reader.getCount(GaussianMixtureState::BINARY_META_BYTES);
+    const std::string type = reader.getString();
+    if (reader.failed()) break;
+
+    states.push_back(name);
+    state_to_num_q[name] = n_q;
+    state_to_type[name] = type;
+
+    if (type == "Trans") {
+      state_to_trans[name] = reader.getFloats();
+    } else if (type == "TransL") {
+      std::unordered_map<std::string, std::vector<TransValue>> transL;
+      // A row is at least its source and its count, a transition its
+      // destination and its weight.
+      const uint32_t n_src = reader.getCount(2 * sizeof(uint32_t));
+      for (uint32_t j = 0; j < n_src && !reader.failed(); j++) {
+        std::vector<TransValue> &row = transL[reader.getString()];
+        const uint32_t n_dst = reader.getCount(2 * sizeof(uint32_t));
+        for (uint32_t k = 0; k < n_dst && !reader.failed(); k++) {
+          const std::string state_dst = reader.getString();
+          row.emplace_back(state_dst, reader.getFloat());
+        }
+      }
+      state_to_transL[name] = transL;
+    }
+
+    std::vector<GaussianMixtureState> state_dgaussians(n_q);
+    for (auto &dgstate : state_dgaussians)
+      if (dgstate.read_binary(&reader, dim) != 0) return 1;
+
+    symbol_to_states[name] = std::move(state_dgaussians);
+  }
+
+  if (reader.failed()) {
+    std::cout << "The binary model " << filename << " is corrupted."
+              << std::endl;
+    return 1;
+  }
+
+  mapped_files.push_back(reader.release());
+  index_senones();
+  return 0;
+}
+
+int MixtureAcousticModel::write_binary_model(const std::string &filename) {
+  if (param_format != ParamFormat::Float32) {
+    std::cout << "Unable to write a quantized model, the float parameters "
+                 "were dropped."
+              << std::endl;
+    return 1;
+  }
+
+  if (dim_order.isSet()) {
+    std::cout << "Unable to write a model with reordered dimensions."
+              << std::endl;
+    return 1;
+  }
+
+  BinaryModelWriter writer;
+  writer.putU32(dim);
+  writer.putFloats(smooth);
+  writer.putU32(states.size());
+
+  for (auto &name : states) {
+    const std::string &type = state_to_type[name];
+    writer.putString(name);
+    writer.putU32(state_to_num_q[name]);
+    writer.putString(type);
+
+    if (type == "Trans") {
+      writer.putFloats(state_to_trans[name]);
+    } else if (type == "TransL") {
+      const auto &transL = state_to_transL[name];
+      writer.putU32(transL.size());
+      for (auto &row : transL) {
+        writer.putString(row.first);
+        writer.putU32(row.second.size());
+        for (auto &tv : row.second) {
+          writer.putString(tv.getState());
+          writer.putFloat(tv.getValue());
+        }
+      }
+    }
+
+    for (auto &dgstate : symbol_to_states[name]) dgstate.write_binary(&writer);
+  }
+
+  return writer.write(filename, BinaryModelKind::Mixture);
+}
+
+MixtureAcousticModel::MixtureAcousticModel(const std::string &filename,
+                                           const ParamFormat format)
     : AcousticModel() {
-  MixtureAcousticModel::read_model(filename);
+  if (MixtureAcousticModel::read_model(filename) == 0) quantize(format);
 }
 
 // TODO: Review the tipying...
 float MixtureAcousticModel::calc_logprob(const std::string &state, int q,
                                          const std::vector<float> &frame) {
-  int n_q = state_to_num_q[state];
+  int senone = getSenoneId(state, q);
+
+  if (senone < 0) return INFINITY;
 
-  if (n_q == 0) {
-    return INFINITY;
+  if (frame.size() != dim) return INFINITY;
+
+  return calc_senone_logprob(senone, frame.data());
+}
+
+float MixtureAcousticModel::calc_logprob(const uint32_t symbol, const int q,
+                                         const float *frame) {
+  int senone = getSenoneId(symbol, q);
+
+  if (senone < 0) return INFINITY;
+
+  return calc_senone_logprob(senone, frame);
+}
+
+void MixtureAcousticModel::calc_logprob_block(const std::string &state,
+                                              const int q, const float *frames,
+                                              const uint32_t n_frames,
+                                              float *out) {
+  int senone = getSenoneId(state, q);
+
+  if (senone < 0) {
+    std::fill_n(out, n_frames, INFINITY);
+    return;
+  }
+
+  calc_senone_logprob_block(senone, frames, n_frames, out);
+}
+
+void MixtureAcousticModel::prepare_frames(const float *frames,
+                                          const uint32_t n_frames,
+                                          PreparedFrames *prepared) {
+  AcousticModel::prepare_frames(frames, n_frames, prepared);
+
+  prepared->frames =
+      dim_order.apply_block(frames, n_frames, &prepared->reordered);
+
+  // Without a dimension order, so the frames keep their original order.
+  if (gselection.isLoaded()) {
+    prepared->codewords.resize(n_frames);
+    for (uint32_t f = 0; f < n_frames; f++)
+      prepared->codewords[f] =
+          gselection.nearest_codeword(prepared->getFrame(f));
+  }
+}
+
+float MixtureAcousticModel::calc_prepared_logprob(
+    const uint32_t senone, const PreparedFrames &prepared, const uint32_t f,
+    const float floor) {
+  const GaussianMixtureState &dgstate = *senone_states[senone];
+  const float *frame = prepared.getFrame(f);
+
+  if (gselection.isLoaded())
+    return gselection.calc_logprob(dgstate, senone, prepared.codewords[f],
+                                   frame, log_add_mode);
+
+  if (log_add_mode == LogAddMode::Max && partial_distance)
+    return dgstate.calc_max_logprob(frame, true, floor);
+
+  return dgstate.calc_logprob(frame, log_add_mode);
+}
+
+void MixtureAcousticModel::calc_prepared_logprob_block(
+    const uint32_t senone, const PreparedFrames &prepared,
+    const uint32_t first, const uint32_t n_frames, float *out) {
+  if (gselection.isLoaded() ||
+      (log_add_mode == LogAddMode::Max && partial_distance)) {
+    for (uint32_t f = 0; f < n_frames; f++)
+      out[f] = calc_prepared_logprob(senone, prepared, first + f);
+    return;
   }
 
-  if (q > n_q) return INFINITY;
+  senone_states[senone]->calc_logprob_block(prepared.getFrame(first),
+                                            n_frames, out, log_add_mode);
+}
 
-  GaussianMixtureState dgstate = symbol_to_states[state][q];
+float MixtureAcousticModel::calc_senone_logprob(const uint32_t senone,
+                                                const float *frame) {
+  return calc_senone_logprob(senone, frame, -HUGE_VAL);
+}
 
-  if (frame.size() != dgstate.getDim()) return INFINITY;
+void MixtureAcousticModel::calc_senone_logprob_block(const uint32_t senone,
+                                                     const float *frames,
+                                                     const uint32_t n_frames,
+                                                     float *out) {
+  PreparedFrames prepared;
+  prepare_frames(frames, n_frames, &prepared);
+  calc_prepared_logprob_block(senone, prepared, 0, n_frames, out);
+}
 
-  return dgstate.calc_logprob(frame);
+float MixtureAcousticModel::calc_senone_logprob(const uint32_t senone,
+                                                const float *frame,
+                                                const float floor) {
+  PreparedFrames prepared;
+  prepare_frames(frame, 1, &prepared);
+  return calc_prepared_logprob(senone, prepared, 0, floor);
 }
 
 std::vector<float> &MixtureAcousticModel::getStateTrans(
     const std::string &state) {
   // TODO: Check if transL or trans
   return state_to_trans[state];
-}
\ No newline at end of file
+}
+
+void MixtureAcousticModel::index_senones() {
+  senone_states.clear();
+  state_to_id.clear();
+  symbol_first_senone.clear();
+  symbol_num_q.clear();
+  symbol_type.clear();
+  symbol_trans.clear();
+
+  for (auto &name : states) {
+    state_to_id[name] = symbol_first_senone.size();
+    symbol_first_senone.push_back(senone_states.size());
+    symbol_num_q.push_back(state_to_num_q[name]);
+    symbol_type.push_back(&state_to_type[name]);
+    symbol_trans.push_back(&state_to_trans[name]);
+    for (auto &dgstate : symbol_to_states[name])
+      senone_states.push_back(&dgstate);
+  }
+
+  compile_topology();
+}
+
+// Row and column of a TransL state in the transition matrix of n states: 0 for
+// I, q for the state "q" and n + 1 for F; -1 if it is not one of them.
+static int transl_index(const std::string &name, const int n) {
+  if (name == "I") return 0;
+  if (name == "F") return n + 1;
+
+  int q = 0;
+  std::istringstream iss(name);
+  if (!(iss >> q) || q < 1 || q > n) return -1;
+  return q;
+}
+
+bool MixtureAcousticModel::getTransitionMatrix(
+    const uint32_t symbol, std::vector<float> *matrix) const {
+  if (*symbol_type[symbol] != "TransL") return false;
+
+  auto it = state_to_transL.find(states[symbol]);
+  if (it == state_to_transL.end()) return false;
+
+  const int n = symbol_num_q[symbol];
+  const int size = n + 2;
+  matrix->assign(size * size, -HUGE_VAL);
+
+  for (auto &row : it->second) {
+    int src = transl_index(row.first, n);
+    if (src < 0 || src == n + 1) continue;
+
+    for (auto &tv : row.second) {
+      int dst = transl_index(tv.getState(), n);
+      if (dst > 0) (*matrix)[src * size + dst] = tv.getValue();
+    }
+  }
+  return true;
+}
+
+int MixtureAcousticModel::getSymbolId(const std::string &state) const {
+  auto it = state_to_id.find(state);
+  if (it == state_to_id.end()) return -1;
+
+  return it->second;
+}
+
+int MixtureAcousticModel::getSenoneId(const std::string &state,
+                                      const int q) const {
+  int symbol = getSymbolId(state);
+  if (symbol < 0) return -1;
+
+  return getSenoneId(static_cast<uint32_t>(symbol), q);
+}
+
+int MixtureAcousticModel::getSenoneId(const uint32_t symbol,
+                                      const int q) const {
+  if (symbol >= symbol_num_q.size()) return -1;
+
+  if (q < 0 || q >= symbol_num_q[symbol]) return -1;
+
+  return symbol_first_senone[symbol] + q;
+}
+
+void MixtureAcousticModel::setScoringMode(const ScoringMode mode) {
+  if (mode == ScoringMode::Gemm && !scorer.isPacked()) {
+    if (param_format != ParamFormat::Float32) {
+      std::cout << "ScoringMode::Gemm requires the float parameters."
+                << std::endl;
+      return;
+    }
+    scorer.reset(dim);
+    for (auto dgstate : senone_states) scorer.addMixture(*dgstate);
+    scorer.pack();
+  }
+  scoring_mode = mode;
+}
+
+void MixtureAcousticModel::calc_logprob_block(const float *frames,
+                                              const uint32_t n_frames,
+                                              float *out) {
+  const uint32_t n_senones = getNSenones();
+  if (scoring_mode == ScoringMode::Gemm) {
+    std::vector<float> buffer;
+    frames = dim_order.apply_block(frames, n_frames, &buffer);
+    scorer.calc_block_logprob(frames, n_frames, out, log_add_mode);
+    return;
+  }
+
+  PreparedFrames prepared;
+  prepare_frames(frames, n_frames, &prepared);
+
+  if (gselection.isLoaded()) {
+    for (uint32_t f = 0; f < n_frames; f++)
+      for (uint32_t s = 0; s < n_senones; s++)
+        out[f * n_senones + s] =
+            gselection.calc_logprob(*senone_states[s], s, prepared.codewords[f],
+                                    prepared.getFrame(f), log_add_mode);
+    return;
+  }
+
+  for (uint32_t f = 0; f < n_frames; f++)
+    for (uint32_t s = 0; s < n_senones; s++)
+      out[f * n_senones + s] =
+          senone_states[s]->calc_logprob(prepared.getFrame(f), log_add_mode);
+}
+
+int MixtureAcousticModel::read_gaussian_selection(const std::string &filename) {
+  if (dim_order.isSet()) {
+    std::cout << "Unable to use a Gaussian selection with reordered "
+                 "dimensions."
+              << std::endl;
+    return 1;
+  }
+
+  if (gselection.read_selection(filename) != 0) return 1;
+
+  if (!gselection.matches(senone_states)) {
+    std::cout << "The Gaussian selection in " << filename
+              << " was not built for this model." << std::endl;
+    gselection.clear();
+    return 1;
+  }
+  return 0;
+}
+
+int MixtureAcousticModel::sortDimensions() {
+  if (dim_order.isSet()) return 0;
+
+  if (gselection.isLoaded()) {
+    std::cout << "Unable to reorder the dimensions of a model with a Gaussian "
+                 "selection."
+              << std::endl;
+    return 1;
+  }
+
+  if (dim_order.build(senone_states) != 0) return 1;
+
+  permute_senones(dim_order.getOrder());
+  return 0;
+}
+
+void MixtureAcousticModel::clearDimensionOrder() {
+  if (!dim_order.isSet()) return;
+
+  permute_senones(dim_order.getInverse());
+  dim_order.clear();
+}
+
+void MixtureAcousticModel::permute_senones(
+    const std::vector<uint32_t> &order) {
+  for (auto &it : symbol_to_states)
+    for (auto &dgstate : it.second) dgstate.permute_dims(order);
+
+  if (scorer.isPacked()) {
+    scorer.reset(dim);
+    for (auto dgstate : senone_states) scorer.addMixture(*dgstate);
+    scorer.pack();
+  }
+}
+
+int MixtureAcousticModel::quantize(const ParamFormat format) {
+  if (format == ParamFormat::Float32) return 0;
+
+  if (param_format != ParamFormat::Float32) {
+    std::cout << "The model is already quantized." << std::endl;
+    return 1;
+  }
+
+  // Checked first, so the model is never left half converted.
+  for (auto dgstate : senone_states)
+    if (!dgstate->canQuantize(format)) return 1;
+
+  for (auto &it : symbol_to_states)
+    for (auto &dgstate : it.second) dgstate.quantize(format);
+
+  param_format = format;
+  return 0;
+}
+
+std::size_t MixtureAcousticModel::getParamBytes() const {
+  std::size_t bytes = 0;
+  for (auto dgstate : senone_states) bytes += dgstate->getParamBytes();
+  return bytes;
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright 2020 Javier Jorge. All rights reserved.
+ * License: https://github.com/JJorgeDSIC/CppDecoder#license
+ */
+
+#include "QuadraticScorer.h"
+
+#include "Gemm.h"
+#include "MixtureAcousticModel.h"
+
+QuadraticScorer::QuadraticScorer()
+    : dim(0), expanded_dim(1), n_components(0), ldp(0), offsets(1, 0) {}
+
+void QuadraticScorer::reset(const uint32_t dim) {
+  this->dim = dim;
+  expanded_dim = 2 * dim + 1;
+  n_components = 0;
+  ldp = 0;
+  offsets.assign(1, 0);
+  staging.clear();
+  params.clear();
+}
+
+uint32_t QuadraticScorer::addMixture(const GaussianMixtureState &mixture) {
+  assert(mixture.getDim() == dim);
+  assert(!isPacked());
+
+  for (uint32_t c = 0; c < mixture.getComponents(); c++) {
+    VectorView<float> mu = mixture.getMuByComponent(c);
+    VectorView<float> ivar = mixture.getIVarByComponent(c);
+
+    // The constant accumulates a sum of dim terms, in double.
+    double k = static_cast<double>(mixture.getLogWeightByComponent(c)) +
+               mixture.getLogcByComponent(c);
+    for (uint32_t d = 0; d < dim; d++) staging.push_back(-0.5 * ivar[d]);
+    for (uint32_t d = 0; d < dim; d++) {
+      staging.push_back(static_cast<double>(mu[d]) * ivar[d]);
+      k -= 0.5 * static_cast<double>(mu[d]) * mu[d] * ivar[d];
+    }
+    staging.push_back(k);
+  }
+
+  n_components += mixture.getComponents();
+  offsets.push_back(n_components);
+  return offsets.size() - 2;
+}
+
+void QuadraticScorer::pack() {
+  ldp = aligned_stride(n_components);
+  params.assign(expanded_dim * ldp, 0.0);
+
+  for (uint32_t c = 0; c < n_components; c++)
+    for (uint32_t p = 0; p < expanded_dim; p++)
+      params[p * ldp + c] = staging[c * expanded_dim + p];
+
+  std::vector<float>().swap(staging);
+}
+
+void QuadraticScorer::expand_frames(const float *frames,
+                                    const uint32_t n_frames,
+                                    float *expanded) const {
+  for (uint32_t f = 0; f < n_frames; f++) {
+    const float *x = frames + f * dim;
+    float *e = expanded + f * expanded_dim;
+    for (uint32_t d = 0; d < dim; d++) {
+      e[d] = x[d] * x[d];
+      e[dim + d] = x[d];
+    }
+    e[2 * dim] = 1.0;
+  }
+}
+
+void QuadraticScorer::calc_block_logprob(const float *frames,
+                                         const uint32_t n_frames, float *out,
+                                         const LogAddMode mode) const {
+  assert(isPacked());
+
+  const uint32_t n_senones = getNSenones();
+
+  std::vector<float> expanded(n_frames * expanded_dim);
+  std::vector<float> lprobs(n_frames * ldp);
+
+  expand_frames(frames, n_frames, expanded.data());
+
+  sgemm(n_frames, n_components, expanded_dim, expanded.data(), expanded_dim,
+        params.data(), ldp, lprobs.data(), ldp);
+
+  for (uint32_t f = 0; f < n_frames; f++) {
+    const float *lprob = &lprobs[f * ldp];
+    for (uint32_t s = 0; s < n_senones; s++) {
+      out[f * n_senones + s] = mixture_log_add(
+          lprob + offsets[s], offsets[s + 1] - offsets[s], mode);
+    }
+  }
+}
+
+float mixture_log_add(const float *lprobs, const uint32_t n,
+                      const LogAddMode mode) {
+  float max = -HUGE_VAL;
+  for (uint32_t i = 0; i < n; i++) {
+    if (lprobs[i] == -INFINITY) return -HUGE_VAL;
+
+    if (lprobs[i] > max) max = lprobs[i];
+  }
+
+  if (max != -HUGE_VAL && max != -INFINITY) {
+    return robust_add(lprobs, max, n, mode);
+  } else {
+    return -HUGE_VAL;
+  }
+}
@@ -5,21 +5,33 @@
 
 #include "TiedStatesAcousticModel.h"
 
-TiedStatesAcousticModel::TiedStatesAcousticModel(const std::string &filename)
+#include <algorithm>
+
+TiedStatesAcousticModel::TiedStatesAcousticModel(const std::string &filename,
+                                                 const ParamFormat format)
     : AcousticModel() {
-  TiedStatesAcousticModel::read_model(filename);
+  if (TiedStatesAcousticModel::read_model(filename) == 0) quantize(format);
 }
 
 int TiedStatesAcousticModel::read_model(const std::string &filename) {
+  if (BinaryModelReader::isBinaryModel(filename))
+    return read_binary_model(filename);
+
   std::cout << "Reading TiedStatesAcousticModel from " << filename << "..."
             << std::endl;
 
-  std::ifstream fileI(filename, std::ifstream::in);
+  // Read with a single read, then split into lines in memory.
+  std::string contents;
+  const bool opened = read_file(filename, &contents) == 0;
+  LineCursor fileI(contents);
   std::string line, name;
   const char del = ' ';
   uint32_t i, statesIter;
+  // The lines of the components of each mixture, parsed once every mixture
+  // is found.
+  std::vector<TextMixtureBlock> blocks;
 
-  if (fileI.is_open()) {
+  if (opened) {
     int components, n_q;
 
     getline(fileI, line);       // AMODEL
@@ -50,7 +62,9 @@ int TiedStatesAcousticModel::read_model(const std::string &filename) {
       getline(fileI, line);       // value
       std::stringstream(line) >> components;
 
-      GaussianMixtureState dg_state(components, dim);
+      // In the map from the start, so the block can point to it.
+      GaussianMixtureState &dg_state = senone_to_mixturestate[name];
+      dg_state = GaussianMixtureState(components, dim);
 
       getline(fileI, line, del);  // PMembers
       getline(fileI, line);       // value
@@ -60,19 +74,7 @@ int TiedStatesAcousticModel::read_model(const std::string &filename) {
 
       getline(fileI, line);  // Members
 
-      std::string mu_line, var_line;
-
-      for (auto j = 0; j < components; j++) {
-        getline(fileI, line, del);  // MU
-        getline(fileI, mu_line);    // values
-
-        getline(fileI, line, del);  // VAR
-        getline(fileI, var_line);   // values
-
-        dg_state.addGaussianState(dim, mu_line, var_line);
-      }
-
-      senone_to_mixturestate[name] = dg_state;
+      blocks.push_back(skip_text_members(&fileI, &dg_state, components));
     }
 
     getline(fileI, line, del);  // N
@@ -138,7 +140,10 @@ int TiedStatesAcousticModel::read_model(const std::string &filename) {
         symbol_to_type[symbol] = "TransP";
       }
     }
-    fileI.close();
+
+    if (read_text_mixtures(blocks) != 0) return 1;
+
+    index_senones();
   } else {
     std::cout << "Unable to open file for reading" << std::endl;
     return 1;
@@ -146,7 +151,115 @@ int TiedStatesAcousticModel::read_model(const std::string &filename) {
   return 0;
 }
 
+int TiedStatesAcousticModel::read_binary_model(const std::string &filename) {
+  std::cout << "Reading binary TiedStatesAcousticModel from " << filename
+            << "..." << std::endl;
+
+  BinaryModelReader reader;
+  if (reader.open(filename, BinaryModelKind::TiedStates) != 0) return 1;
+
+  dim = reader.getU32();
+  smooth = reader.getFloats();
+  n_states = reader.getU32();
+
+  for (uint32_t statesIter = 0; statesIter < n_states; statesIter++) {
+    const std::string name = reader.getString();
+    if (reader.failed()) break;
+    senones.push_back(name);
+
+    GaussianMixtureState dg_state;
+    if (dg_state.read_binary(&reader, dim) != 0) return 1;
+    senone_to_mixturestate[name] = std::move(dg_state);
+  }
+
+  n_trans = reader.getU32();
+
+  for (uint32_t i = 0; i < n_trans && !reader.failed(); i++) {
+    const std::string symbol = reader.getString();
+    const std::string type = reader.getString();
+    const std::string token = reader.getString();
+    std::vector<float> trans = reader.getFloats();
+
+    // Each name is at least its length.
+    std::vector<std::string> symbol_senones(reader.getCount(sizeof(uint32_t)));
+    for (auto &senone : symbol_senones) senone = reader.getString();
+
+    symbols.push_back(symbol);
+    symbol_to_transitions[symbol] = trans;
+    symbol_to_senones[symbol] = symbol_senones;
+    symbol_to_symbol_transitions[symbol] = token;
+    symbol_to_type[symbol] = type;
+  }
+
+  if (reader.failed()) {
+    std::cout << "The binary model " << filename << " is corrupted."
+              << std::endl;
+    return 1;
+  }
+
+  mapped_files.push_back(reader.release());
+  index_senones();
+  return 0;
+}
+
+int TiedStatesAcousticModel::write_binary_model(const std::string &filename) {
+  if (param_format != ParamFormat::Float32) {
+    std::cout << "Unable to write a quantized model, the float parameters "
+                 "were dropped."
+              << std::endl;
+    return 1;
+  }
+
+  if (dim_order.isSet()) {
+    std::cout << "Unable to write a model with reordered dimensions."
+              << std::endl;
+    return 1;
+  }
+
+  BinaryModelWriter writer;
+  writer.putU32(dim);
+  writer.putFloats(smooth);
+  writer.putU32(senones.size());
+
+  for (auto &name : senones) {
+    writer.putString(name);
+    senone_to_mixturestate[name].write_binary(&writer);
+  }
+
+  writer.putU32(symbols.size());
+
+  for (auto &symbol : symbols) {
+    const std::vector<std::string> &symbol_senones = symbol_to_senones[symbol];
+    writer.putString(symbol);
+    writer.putString(symbol_to_type[symbol]);
+    writer.putString(symbol_to_symbol_transitions[symbol]);
+    writer.putFloats(symbol_to_transitions[symbol]);
+    writer.putU32(symbol_senones.size());
+    for (auto &senone : symbol_senones) writer.putString(senone);
+  }
+
+  return writer.write(filename, BinaryModelKind::TiedStates);
+}
+
 int TiedStatesAcousticModel::write_model(const std::string &filename) {
+  if (param_format != ParamFormat::Float32) {
+    std::cout << "Unable to write a quantized model, the float parameters "
+                 "were dropped."
+              << std::endl;
+    return 1;
+  }
+
+  if (dim_order.isSet()) {
+    std::cout << "Unable to write a model with reordered dimensions."
+              << std::endl;
+    return 1;
+  }
+
+  if (smooth.empty()) {
+    std::cout << "Unable to write an empty model." << std::endl;
+    return 1;
+  }
+
   std::ofstream fileO(filename, std::ios::app);
 
   if (fileO.is_open()) {
@@ -183,10 +296,10 @@ int TiedStatesAcousticModel::write_model(const std::string &filename) {
 
       fileO << "Members" << std::endl;
 
-      GaussianMixtureState gsmixstate = senone_to_mixturestate[senones[i]];
+      GaussianMixtureState &gsmixstate = senone_to_mixturestate[senones[i]];
       for (auto j = 0; j < components; j++) {
-        std::vector<float> mu = gsmixstate.getMuByComponent(j);
-        std::vector<float> var = gsmixstate.getVarByComponent(j);
+        VectorView<float> mu = gsmixstate.getMuByComponent(j);
+        VectorView<float> var = gsmixstate.getVarByComponent(j);
 
         fileO << "MU ";
         for (uint32_t i = 0; i < mu.size() - 1; i++) {
@@ -252,22 +365,386 @@ std::string &TiedStatesAcousticModel::getStateTransType(
 float TiedStatesAcousticModel::calc_logprob(const std::string &state,
                                             const int q,
                                             const std::vector<float> &frame) {
-  std::vector<std::string> senones = symbol_to_senones[state];
+  int senone = getSenoneId(state, q);
+
+  if (senone < 0) return INFINITY;
+
+  if (frame.size() != dim) return INFINITY;
+
+  return calc_senone_logprob(senone, frame.data());
+}
 
-  if (senones.size() == 0) return INFINITY;
+float TiedStatesAcousticModel::calc_logprob(const uint32_t symbol,
+                                            const int q, const float *frame) {
+  int senone = getSenoneId(symbol, q);
 
-  if (senones.size() < q) return INFINITY;
+  if (senone < 0) return INFINITY;
 
-  std::string senon = senones[q];
+  return calc_senone_logprob(senone, frame);
+}
 
-  GaussianMixtureState dgstate = senone_to_mixturestate[senon];
+void TiedStatesAcousticModel::calc_logprob_block(const std::string &state,
+                                                 const int q,
+                                                 const float *frames,
+                                                 const uint32_t n_frames,
+                                                 float *out) {
+  int senone = getSenoneId(state, q);
 
-  if (frame.size() != dgstate.getDim()) return INFINITY;
+  if (senone < 0) {
+    std::fill_n(out, n_frames, INFINITY);
+    return;
+  }
 
-  return dgstate.calc_logprob(frame);
+  calc_senone_logprob_block(senone, frames, n_frames, out);
+}
+
+void TiedStatesAcousticModel::prepare_frames(const float *frames,
+                                             const uint32_t n_frames,
+                                             PreparedFrames *prepared) {
+  AcousticModel::prepare_frames(frames, n_frames, prepared);
+
+  prepared->frames =
+      dim_order.apply_block(frames, n_frames, &prepared->reordered);
+
+  if (fm_model) {
+    const uint32_t n_scores = fm_model->getNSenones();
+    prepared->n_fm_scores = n_scores;
+    prepared->fm_scores.resize(n_frames * n_scores);
+    prepared->fm_best.resize(n_frames);
+
+    fm_model->setLogAddMode(log_add_mode);
+    fm_model->calc_logprob_block(frames, n_frames, prepared->fm_scores.data());
+    for (uint32_t f = 0; f < n_frames; f++) {
+      const float *scores = &prepared->fm_scores[f * n_scores];
+      prepared->fm_best[f] = *std::max_element(scores, scores + n_scores);
+    }
+  }
+
+  // Without a dimension order, so the frames keep their original order.
+  if (gselection.isLoaded()) {
+    prepared->codewords.resize(n_frames);
+    for (uint32_t f = 0; f < n_frames; f++)
+      prepared->codewords[f] =
+          gselection.nearest_codeword(prepared->getFrame(f));
+  }
+}
+
+float TiedStatesAcousticModel::calc_prepared_logprob(
+    const uint32_t senone, const PreparedFrames &prepared, const uint32_t f,
+    const float floor) {
+  float lprob;
+  if (fast_match_pruned(senone, prepared, f, &lprob)) return lprob;
+
+  const GaussianMixtureState &dgstate = *senone_states[senone];
+  const float *frame = prepared.getFrame(f);
+
+  if (gselection.isLoaded())
+    return gselection.calc_logprob(dgstate, senone, prepared.codewords[f],
+                                   frame, log_add_mode);
+
+  if (log_add_mode == LogAddMode::Max && partial_distance)
+    return dgstate.calc_max_logprob(frame, true, floor);
+
+  return dgstate.calc_logprob(frame, log_add_mode);
+}
+
+void TiedStatesAcousticModel::calc_prepared_logprob_block(
+    const uint32_t senone, const PreparedFrames &prepared,
+    const uint32_t first, const uint32_t n_frames, float *out) {
+  if (fm_model || gselection.isLoaded() ||
+      (log_add_mode == LogAddMode::Max && partial_distance)) {
+    for (uint32_t f = 0; f < n_frames; f++)
+      out[f] = calc_prepared_logprob(senone, prepared, first + f);
+    return;
+  }
+
+  senone_states[senone]->calc_logprob_block(prepared.getFrame(first),
+                                            n_frames, out, log_add_mode);
+}
+
+float TiedStatesAcousticModel::calc_senone_logprob(const uint32_t senone,
+                                                   const float *frame) {
+  return calc_senone_logprob(senone, frame, -HUGE_VAL);
+}
+
+void TiedStatesAcousticModel::calc_senone_logprob_block(const uint32_t senone,
+                                                        const float *frames,
+                                                        const uint32_t n_frames,
+                                                        float *out) {
+  PreparedFrames prepared;
+  prepare_frames(frames, n_frames, &prepared);
+  calc_prepared_logprob_block(senone, prepared, 0, n_frames, out);
+}
+
+float TiedStatesAcousticModel::calc_senone_logprob(const uint32_t senone,
+                                                   const float *frame,
+                                                   const float floor) {
+  PreparedFrames prepared;
+  prepare_frames(frame, 1, &prepared);
+  return calc_prepared_logprob(senone, prepared, 0, floor);
+}
+
+bool TiedStatesAcousticModel::fast_match_pruned(
+    const uint32_t senone, const PreparedFrames &prepared, const uint32_t f,
+    float *lprob) const {
+  if (!fm_model || fm_parents[senone] < 0) return false;
+
+  const float parent =
+      prepared.fm_scores[f * prepared.n_fm_scores + fm_parents[senone]];
+  if (parent >= prepared.fm_best[f] - fm_beam) return false;
+
+  *lprob = parent + fm_penalty;
+  return true;
 }
 
 std::vector<float> &TiedStatesAcousticModel::getStateTrans(
     const std::string &state) {
   return symbol_to_transitions[state];
 }
+
+void TiedStatesAcousticModel::index_senones() {
+  senone_states.clear();
+  senone_to_id.clear();
+
+  for (auto &senone : senones) {
+    senone_to_id[senone] = senone_states.size();
+    senone_states.push_back(&senone_to_mixturestate[senone]);
+  }
+
+  symbol_to_id.clear();
+  symbol_senone_offsets.assign(1, 0);
+  symbol_senone_ids.clear();
+  symbol_type.clear();
+  symbol_trans.clear();
+
+  for (auto &symbol : symbols) {
+    symbol_to_id[symbol] = symbol_type.size();
+    for (auto &senone : symbol_to_senones[symbol]) {
+      auto id = senone_to_id.find(senone);
+      symbol_senone_ids.push_back(id == senone_to_id.end() ? -1 : id->second);
+    }
+    symbol_senone_offsets.push_back(symbol_senone_ids.size());
+    symbol_type.push_back(&symbol_to_type[symbol]);
+    symbol_trans.push_back(&symbol_to_transitions[symbol]);
+  }
+
+  compile_topology();
+}
+
+int TiedStatesAcousticModel::getSymbolId(const std::string &state) const {
+  auto it = symbol_to_id.find(state);
+  if (it == symbol_to_id.end()) return -1;
+
+  return it->second;
+}
+
+int TiedStatesAcousticModel::getSenoneId(const std::string &state,
+                                         const int q) const {
+  int symbol = getSymbolId(state);
+  if (symbol < 0) return -1;
+
+  return getSenoneId(static_cast<uint32_t>(symbol), q);
+}
+
+int TiedStatesAcousticModel::getSenoneId(const uint32_t symbol,
+                                         const int q) const {
+  if (symbol >= symbol_type.size()) return -1;
+
+  const uint32_t begin = symbol_senone_offsets[symbol];
+  if (q < 0 || begin + q >= symbol_senone_offsets[symbol + 1]) return -1;
+
+  return symbol_senone_ids[begin + q];
+}
+
+void TiedStatesAcousticModel::setScoringMode(const ScoringMode mode) {
+  if (mode == ScoringMode::Gemm && !scorer.isPacked()) {
+    if (param_format != ParamFormat::Float32) {
+      std::cout << "ScoringMode::Gemm requires the float parameters."
+                << std::endl;
+      return;
+    }
+    scorer.reset(dim);
+    for (auto dgstate : senone_states) scorer.addMixture(*dgstate);
+    scorer.pack();
+  }
+  scoring_mode = mode;
+}
+
+void TiedStatesAcousticModel::calc_logprob_block(const float *frames,
+                                                 const uint32_t n_frames,
+                                                 float *out) {
+  const uint32_t n_senones = getNSenones();
+
+  if (scoring_mode == ScoringMode::Gemm) {
+    std::vector<float> buffer;
+    frames = dim_order.apply_block(frames, n_frames, &buffer);
+    scorer.calc_block_logprob(frames, n_frames, out, log_add_mode);
+    return;
+  }
+
+  PreparedFrames prepared;
+  prepare_frames(frames, n_frames, &prepared);
+
+  if (fm_model) {
+    for (uint32_t f = 0; f < n_frames; f++)
+      for (uint32_t s = 0; s < n_senones; s++)
+        out[f * n_senones + s] = calc_prepared_logprob(s, prepared, f);
+    return;
+  }
+
+  if (gselection.isLoaded()) {
+    for (uint32_t f = 0; f < n_frames; f++)
+      for (uint32_t s = 0; s < n_senones; s++)
+        out[f * n_senones + s] =
+            gselection.calc_logprob(*senone_states[s], s, prepared.codewords[f],
+                                    prepared.getFrame(f), log_add_mode);
+    return;
+  }
+
+  for (uint32_t f = 0; f < n_frames; f++)
+    for (uint32_t s = 0; s < n_senones; s++)
+      out[f * n_senones + s] =
+          senone_states[s]->calc_logprob(prepared.getFrame(f), log_add_mode);
+}
+
+int TiedStatesAcousticModel::read_gaussian_selection(
+    const std::string &filename) {
+  if (dim_order.isSet()) {
+    std::cout << "Unable to use a Gaussian selection with reordered "
+                 "dimensions."
+              << std::endl;
+    return 1;
+  }
+
+  if (gselection.read_selection(filename) != 0) return 1;
+
+  if (!gselection.matches(senone_states)) {
+    std::cout << "The Gaussian selection in " << filename
+              << " was not built for this model." << std::endl;
+    gselection.clear();
+    return 1;
+  }
+  return 0;
+}
+
+int TiedStatesAcousticModel::read_fast_match(const std::string &filename,
+                                             const float beam,
+                                             const float penalty) {
+  clearFastMatch();
+
+  std::unique_ptr<MixtureAcousticModel> model(
+      new MixtureAcousticModel(filename));
+
+  if (model->getNSenones() == 0 || model->getDim() != dim) {
+    std::cout << "The fast match model " << filename
+              << " does not match this model." << std::endl;
+    return 1;
+  }
+
+  // Parent of each senone, -2 if its symbols have different parents.
+  std::vector<int> parents(getNSenones(), -1);
+  for (uint32_t symbol = 0; symbol < getNSymbols(); symbol++) {
+    int ci = model->getSymbolId(getCentralPhone(symbols[symbol]));
+    if (ci < 0) continue;
+
+    for (int q = 0; getSenoneId(symbol, q) >= 0; q++) {
+      int senone = getSenoneId(symbol, q);
+      int parent = model->getSenoneId(static_cast<uint32_t>(ci), q);
+      if (parent < 0 || parents[senone] == parent) continue;
+      parents[senone] = parents[senone] == -1 ? parent : -2;
+    }
+  }
+
+  uint32_t n_parents = 0;
+  for (auto &parent : parents) {
+    if (parent == -2) parent = -1;
+    if (parent >= 0) n_parents++;
+  }
+
+  if (n_parents == 0) {
+    std::cout << "No senone has a parent in the fast match model " << filename
+              << "." << std::endl;
+    return 1;
+  }
+
+  fm_model = std::move(model);
+  fm_parents = std::move(parents);
+  fm_beam = beam;
+  fm_penalty = penalty;
+
+  return 0;
+}
+
+void TiedStatesAcousticModel::clearFastMatch() {
+  fm_model.reset();
+  fm_parents.clear();
+}
+
+std::string TiedStatesAcousticModel::getCentralPhone(
+    const std::string &symbol) {
+  std::size_t begin = symbol.find('-');
+  begin = begin == std::string::npos ? 0 : begin + 1;
+
+  std::size_t end = symbol.find('+', begin);
+  if (end == std::string::npos) end = symbol.size();
+
+  return symbol.substr(begin, end - begin);
+}
+
+int TiedStatesAcousticModel::sortDimensions() {
+  if (dim_order.isSet()) return 0;
+
+  if (gselection.isLoaded()) {
+    std::cout << "Unable to reorder the dimensions of a model with a Gaussian "
+                 "selection."
+              << std::endl;
+    return 1;
+  }
+
+  if (dim_order.build(senone_states) != 0) return 1;
+
+  permute_senones(dim_order.getOrder());
+  return 0;
+}
+
+void TiedStatesAcousticModel::clearDimensionOrder() {
+  if (!dim_order.isSet()) return;
+
+  permute_senones(dim_order.getInverse());
+  dim_order.clear();
+}
+
+void TiedStatesAcousticModel::permute_senones(
+    const std::vector<uint32_t> &order) {
+  for (auto &it : senone_to_mixturestate) it.second.permute_dims(order);
+
+  if (scorer.isPacked()) {
+    scorer.reset(dim);
+    for (auto dgstate : senone_states) scorer.addMixture(*dgstate);
+    scorer.pack();
+  }
+}
+
+int TiedStatesAcousticModel::quantize(const ParamFormat format) {
+  if (format == ParamFormat::Float32) return 0;
+
+  if (param_format != ParamFormat::Float32) {
+    std::cout << "The model is already quantized." << std::endl;
+    return 1;
+  }
+
+  // Checked first, so the model is never left half converted.
+  for (auto dgstate : senone_states)
+    if (!dgstate->canQuantize(format)) return 1;
+
+  for (auto &it : senone_to_mixturestate) it.second.quantize(format);
+
+  param_format = format;
+  return 0;
+}
+
+std::size_t TiedStatesAcousticModel::getParamBytes() const {
+  std::size_t bytes = 0;
+  for (auto dgstate : senone_states) bytes += dgstate->getParamBytes();
+  return bytes;
+}
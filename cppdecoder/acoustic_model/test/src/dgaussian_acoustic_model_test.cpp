@@ -8,6 +8,7 @@
 #include <stdio.h>
 
 #include <iomanip>  // std::setprecision
+#include <random>
 
 #include "gtest/gtest.h"
 
@@ -136,6 +137,225 @@ TEST_F(DGaussianAcousticModelTests, GaussianStateTestCalcLogProb) {
   ASSERT_FLOAT_EQ(prob_second_constructor, probTrue);
 }
 
+TEST_F(DGaussianAcousticModelTests, GaussianKernelsMatchScalar) {
+  std::vector<float> mu = read_vector<float>(lineMu);
+  std::vector<float> ivar;
+  for (auto value : read_vector<float>(lineVar)) ivar.push_back(1.0 / value);
+
+  std::mt19937 gen(1234);
+  std::normal_distribution<float> normal(0.0, 1.0);
+  std::uniform_real_distribution<float> uniform(0.1, 2.0);
+
+  const SimdLevel levels[] = {SimdLevel::Scalar, SimdLevel::SSE4,
+                              SimdLevel::AVX2, SimdLevel::AVX512};
+
+  for (auto level : levels) {
+    DiagGaussianKernel kernel = get_diag_gaussian_kernel(level);
+    if (kernel == nullptr) {
+      std::cout << simd_level_name(level) << " not available" << std::endl;
+      continue;
+    }
+
+    float expected =
+        diag_gaussian_distance_scalar(frame.data(), mu.data(), ivar.data(), 48);
+    ASSERT_NEAR(kernel(frame.data(), mu.data(), ivar.data(), 48), expected,
+                DIAG_GAUSSIAN_KERNEL_TOLERANCE * expected);
+
+    // Every dimension up to 128, to cover the tails of all the variants.
+    for (uint32_t dim = 1; dim <= 128; dim++) {
+      std::vector<float> x(dim), m(dim), iv(dim);
+      for (uint32_t i = 0; i < dim; i++) {
+        x[i] = normal(gen);
+        m[i] = normal(gen);
+        iv[i] = uniform(gen);
+      }
+      expected =
+          diag_gaussian_distance_scalar(x.data(), m.data(), iv.data(), dim);
+      ASSERT_NEAR(kernel(x.data(), m.data(), iv.data(), dim), expected,
+                  DIAG_GAUSSIAN_KERNEL_TOLERANCE * expected)
+          << simd_level_name(level) << ", dim " << dim;
+    }
+  }
+}
+
+TEST_F(DGaussianAcousticModelTests, GaussianBoundedKernelsMatchScalar) {
+  std::mt19937 gen(1234);
+  std::normal_distribution<float> normal(0.0, 1.0);
+  std::uniform_real_distribution<float> uniform(0.1, 2.0);
+
+  const SimdLevel levels[] = {SimdLevel::Scalar, SimdLevel::SSE4,
+                              SimdLevel::AVX2, SimdLevel::AVX512};
+
+  for (auto level : levels) {
+    DiagGaussianBoundedKernel kernel = get_diag_gaussian_bounded_kernel(level);
+    if (kernel == nullptr) {
+      std::cout << simd_level_name(level) << " not available" << std::endl;
+      continue;
+    }
+
+    for (uint32_t dim = 1; dim <= 128; dim++) {
+      std::vector<float> x(dim), m(dim), iv(dim);
+      for (uint32_t i = 0; i < dim; i++) {
+        x[i] = normal(gen);
+        m[i] = normal(gen);
+        iv[i] = uniform(gen);
+      }
+      float expected =
+          diag_gaussian_distance_scalar(x.data(), m.data(), iv.data(), dim);
+
+      // Not reached: the whole distance.
+      ASSERT_NEAR(kernel(x.data(), m.data(), iv.data(), dim, HUGE_VAL),
+                  expected, DIAG_GAUSSIAN_KERNEL_TOLERANCE * expected)
+          << simd_level_name(level) << ", dim " << dim;
+
+      // Reached: a partial sum over the bound, at most the distance.
+      float bound = 0.25 * expected;
+      float partial = kernel(x.data(), m.data(), iv.data(), dim, bound);
+      ASSERT_GT(partial, bound) << simd_level_name(level) << ", dim " << dim;
+      ASSERT_LE(partial, expected * (1 + DIAG_GAUSSIAN_KERNEL_TOLERANCE))
+          << simd_level_name(level) << ", dim " << dim;
+    }
+  }
+}
+
+TEST_F(DGaussianAcousticModelTests, QuantizedKernelsMatchScalar) {
+  std::mt19937 gen(1234);
+  std::uniform_int_distribution<int16_t> frame(-QUANTIZED_FRAME_LIMIT,
+                                               QUANTIZED_FRAME_LIMIT);
+  std::uniform_int_distribution<int16_t> mean(-1023, 1023);
+  std::uniform_int_distribution<int16_t> weight(0, 32767);
+
+  const SimdLevel levels[] = {SimdLevel::Scalar, SimdLevel::SSE4,
+                              SimdLevel::AVX2, SimdLevel::AVX512};
+
+  for (auto level : levels) {
+    QuantizedGaussianKernel kernel = get_quantized_gaussian_kernel(level);
+    QuantizedGaussianKernel8 kernel8 = get_quantized_gaussian_kernel8(level);
+    if (kernel == nullptr || kernel8 == nullptr) {
+      std::cout << simd_level_name(level) << " not available" << std::endl;
+      continue;
+    }
+
+    for (uint32_t dim = 1; dim <= QUANTIZED_MAX_DIM; dim++) {
+      std::vector<int16_t> x(dim), m(dim), w(dim);
+      std::vector<int8_t> m8(dim), w8(dim);
+      for (uint32_t i = 0; i < dim; i++) {
+        x[i] = frame(gen);
+        m[i] = mean(gen);
+        w[i] = weight(gen);
+        m8[i] = m[i] / 8;
+        w8[i] = w[i] / 256;
+      }
+
+      // Integer arithmetic: exactly the same value.
+      ASSERT_EQ(kernel(x.data(), m.data(), w.data(), dim),
+                quantized_gaussian_distance_scalar(x.data(), m.data(),
+                                                   w.data(), dim))
+          << simd_level_name(level) << ", dim " << dim;
+      ASSERT_EQ(kernel8(x.data(), m8.data(), w8.data(), dim),
+                quantized_gaussian_distance8_scalar(x.data(), m8.data(),
+                                                    w8.data(), dim))
+          << simd_level_name(level) << ", dim " << dim;
+
+      // And close to the float distance with the same values (each term is
+      // rounded by at most |x_i - mu_i| / 2).
+      double expected = 0.0, rounding = 0.0;
+      for (uint32_t i = 0; i < dim; i++) {
+        double d = x[i] - m[i];
+        expected += d * d * w[i] / 32768.0;
+        rounding += 0.5 * fabs(d);
+      }
+      ASSERT_NEAR(kernel(x.data(), m.data(), w.data(), dim), expected,
+                  rounding + 1.0)
+          << simd_level_name(level) << ", dim " << dim;
+    }
+  }
+}
+
+TEST_F(DGaussianAcousticModelTests, HalfKernelsMatchScalar) {
+  // Conversions: exact values, rounding to nearest even, subnormals and
+  // overflow.
+  ASSERT_EQ(float_to_half(1.0), 0x3c00);
+  ASSERT_EQ(float_to_half(-2.0), 0xc000);
+  ASSERT_EQ(float_to_half(65504.0), 0x7bff);
+  ASSERT_EQ(float_to_half(1e6), 0x7c00);
+  ASSERT_EQ(float_to_half(1.0 + 1.0 / 2048), 0x3c00);
+  ASSERT_EQ(float_to_half(1.0 + 3.0 / 2048), 0x3c02);
+  ASSERT_EQ(float_to_half(std::ldexp(1.0f, -24)), 0x0001);
+  ASSERT_EQ(half_to_float(0x0001), std::ldexp(1.0f, -24));
+  ASSERT_EQ(half_to_float(0x3555), 0.333251953125f);
+  ASSERT_EQ(float_to_bfloat16(1.0), 0x3f80);
+  ASSERT_EQ(bfloat16_to_float(0x3f80), 1.0f);
+  ASSERT_EQ(float_to_bfloat16(1.0 + 1.0 / 256), 0x3f80);
+  ASSERT_EQ(float_to_bfloat16(1.0 + 3.0 / 256), 0x3f82);
+
+  std::mt19937 gen(1234);
+  std::normal_distribution<float> normal(0.0, 1.0);
+  std::uniform_real_distribution<float> uniform(0.1, 2.0);
+
+  for (int i = 0; i < 1000; i++) {
+    float value = normal(gen);
+    ASSERT_NEAR(half_to_float(float_to_half(value)), value,
+                fabs(value) / 2048);
+    ASSERT_NEAR(bfloat16_to_float(float_to_bfloat16(value)), value,
+                fabs(value) / 256);
+  }
+
+  const SimdLevel levels[] = {SimdLevel::Scalar, SimdLevel::SSE4,
+                              SimdLevel::AVX2, SimdLevel::AVX512};
+
+  for (auto level : levels) {
+    HalfGaussianKernel half = get_half_gaussian_kernel(level);
+    HalfGaussianKernel bfloat16 = get_bfloat16_gaussian_kernel(level);
+    if (half == nullptr || bfloat16 == nullptr) {
+      std::cout << simd_level_name(level) << " not available" << std::endl;
+      continue;
+    }
+
+    for (uint32_t dim = 1; dim <= 128; dim++) {
+      std::vector<float> x(dim), m(dim), iv(dim);
+      std::vector<uint16_t> hm(dim), hiv(dim), bm(dim), biv(dim);
+      for (uint32_t i = 0; i < dim; i++) {
+        x[i] = normal(gen);
+        hm[i] = float_to_half(normal(gen));
+        hiv[i] = float_to_half(uniform(gen));
+        bm[i] = float_to_bfloat16(normal(gen));
+        biv[i] = float_to_bfloat16(uniform(gen));
+      }
+
+      // The same as the float kernel with the converted values.
+      for (uint32_t i = 0; i < dim; i++) {
+        m[i] = half_to_float(hm[i]);
+        iv[i] = half_to_float(hiv[i]);
+      }
+      float expected =
+          diag_gaussian_distance_scalar(x.data(), m.data(), iv.data(), dim);
+      ASSERT_NEAR(half(x.data(), hm.data(), hiv.data(), dim), expected,
+                  DIAG_GAUSSIAN_KERNEL_TOLERANCE * expected)
+          << simd_level_name(level) << ", dim " << dim;
+
+      for (uint32_t i = 0; i < dim; i++) {
+        m[i] = bfloat16_to_float(bm[i]);
+        iv[i] = bfloat16_to_float(biv[i]);
+      }
+      expected =
+          diag_gaussian_distance_scalar(x.data(), m.data(), iv.data(), dim);
+      ASSERT_NEAR(bfloat16(x.data(), bm.data(), biv.data(), dim), expected,
+                  DIAG_GAUSSIAN_KERNEL_TOLERANCE * expected)
+          << simd_level_name(level) << ", dim " << dim;
+    }
+  }
+}
+
+TEST_F(DGaussianAcousticModelTests, GaussianKernelsDispatch) {
+  SimdLevel level = active_simd_level();
+  std::cout << "Active kernel: " << simd_level_name(level) << std::endl;
+
+  ASSERT_EQ(level, detect_simd_level());
+  ASSERT_TRUE(get_diag_gaussian_kernel(level) != nullptr);
+  ASSERT_TRUE(get_diag_gaussian_kernel(SimdLevel::Scalar) != nullptr);
+}
+
 TEST_F(DGaussianAcousticModelTests, DGaussianAcousticModelReadWrite) {
   DGaussianAcousticModel dgaussianmodel(nameModel);
   dgaussianmodel.write_model(nameWrittenModel);
@@ -199,6 +419,20 @@ TEST_F(DGaussianAcousticModelTests, DGaussianAcousticModelCalcLogProb) {
   ASSERT_FLOAT_EQ(prob, probTrue);
 }
 
+TEST_F(DGaussianAcousticModelTests, DGaussianAcousticModelSenones) {
+  DGaussianAcousticModel dgaussianmodel(nameModel);
+
+  int senone = dgaussianmodel.getSenoneId("aa", 0);
+  ASSERT_GE(senone, 0);
+  ASSERT_LT(senone, dgaussianmodel.getNSenones());
+  ASSERT_EQ(dgaussianmodel.getSenoneId("aa", 1), senone + 1);
+  ASSERT_EQ(dgaussianmodel.calc_senone_logprob(senone, frame.data()),
+            dgaussianmodel.calc_logprob("aa", 0, frame));
+
+  ASSERT_EQ(dgaussianmodel.getSenoneId("aa", 56), -1);
+  ASSERT_EQ(dgaussianmodel.getSenoneId("aaaaaaaaaa", 0), -1);
+}
+
 TEST_F(DGaussianAcousticModelTests, DGaussianAcousticGetStateType) {
   DGaussianAcousticModel dgaussianmodel(nameModel);
 
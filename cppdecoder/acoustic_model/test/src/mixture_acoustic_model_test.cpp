@@ -3,11 +3,15 @@
  * License: https://github.com/JJorgeDSIC/CppDecoder#license
  */
 
+#include <GaussianSelection.h>
+#include <Gemm.h>
 #include <MixtureAcousticModel.h>
 #include <Utils.h>
 #include <stdio.h>
 
 #include <iomanip>  // std::setprecision
+#include <random>
+#include <set>
 
 #include "gtest/gtest.h"
 
@@ -21,6 +25,15 @@ class MixtureAcousticModelTests : public ::testing::Test {
   const std::string nameWrittenModel =
       "./models/mixture_monophoneme_I32.example.model.test";
 
+  const std::string nameBinaryModel =
+      "./models/mixture_monophoneme_I32.example.model.bin.test";
+
+  const std::string nameSelection =
+      "./models/mixture_monophoneme_I32.example.gselection.test";
+
+  const std::string nameWrittenSelection =
+      "./models/mixture_monophoneme_I32.example.gselection.test2";
+
   std::ifstream fileNameModel;
   std::ifstream fileNameWrittenModel;
 
@@ -144,6 +157,113 @@ TEST_F(MixtureAcousticModelTests, GaussianMixtureStateTestCalcLogProbHugeVal) {
   ASSERT_EQ(r_add, gstates.calc_logprob(frame));
 }
 
+TEST_F(MixtureAcousticModelTests, GaussianMixtureStatePackedComponents) {
+  GaussianState gstate1(frame.size(), lineMu, lineVar);
+  GaussianState gstate2(frame.size(), lineMuWrong, lineVar);
+
+  GaussianMixtureState gstates(2, frame.size());
+
+  gstates.addPMembers(linePMembers);
+  gstates.addGaussianState(frame.size(), lineMu, lineVar);
+  gstates.addGaussianState(frame.size(), lineMuWrong, lineVar);
+
+  ASSERT_EQ(gstates.getStride() % (PARAMS_ALIGNMENT / sizeof(float)), 0);
+  ASSERT_GE(gstates.getStride(), frame.size());
+
+  for (uint32_t i = 0; i < gstates.getComponents(); i++) {
+    GaussianState &gstate = i == 0 ? gstate1 : gstate2;
+    VectorView<float> mu = gstates.getMuByComponent(i);
+
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(mu.data()) % PARAMS_ALIGNMENT, 0);
+    ASSERT_EQ(std::vector<float>(mu), gstate.getMu());
+    ASSERT_EQ(std::vector<float>(gstates.getVarByComponent(i)),
+              gstate.getVar());
+    ASSERT_EQ(std::vector<float>(gstates.getIVarByComponent(i)),
+              gstate.getIVar());
+    ASSERT_EQ(gstates.getLogcByComponent(i), gstate.getLogc());
+  }
+
+  std::vector<float> lprobs(gstates.getComponents());
+  gstates.calc_components_logprob(frame.data(), 0, gstates.getComponents(),
+                                  lprobs.data());
+
+  std::vector<float> pmembers = gstates.getPMembers();
+  ASSERT_EQ(lprobs[0], pmembers[0] + gstate1.calc_logprob(frame));
+  ASSERT_EQ(lprobs[1], pmembers[1] + gstate2.calc_logprob(frame));
+}
+
+TEST_F(MixtureAcousticModelTests, GaussianMixtureStateTestCalcLogProbChunks) {
+  std::mt19937 gen(1234);
+  std::normal_distribution<float> normal(0.0, 1.0);
+
+  // Over two chunks, with the best component in the last one.
+  const uint32_t components = 2 * MIXTURE_CHUNK + 7;
+  GaussianMixtureState gstates(components, frame.size());
+
+  std::vector<GaussianState> single;
+  std::ostringstream pmembers_line;
+  for (uint32_t i = 0; i < components; i++) {
+    std::ostringstream mu_line;
+    for (uint32_t j = 0; j < frame.size(); j++) {
+      float offset = i == components - 1 ? 0.0 : 0.5 * normal(gen);
+      mu_line << frame[j] + offset << " ";
+    }
+    gstates.addGaussianState(frame.size(), mu_line.str(), lineVar);
+    single.emplace_back(frame.size(), mu_line.str(), lineVar);
+    pmembers_line << -log(components) << " ";
+  }
+  gstates.addPMembers(pmembers_line.str());
+
+  std::vector<float> pmembers = gstates.getPMembers();
+  std::vector<float> pprobs;
+  float max = -HUGE_VAL;
+  for (uint32_t i = 0; i < components; i++) {
+    pprobs.push_back(pmembers[i] + single[i].calc_logprob(frame));
+    if (pprobs[i] > max) max = pprobs[i];
+  }
+
+  float r_add = robust_add(pprobs, max, components);
+
+  ASSERT_NEAR(gstates.calc_logprob(frame), r_add, 1e-5 * fabs(r_add));
+  ASSERT_NEAR(gstates.calc_logprob(frame.data(), LogAddMode::FastExp), r_add,
+              1e-5 * fabs(r_add) + FAST_EXP_TOLERANCE);
+}
+
+TEST_F(MixtureAcousticModelTests, SgemmKernelsMatchReference) {
+  // Crosses the blocks in n and k, with padded leading dimensions and rows
+  // that do not fill a tile.
+  const uint32_t m = 7, n = SGEMM_BLOCK_N + 37, k = SGEMM_BLOCK_K + 11;
+  const uint32_t lda = k + 3, ldb = n + 5, ldc = n + 1;
+
+  std::mt19937 gen(1234);
+  std::uniform_real_distribution<float> uniform(-1.0, 1.0);
+
+  std::vector<float> a(m * lda), b(k * ldb);
+  for (auto &value : a) value = uniform(gen);
+  for (auto &value : b) value = uniform(gen);
+
+  const SimdLevel levels[] = {SimdLevel::Scalar, SimdLevel::SSE4,
+                              SimdLevel::AVX2, SimdLevel::AVX512};
+
+  for (auto level : levels) {
+    SgemmKernel kernel = get_sgemm_kernel(level);
+    if (kernel == nullptr) continue;
+
+    std::vector<float> c(m * ldc, NAN);
+    kernel(m, n, k, a.data(), lda, b.data(), ldb, c.data(), ldc);
+
+    for (uint32_t i = 0; i < m; i++) {
+      for (uint32_t j = 0; j < n; j++) {
+        double expected = 0.0;
+        for (uint32_t p = 0; p < k; p++)
+          expected += static_cast<double>(a[i * lda + p]) * b[p * ldb + j];
+        ASSERT_NEAR(c[i * ldc + j], expected, 1e-4)
+            << simd_level_name(level) << " " << i << " " << j;
+      }
+    }
+  }
+}
+
 TEST_F(MixtureAcousticModelTests, MixtureAcousticModelReadWrite) {
   MixtureAcousticModel mixtureacousticmodel(nameModel);
   mixtureacousticmodel.write_model(nameWrittenModel);
@@ -175,6 +295,63 @@ TEST_F(MixtureAcousticModelTests, MixtureAcousticModelReadWrite) {
   ASSERT_TRUE(true);
 }
 
+TEST_F(MixtureAcousticModelTests, MixtureAcousticModelBinaryReadWrite) {
+  MixtureAcousticModel mixtureacousticmodel(nameModel);
+  ASSERT_EQ(mixtureacousticmodel.write_binary_model(nameBinaryModel), 0);
+  ASSERT_TRUE(BinaryModelReader::isBinaryModel(nameBinaryModel));
+  ASSERT_FALSE(BinaryModelReader::isBinaryModel(nameModel));
+
+  MixtureAcousticModel binarymodel(nameBinaryModel);
+  ASSERT_EQ(binarymodel.getDim(), mixtureacousticmodel.getDim());
+  ASSERT_EQ(binarymodel.getNSymbols(), mixtureacousticmodel.getNSymbols());
+  ASSERT_EQ(binarymodel.getNSenones(), mixtureacousticmodel.getNSenones());
+  ASSERT_TRUE(binarymodel.getSenoneStates()[0]->isMapped());
+
+  // The parameters are used in place, with the same scores.
+  for (uint32_t s = 0; s < binarymodel.getNSenones(); s++)
+    ASSERT_EQ(binarymodel.calc_senone_logprob(s, frame.data()),
+              mixtureacousticmodel.calc_senone_logprob(s, frame.data()));
+
+  // Writing it back as text gives the original model.
+  ASSERT_EQ(binarymodel.write_model(nameWrittenModel), 0);
+  fileNameModel.open(nameModel);
+  fileNameWrittenModel.open(nameWrittenModel);
+  std::string lineA, lineB;
+  while (getline(fileNameModel, lineA) && getline(fileNameWrittenModel, lineB))
+    ASSERT_EQ(lineA, lineB);
+  fileNameWrittenModel.close();
+  fileNameModel.close();
+  remove(nameWrittenModel.c_str());
+
+  // Reordering the dimensions of a mapped model does not write to the file.
+  const uint32_t sp = binarymodel.getSymbolId("SP");
+  const float expected = binarymodel.calc_logprob(sp, 0, frame.data());
+  ASSERT_EQ(binarymodel.sortDimensions(), 0);
+  ASSERT_NEAR(binarymodel.calc_logprob(sp, 0, frame.data()), expected,
+              1e-4 * fabs(expected));
+  MixtureAcousticModel reread(nameBinaryModel);
+  ASSERT_EQ(reread.calc_logprob(sp, 0, frame.data()), expected);
+  ASSERT_EQ(reread.getTopology().getState(sp, 0).loop,
+            mixtureacousticmodel.getTopology().getState(sp, 0).loop);
+
+  // And it can be quantized, which drops the views.
+  ASSERT_EQ(reread.quantize(ParamFormat::Int16), 0);
+  ASSERT_FALSE(reread.getSenoneStates()[0]->isMapped());
+  ASSERT_NEAR(reread.calc_logprob(sp, 0, frame.data()), expected,
+              0.01 * fabs(expected));
+
+  // A corrupted header or metadata is rejected.
+  std::fstream file(nameBinaryModel,
+                    std::ios::in | std::ios::out | std::ios::binary);
+  file.seekp(sizeof(BinaryModelHeader) + 4);
+  file.put(0x7f);
+  file.close();
+  MixtureAcousticModel corrupted(nameBinaryModel);
+  ASSERT_EQ(corrupted.getNSymbols(), 0);
+
+  remove(nameBinaryModel.c_str());
+}
+
 TEST_F(MixtureAcousticModelTests, MixtureAcousticModelCalcProbWrongState) {
   MixtureAcousticModel mixtureacousticmodel(nameModel);
 
@@ -205,6 +382,313 @@ TEST_F(MixtureAcousticModelTests, MixtureAcousticModelCalcLogProb) {
   ASSERT_FLOAT_EQ(prob, probTrue);
 }
 
+TEST_F(MixtureAcousticModelTests, MixtureAcousticModelCalcLogProbBlockGemm) {
+  MixtureAcousticModel mixtureacousticmodel(nameModel);
+
+  // The fixture frame and two perturbed copies of it.
+  const uint32_t n_frames = 3;
+  std::vector<float> frames;
+  for (uint32_t f = 0; f < n_frames; f++)
+    for (auto value : frame) frames.push_back(value + 0.25 * f * value);
+
+  const uint32_t n_senones = mixtureacousticmodel.getNSenones();
+  ASSERT_GT(n_senones, 0);
+
+  std::vector<float> direct(n_frames * n_senones);
+  std::vector<float> gemm(n_frames * n_senones);
+
+  mixtureacousticmodel.calc_logprob_block(frames.data(), n_frames, direct.data());
+
+  int senone = mixtureacousticmodel.getSenoneId("a", 0);
+  ASSERT_GE(senone, 0);
+  ASSERT_EQ(direct[senone], mixtureacousticmodel.calc_logprob("a", 0, frame));
+  ASSERT_EQ(mixtureacousticmodel.getSenoneId("a", 56), -1);
+  ASSERT_EQ(mixtureacousticmodel.getSenoneId("aaaaaaaaaa", 0), -1);
+
+  mixtureacousticmodel.setScoringMode(ScoringMode::Gemm);
+  mixtureacousticmodel.calc_logprob_block(frames.data(), n_frames, gemm.data());
+
+  for (uint32_t i = 0; i < n_frames * n_senones; i++)
+    ASSERT_NEAR(gemm[i], direct[i], 1e-4 * fabs(direct[i])) << i;
+}
+
+TEST_F(MixtureAcousticModelTests, MixtureAcousticModelCalcLogProbStateBlock) {
+  MixtureAcousticModel mixtureacousticmodel(nameModel);
+
+  // More frames than a block, so the last block is a partial one.
+  const uint32_t n_frames = MIXTURE_BLOCK_FRAMES + 5;
+  std::mt19937 gen(1234);
+  std::normal_distribution<float> normal(0.0, 0.3);
+
+  std::vector<float> frames;
+  for (uint32_t f = 0; f < n_frames; f++)
+    for (auto value : frame) frames.push_back(value + normal(gen));
+
+  const LogAddMode modes[] = {LogAddMode::Exact, LogAddMode::FastExp};
+
+  for (auto mode : modes) {
+    mixtureacousticmodel.setLogAddMode(mode);
+
+    std::vector<float> out(n_frames);
+    mixtureacousticmodel.calc_logprob_block("a", 1, frames.data(), n_frames,
+                                            out.data());
+
+    for (uint32_t f = 0; f < n_frames; f++) {
+      std::vector<float> single(frames.begin() + f * frame.size(),
+                                frames.begin() + (f + 1) * frame.size());
+      ASSERT_EQ(out[f], mixtureacousticmodel.calc_logprob("a", 1, single));
+    }
+  }
+
+  std::vector<float> out(n_frames);
+  mixtureacousticmodel.calc_logprob_block("aaaaaaaaaa", 0, frames.data(),
+                                          n_frames, out.data());
+  ASSERT_FLOAT_EQ(out[0], INFINITY);
+}
+
+TEST_F(MixtureAcousticModelTests, MixtureAcousticModelMaxComponent) {
+  MixtureAcousticModel mixtureacousticmodel(nameModel);
+  const uint32_t n_senones = mixtureacousticmodel.getNSenones();
+
+  std::mt19937 gen(1234);
+  std::normal_distribution<float> normal(0.0, 0.5);
+
+  const uint32_t n_frames = 50;
+  std::vector<float> frames;
+  for (uint32_t f = 0; f < n_frames; f++)
+    for (auto value : frame) frames.push_back(value + normal(gen));
+
+  std::vector<float> full(n_frames * n_senones), best(n_frames * n_senones);
+  mixtureacousticmodel.calc_logprob_block(frames.data(), n_frames, full.data());
+  mixtureacousticmodel.setLogAddMode(LogAddMode::Max);
+  mixtureacousticmodel.calc_logprob_block(frames.data(), n_frames, best.data());
+
+  std::vector<float> lprobs(MIXTURE_CHUNK);
+  float error = 0.0;
+  uint32_t agree = 0;
+  for (uint32_t f = 0; f < n_frames; f++) {
+    const float *x = &frames[f * frame.size()];
+    uint32_t full_argmax = 0, best_argmax = 0;
+
+    for (uint32_t s = 0; s < n_senones; s++) {
+      const GaussianMixtureState *state =
+          mixtureacousticmodel.getSenoneStates()[s];
+      float max = state->calc_components_logprob(x, 0, state->getComponents(),
+                                                 lprobs.data());
+      const uint32_t i = f * n_senones + s;
+
+      // The best component, found with partial distances, and below the
+      // full mixture.
+      ASSERT_NEAR(best[i], max, DIAG_GAUSSIAN_KERNEL_TOLERANCE * fabs(max));
+      ASSERT_LE(best[i], full[i] + DIAG_GAUSSIAN_KERNEL_TOLERANCE * fabs(max));
+
+      error += full[i] - best[i];
+      if (full[i] > full[f * n_senones + full_argmax]) full_argmax = s;
+      if (best[i] > best[f * n_senones + best_argmax]) best_argmax = s;
+    }
+    if (full_argmax == best_argmax) agree++;
+  }
+
+  std::cout << "Mean difference with full scoring: "
+            << error / (n_frames * n_senones) << ", same best senone in "
+            << agree << " of " << n_frames << " frames" << std::endl;
+  ASSERT_GE(agree, 0.8 * n_frames);
+
+  // Partial distance elimination finds the same components.
+  mixtureacousticmodel.setPartialDistance(true);
+  std::vector<float> single(frame.size());
+  for (uint32_t f = 0; f < n_frames; f++) {
+    single.assign(frames.begin() + f * frame.size(),
+                  frames.begin() + (f + 1) * frame.size());
+    for (uint32_t s = 0; s < n_senones; s += 7) {
+      const uint32_t i = f * n_senones + s;
+      float pde = mixtureacousticmodel.getSenoneStates()[s]->calc_max_logprob(
+          single.data(), true);
+      ASSERT_NEAR(pde, best[i], DIAG_GAUSSIAN_KERNEL_TOLERANCE * fabs(best[i]));
+    }
+  }
+  ASSERT_NEAR(mixtureacousticmodel.calc_logprob("a", 1, single),
+              best[(n_frames - 1) * n_senones +
+                   mixtureacousticmodel.getSenoneId("a", 1)],
+              DIAG_GAUSSIAN_KERNEL_TOLERANCE * 100);
+}
+
+TEST_F(MixtureAcousticModelTests, MixtureAcousticModelQuantized) {
+  MixtureAcousticModel floatmodel(nameModel);
+  const uint32_t n_senones = floatmodel.getNSenones();
+
+  std::mt19937 gen(1234);
+  std::normal_distribution<float> normal(0.0, 0.5);
+
+  const uint32_t n_frames = 50;
+  std::vector<float> frames;
+  for (uint32_t f = 0; f < n_frames; f++)
+    for (auto value : frame) frames.push_back(value + normal(gen));
+
+  std::vector<float> expected(n_frames * n_senones);
+  floatmodel.calc_logprob_block(frames.data(), n_frames, expected.data());
+
+  const ParamFormat formats[] = {ParamFormat::Int16, ParamFormat::Int8,
+                                 ParamFormat::Float16, ParamFormat::BFloat16};
+  const char *names[] = {"Int16", "Int8", "Float16", "BFloat16"};
+  // Mean relative error allowed for each format.
+  const float tolerances[] = {0.001, 0.01, 0.0001, 0.01};
+  // Against means, inverse variances and variances in float.
+  const float compressions[] = {2.5, 5, 2.5, 2.5};
+
+  for (uint32_t k = 0; k < 4; k++) {
+    MixtureAcousticModel mixtureacousticmodel(nameModel, formats[k]);
+    ASSERT_EQ(mixtureacousticmodel.getParamFormat(), formats[k]);
+    ASSERT_LT(compressions[k] * mixtureacousticmodel.getParamBytes(),
+              floatmodel.getParamBytes());
+
+    std::vector<float> out(n_frames * n_senones);
+    mixtureacousticmodel.calc_logprob_block(frames.data(), n_frames,
+                                            out.data());
+
+    double error = 0.0;
+    uint32_t agree = 0;
+    for (uint32_t f = 0; f < n_frames; f++) {
+      uint32_t expected_argmax = 0, argmax = 0;
+      for (uint32_t s = 0; s < n_senones; s++) {
+        const uint32_t i = f * n_senones + s;
+        error += fabs(out[i] - expected[i]) / fabs(expected[i]);
+        if (expected[i] > expected[f * n_senones + expected_argmax])
+          expected_argmax = s;
+        if (out[i] > out[f * n_senones + argmax]) argmax = s;
+      }
+      if (argmax == expected_argmax) agree++;
+    }
+    error /= n_frames * n_senones;
+
+    std::cout << "Mean relative error of the " << names[k] << " model: " << error << ", same best senone in " << agree
+              << " of " << n_frames << " frames" << std::endl;
+    ASSERT_LT(error, tolerances[k]);
+    ASSERT_GE(agree, 0.9 * n_frames);
+
+    // Per state, and with the best component only, as the block.
+    ASSERT_EQ(mixtureacousticmodel.calc_logprob("a", 1, frame),
+              mixtureacousticmodel.getSenoneStates()[mixtureacousticmodel
+                  .getSenoneId("a", 1)]->calc_logprob(frame.data()));
+    mixtureacousticmodel.setLogAddMode(LogAddMode::Max);
+    mixtureacousticmodel.setPartialDistance(true);
+    float best = mixtureacousticmodel.calc_logprob("a", 1, frame);
+    ASSERT_LE(best, mixtureacousticmodel.getSenoneStates()[mixtureacousticmodel
+                        .getSenoneId("a", 1)]->calc_logprob(frame.data()));
+
+    // The float parameters are gone.
+    ASSERT_EQ(mixtureacousticmodel.quantize(ParamFormat::Int16), 1);
+    ASSERT_EQ(mixtureacousticmodel.write_model(nameWrittenModel), 1);
+    mixtureacousticmodel.setScoringMode(ScoringMode::Gemm);
+    ASSERT_EQ(mixtureacousticmodel.getScoringMode(), ScoringMode::Direct);
+  }
+}
+
+TEST_F(MixtureAcousticModelTests, GaussianSelectionReadWrite) {
+  MixtureAcousticModel mixtureacousticmodel(nameModel);
+
+  GaussianSelection gselection;
+  ASSERT_EQ(gselection.build(mixtureacousticmodel.getSenoneStates(), 16), 0);
+  ASSERT_EQ(gselection.getNCodewords(), 16);
+  ASSERT_EQ(gselection.getNSenones(), mixtureacousticmodel.getNSenones());
+  ASSERT_TRUE(gselection.matches(mixtureacousticmodel.getSenoneStates()));
+  ASSERT_EQ(gselection.write_selection(nameSelection), 0);
+
+  GaussianSelection read;
+  ASSERT_EQ(read.read_selection(nameSelection), 0);
+  ASSERT_TRUE(read.matches(mixtureacousticmodel.getSenoneStates()));
+  ASSERT_EQ(read.write_selection(nameWrittenSelection), 0);
+
+  for (uint32_t k = 0; k < read.getNCodewords(); k++) {
+    for (uint32_t s = 0; s < read.getNSenones(); s++) {
+      VectorView<uint32_t> a = gselection.getShortlist(k, s);
+      VectorView<uint32_t> b = read.getShortlist(k, s);
+      ASSERT_EQ(std::vector<uint32_t>(a), std::vector<uint32_t>(b));
+    }
+  }
+
+  fileNameModel.open(nameSelection);
+  fileNameWrittenModel.open(nameWrittenSelection);
+
+  std::string lineA;
+  std::string lineB;
+  while (getline(fileNameModel, lineA) &&
+         getline(fileNameWrittenModel, lineB)) {
+    ASSERT_EQ(lineA, lineB);
+  }
+
+  fileNameWrittenModel.close();
+  fileNameModel.close();
+  remove(nameWrittenSelection.c_str());
+  remove(nameSelection.c_str());
+}
+
+TEST_F(MixtureAcousticModelTests, MixtureAcousticModelGaussianSelection) {
+  MixtureAcousticModel mixtureacousticmodel(nameModel);
+  const float full = mixtureacousticmodel.calc_logprob("a", 1, frame);
+
+  // Every component in the shortlists: same values as without selection.
+  GaussianSelection &gselection = mixtureacousticmodel.getGaussianSelection();
+  ASSERT_EQ(gselection.build(mixtureacousticmodel.getSenoneStates(), 16,
+                             HUGE_VAL),
+            0);
+  ASSERT_EQ(mixtureacousticmodel.calc_logprob("a", 1, frame), full);
+
+  GaussianSelection selection;
+  selection.build(mixtureacousticmodel.getSenoneStates(), 64);
+  selection.write_selection(nameSelection);
+
+  ASSERT_EQ(mixtureacousticmodel.read_gaussian_selection(nameSelection), 0);
+  remove(nameSelection.c_str());
+
+  uint32_t shortlisted = 0, components = 0;
+  for (uint32_t k = 0; k < selection.getNCodewords(); k++) {
+    for (uint32_t s = 0; s < selection.getNSenones(); s++) {
+      shortlisted += selection.getShortlist(k, s).size();
+      components += mixtureacousticmodel.getSenoneStates()[s]->getComponents();
+    }
+  }
+  std::cout << "Shortlisted " << shortlisted << " of " << components
+            << " components" << std::endl;
+  ASSERT_LT(shortlisted, components);
+
+  float selected = mixtureacousticmodel.calc_logprob("a", 1, frame);
+  std::cout << "Full: " << full << ", selected: " << selected << std::endl;
+  ASSERT_NEAR(selected, full, 0.01 * fabs(full));
+
+  // Block and per-frame scoring agree with the selection too.
+  float out;
+  mixtureacousticmodel.calc_logprob_block("a", 1, frame.data(), 1, &out);
+  ASSERT_EQ(out, selected);
+
+  // Each frame of a prepared block is scored with its own codeword.
+  std::vector<float> frames(frame);
+  for (auto value : frame) frames.push_back(-value);
+  PreparedFrames prepared;
+  mixtureacousticmodel.prepare_frames(frames.data(), 2, &prepared);
+  ASSERT_EQ(prepared.codewords.size(), 2);
+  const int senone = mixtureacousticmodel.getSenoneId("a", 1);
+  for (uint32_t f = 0; f < 2; f++) {
+    ASSERT_EQ(prepared.codewords[f],
+              selection.nearest_codeword(&frames[f * frame.size()]));
+    ASSERT_EQ(mixtureacousticmodel.calc_prepared_logprob(senone, prepared, f),
+              mixtureacousticmodel.calc_senone_logprob(
+                  senone, &frames[f * frame.size()]));
+  }
+
+  // Built for another model.
+  GaussianSelection other;
+  std::vector<const GaussianMixtureState *> senones(
+      mixtureacousticmodel.getSenoneStates().begin(),
+      mixtureacousticmodel.getSenoneStates().begin() + 3);
+  other.build(senones, 4);
+  other.write_selection(nameSelection);
+  ASSERT_EQ(mixtureacousticmodel.read_gaussian_selection(nameSelection), 1);
+  remove(nameSelection.c_str());
+  ASSERT_FALSE(mixtureacousticmodel.getGaussianSelection().isLoaded());
+  ASSERT_EQ(mixtureacousticmodel.calc_logprob("a", 1, frame), full);
+}
+
 TEST_F(MixtureAcousticModelTests, MixtureAcousticGetStateType) {
   MixtureAcousticModel mixtureacousticmodel(nameModel);
 
@@ -227,7 +711,125 @@ TEST_F(MixtureAcousticModelTests, MixtureAcousticGetTrans) {
   }
 }
 
+TEST_F(MixtureAcousticModelTests, MixtureAcousticSymbolIds) {
+  MixtureAcousticModel mixtureacousticmodel(nameModel);
+
+  ASSERT_EQ(mixtureacousticmodel.getNSymbols(),
+            mixtureacousticmodel.getNStates());
+
+  int symbol = mixtureacousticmodel.getSymbolId("a");
+  ASSERT_GE(symbol, 0);
+  ASSERT_EQ(mixtureacousticmodel.getSymbolId("aaaaaaaaaa"), -1);
+
+  for (int q = 0; q < 3; q++) {
+    ASSERT_EQ(mixtureacousticmodel.getSenoneId(symbol, q),
+              mixtureacousticmodel.getSenoneId("a", q));
+    ASSERT_EQ(mixtureacousticmodel.calc_logprob(symbol, q, frame.data()),
+              mixtureacousticmodel.calc_logprob("a", q, frame));
+  }
+  ASSERT_FLOAT_EQ(mixtureacousticmodel.calc_logprob(symbol, 56, frame.data()),
+                  INFINITY);
+
+  ASSERT_EQ(mixtureacousticmodel.getStateTransType(symbol), "Trans");
+  ASSERT_EQ(mixtureacousticmodel.getStateTrans(symbol),
+            mixtureacousticmodel.getStateTrans("a"));
+  ASSERT_EQ(mixtureacousticmodel.getStateTransType(
+                mixtureacousticmodel.getSymbolId("SP")),
+            "TransL");
+}
+
 }  // namespace
+TEST_F(MixtureAcousticModelTests, MixtureAcousticModelPartialDistanceFloor) {
+  MixtureAcousticModel mixtureacousticmodel(nameModel);
+  const uint32_t n_senones = mixtureacousticmodel.getNSenones();
+
+  std::vector<float> full(n_senones);
+  mixtureacousticmodel.calc_logprob_block(frame.data(), 1, full.data());
+
+  mixtureacousticmodel.setLogAddMode(LogAddMode::Max);
+  mixtureacousticmodel.setPartialDistance(true);
+  std::vector<float> best(n_senones);
+  for (uint32_t s = 0; s < n_senones; s++)
+    best[s] = mixtureacousticmodel.calc_senone_logprob(s, frame.data());
+
+  // Scored under the floor, dropped over it.
+  for (uint32_t s = 0; s < n_senones; s++) {
+    ASSERT_EQ(mixtureacousticmodel.calc_senone_logprob(s, frame.data(),
+                                                       best[s] - 1.0),
+              best[s]);
+    ASSERT_EQ(mixtureacousticmodel.calc_senone_logprob(s, frame.data(),
+                                                       best[s] + 1.0),
+              -HUGE_VAL);
+  }
+
+  // The dimensions that add the most to the distance first, the scores only
+  // change by rounding.
+  ASSERT_EQ(mixtureacousticmodel.sortDimensions(), 0);
+  ASSERT_TRUE(mixtureacousticmodel.hasDimensionOrder());
+  const std::vector<uint32_t> &order =
+      mixtureacousticmodel.getDimensionOrder().getOrder();
+  ASSERT_EQ(std::set<uint32_t>(order.begin(), order.end()).size(),
+            frame.size());
+
+  for (uint32_t s = 0; s < n_senones; s++) {
+    ASSERT_NEAR(mixtureacousticmodel.calc_senone_logprob(s, frame.data()),
+                best[s], DIAG_GAUSSIAN_KERNEL_TOLERANCE * fabs(best[s]));
+    ASSERT_EQ(mixtureacousticmodel.calc_senone_logprob(s, frame.data(),
+                                                       best[s] + 1.0),
+              -HUGE_VAL);
+  }
+
+  // A prepared frame is reordered once and scored by index.
+  PreparedFrames prepared;
+  mixtureacousticmodel.prepare_frames(frame.data(), 1, &prepared);
+  for (uint32_t i = 0; i < order.size(); i++)
+    ASSERT_EQ(prepared.getFrame(0)[i], frame[order[i]]);
+  for (uint32_t s = 0; s < n_senones; s++)
+    ASSERT_EQ(mixtureacousticmodel.calc_prepared_logprob(s, prepared, 0),
+              mixtureacousticmodel.calc_senone_logprob(s, frame.data()));
+
+  std::vector<float> out(n_senones);
+  mixtureacousticmodel.setLogAddMode(LogAddMode::Exact);
+  mixtureacousticmodel.calc_logprob_block(frame.data(), 1, out.data());
+  for (uint32_t s = 0; s < n_senones; s++)
+    ASSERT_NEAR(out[s], full[s], DIAG_GAUSSIAN_KERNEL_TOLERANCE * fabs(full[s]));
+
+  ASSERT_EQ(mixtureacousticmodel.write_model(nameWrittenModel), 1);
+
+  mixtureacousticmodel.clearDimensionOrder();
+  ASSERT_FALSE(mixtureacousticmodel.hasDimensionOrder());
+  mixtureacousticmodel.calc_logprob_block(frame.data(), 1, out.data());
+  ASSERT_EQ(out, full);
+}
+
+TEST_F(MixtureAcousticModelTests, MixtureAcousticTopology) {
+  MixtureAcousticModel mixtureacousticmodel(nameModel);
+  const HMMTopology &topology = mixtureacousticmodel.getTopology();
+  ASSERT_EQ(topology.getNSymbols(), mixtureacousticmodel.getNSymbols());
+
+  const uint32_t symbol = mixtureacousticmodel.getSymbolId("a");
+  const std::vector<float> &trans = mixtureacousticmodel.getStateTrans(symbol);
+  ASSERT_EQ(topology.getNStates(symbol), trans.size());
+  for (uint32_t q = 0; q < trans.size(); q++) {
+    const HMMTopologyState &state = topology.getState(symbol, q);
+    ASSERT_EQ(state.senone, mixtureacousticmodel.getSenoneId(symbol, q));
+    ASSERT_EQ(state.forward, trans[q]);
+    ASSERT_FLOAT_EQ(state.loop, log(1 - exp(trans[q])));
+  }
+
+  // TransL, the transition from I to F is dropped.
+  const uint32_t sp = mixtureacousticmodel.getSymbolId("SP");
+  ASSERT_EQ(topology.getNStates(sp), 1);
+  ASSERT_EQ(topology.getNEntries(sp), 1);
+  ASSERT_EQ(topology.getEntry(sp, 0).dst, 0);
+  ASSERT_FLOAT_EQ(topology.getEntry(sp, 0).lprob, -0.510832);
+  const HMMTopologyState &state = topology.getState(sp, 0);
+  ASSERT_EQ(state.senone, mixtureacousticmodel.getSenoneId(sp, 0));
+  ASSERT_FLOAT_EQ(state.loop, -0.510832);
+  ASSERT_FLOAT_EQ(state.forward, -0.916284);
+  ASSERT_EQ(state.n_arcs, 0);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -7,19 +7,103 @@
 #include <Utils.h>
 #include <stdio.h>
 
+#include <algorithm>
+#include <cmath>
 #include <iomanip>  // std::setprecision
+#include <random>
 
 #include "gtest/gtest.h"
 
 namespace {
 
+// "I", "PMembers", "Members" and the "MU" and "VAR" lines of a mixture of
+// equally weighted Gaussians with random means and variances.
+void write_mixture(std::ofstream *fileO, const uint32_t dim,
+                   const uint32_t components, std::mt19937 *generator) {
+  std::normal_distribution<float> mean(0.0, 1.0);
+  std::uniform_real_distribution<float> variance(0.5, 1.5);
+
+  *fileO << "I " << components << "\nPMembers";
+  for (uint32_t c = 0; c < components; c++)
+    *fileO << " " << std::log(1.0 / components);
+  *fileO << "\nMembers\n";
+  for (uint32_t c = 0; c < components; c++) {
+    *fileO << "MU";
+    for (uint32_t d = 0; d < dim; d++) *fileO << " " << mean(*generator);
+    *fileO << "\nVAR";
+    for (uint32_t d = 0; d < dim; d++) *fileO << " " << variance(*generator);
+    *fileO << "\n";
+  }
+}
+
+// Tied-state model, as write_model writes it, with three senones for each
+// of 'a', 'e' and 'i', 'e+a' with the senones and the transitions ("TransP")
+// of 'e', and 'i-i' with those of 'i'. Sixteen Gaussians per senone keep the
+// per-state quantization scales small against the parameters.
+void write_tied_model(const std::string &filename, const uint32_t dim) {
+  const std::vector<std::string> phones = {"a", "e", "i"};
+  std::mt19937 generator(1);
+
+  std::ofstream fileO(filename);
+  fileO << "AMODEL\nTiedStates\nMixture\nDGaussian\nD " << dim << "\nSMOOTH";
+  for (uint32_t d = 0; d < dim; d++) fileO << " 0.001";
+  fileO << "\nN " << 3 * phones.size() << "\nStates\n";
+  for (auto &phone : phones) {
+    for (int q = 0; q < 3; q++) {
+      fileO << phone << "_" << q << "\n";
+      write_mixture(&fileO, dim, 16, &generator);
+    }
+  }
+
+  fileO << "N " << phones.size() + 2 << "\n";
+  for (auto &phone : phones) {
+    fileO << "'" << phone << "'\nQ 3\nTrans\n-0.5 -0.7 -0.9\n" << phone
+          << "_0 " << phone << "_1 " << phone << "_2\n";
+  }
+  fileO << "'e+a'\nQ 3\nTransP e\ne_0 e_1 e_2\n";
+  fileO << "'i-i'\nQ 3\nTransP i\ni_0 i_1 i_2\n";
+}
+
+// Context-independent mixture model with two Gaussians for each state of
+// 'a', 'e' and 'i', the fast match model of the one above.
+void write_ci_model(const std::string &filename, const uint32_t dim) {
+  const std::vector<std::string> phones = {"a", "e", "i"};
+  std::mt19937 generator(2);
+
+  std::ofstream fileO(filename);
+  fileO << "AMODEL\nMixture\nDGaussian\nD " << dim << "\nSMOOTH";
+  for (uint32_t d = 0; d < dim; d++) fileO << " 0.001";
+  fileO << "\nN " << phones.size() << "\n";
+  for (auto &phone : phones) {
+    fileO << "'" << phone << "'\nQ 3\nTrans\n-0.5 -0.7 -0.9\n";
+    for (int q = 0; q < 3; q++) write_mixture(&fileO, dim, 2, &generator);
+  }
+}
+
 class TiedStatesAcousticModelTests : public ::testing::Test {
  protected:
+  void SetUp() override {
+    write_tied_model(nameTiedModel, frame.size());
+    write_ci_model(nameCIModel, frame.size());
+  }
+
+  void TearDown() override {
+    remove(nameTiedModel.c_str());
+    remove(nameCIModel.c_str());
+  }
+
   const std::string nameModel = "./models/tiedphoneme_I04.example.model";
 
+  // Written by the fixture.
+  const std::string nameTiedModel = "./models/tied.model.test";
+  const std::string nameCIModel = "./models/ci.model.test";
+
   const std::string nameWrittenModel =
       "./models/tiedphoneme_I04.example.model.test";
 
+  const std::string nameBinaryModel =
+      "./models/tiedphoneme_I04.example.model.bin.test";
+
   std::ifstream fileNameModel;
   std::ifstream fileNameWrittenModel;
 
@@ -124,6 +208,108 @@ TEST_F(TiedStatesAcousticModelTests, TiedStatesAcousticModelTestsCalcLogProb)
   ASSERT_FLOAT_EQ(prob, probTrue);
 }
 
+TEST_F(TiedStatesAcousticModelTests, TiedStatesAcousticModelSharedSenones) {
+  TiedStatesAcousticModel tiedstatesacousticmodel(nameTiedModel);
+
+  // e+a is tied to the senones of e.
+  for (int q = 0; q < 3; q++) {
+    int senone = tiedstatesacousticmodel.getSenoneId("e+a", q);
+    ASSERT_GE(senone, 0);
+    ASSERT_EQ(senone, tiedstatesacousticmodel.getSenoneId("e", q));
+    ASSERT_EQ(tiedstatesacousticmodel.calc_senone_logprob(senone, frame.data()),
+              tiedstatesacousticmodel.calc_logprob("e+a", q, frame));
+  }
+
+  ASSERT_NE(tiedstatesacousticmodel.getSenoneId("e", 0),
+            tiedstatesacousticmodel.getSenoneId("e", 1));
+  ASSERT_EQ(tiedstatesacousticmodel.getSenoneId("e+a", 56), -1);
+  ASSERT_EQ(tiedstatesacousticmodel.getSenoneId("aaaaaaaaaa", 0), -1);
+}
+
+TEST_F(TiedStatesAcousticModelTests, TiedStatesAcousticModelCalcLogProbBlockGemm) {
+  TiedStatesAcousticModel tiedstatesacousticmodel(nameTiedModel);
+
+  // The fixture frame and two perturbed copies of it.
+  const uint32_t n_frames = 3;
+  std::vector<float> frames;
+  for (uint32_t f = 0; f < n_frames; f++)
+    for (auto value : frame) frames.push_back(value + 0.25 * f * value);
+
+  const uint32_t n_senones = tiedstatesacousticmodel.getNSenones();
+  ASSERT_GT(n_senones, 0);
+
+  std::vector<float> direct(n_frames * n_senones);
+  std::vector<float> gemm(n_frames * n_senones);
+
+  tiedstatesacousticmodel.calc_logprob_block(frames.data(), n_frames, direct.data());
+
+  int senone = tiedstatesacousticmodel.getSenoneId("e+a", 0);
+  ASSERT_GE(senone, 0);
+  ASSERT_EQ(direct[senone], tiedstatesacousticmodel.calc_logprob("e+a", 0, frame));
+  ASSERT_EQ(tiedstatesacousticmodel.getSenoneId("e+a", 56), -1);
+  ASSERT_EQ(tiedstatesacousticmodel.getSenoneId("aaaaaaaaaa", 0), -1);
+
+  tiedstatesacousticmodel.setScoringMode(ScoringMode::Gemm);
+  tiedstatesacousticmodel.calc_logprob_block(frames.data(), n_frames, gemm.data());
+
+  for (uint32_t i = 0; i < n_frames * n_senones; i++)
+    ASSERT_NEAR(gemm[i], direct[i], 1e-4 * fabs(direct[i])) << i;
+}
+
+TEST_F(TiedStatesAcousticModelTests, TiedStatesAcousticModelGaussianSelection) {
+  TiedStatesAcousticModel tiedstatesacousticmodel(nameTiedModel);
+  const float full = tiedstatesacousticmodel.calc_logprob("e+a", 0, frame);
+
+  // Every component in the shortlists: same values as without selection.
+  GaussianSelection &gselection =
+      tiedstatesacousticmodel.getGaussianSelection();
+  ASSERT_EQ(gselection.build(tiedstatesacousticmodel.getSenoneStates(), 16,
+                             HUGE_VAL),
+            0);
+  ASSERT_EQ(tiedstatesacousticmodel.calc_logprob("e+a", 0, frame), full);
+
+  gselection.build(tiedstatesacousticmodel.getSenoneStates());
+  float selected = tiedstatesacousticmodel.calc_logprob("e+a", 0, frame);
+  ASSERT_NEAR(selected, full, 0.01 * fabs(full));
+
+  tiedstatesacousticmodel.clearGaussianSelection();
+  ASSERT_EQ(tiedstatesacousticmodel.calc_logprob("e+a", 0, frame), full);
+}
+
+TEST_F(TiedStatesAcousticModelTests, TiedStatesAcousticModelQuantized) {
+  TiedStatesAcousticModel floatmodel(nameTiedModel);
+  const uint32_t n_senones = floatmodel.getNSenones();
+
+  std::vector<float> expected(n_senones), out(n_senones);
+  floatmodel.calc_logprob_block(frame.data(), 1, expected.data());
+
+  const ParamFormat formats[] = {ParamFormat::Int16, ParamFormat::Int8,
+                                 ParamFormat::Float16, ParamFormat::BFloat16};
+  const float tolerances[] = {0.002, 0.02, 0.0001, 0.01};
+  // Against means, inverse variances and variances in float.
+  const float compressions[] = {2.5, 5, 2.5, 2.5};
+
+  for (uint32_t k = 0; k < 4; k++) {
+    TiedStatesAcousticModel tiedstatesacousticmodel(nameTiedModel, formats[k]);
+    ASSERT_LT(compressions[k] * tiedstatesacousticmodel.getParamBytes(),
+              floatmodel.getParamBytes());
+
+    tiedstatesacousticmodel.calc_logprob_block(frame.data(), 1, out.data());
+
+    double error = 0.0;
+    for (uint32_t s = 0; s < n_senones; s++)
+      error += fabs(out[s] - expected[s]) / fabs(expected[s]);
+    error /= n_senones;
+    std::cout << "Mean relative error: " << error << std::endl;
+    ASSERT_LT(error, tolerances[k]);
+
+    int senone = tiedstatesacousticmodel.getSenoneId("e+a", 0);
+    ASSERT_EQ(tiedstatesacousticmodel.calc_logprob("e+a", 0, frame),
+              out[senone]);
+    ASSERT_EQ(tiedstatesacousticmodel.write_model(nameWrittenModel), 1);
+  }
+}
+
 TEST_F(TiedStatesAcousticModelTests, TiedStatesGetStateType) {
   TiedStatesAcousticModel tiedstatesacousticmodel(nameModel);
 
@@ -157,7 +343,167 @@ TEST_F(TiedStatesAcousticModelTests, TiedStatesGetTrans) {
   }
 }
 
+TEST_F(TiedStatesAcousticModelTests, TiedStatesSymbolIds) {
+  TiedStatesAcousticModel tiedstatesacousticmodel(nameTiedModel);
+
+  int symbol = tiedstatesacousticmodel.getSymbolId("i-i");
+  ASSERT_GE(symbol, 0);
+  ASSERT_LT(symbol, tiedstatesacousticmodel.getNSymbols());
+  ASSERT_EQ(tiedstatesacousticmodel.getSymbolId("aaaaaaaaaa"), -1);
+
+  for (int q = 0; q < 3; q++) {
+    ASSERT_EQ(tiedstatesacousticmodel.getSenoneId(symbol, q),
+              tiedstatesacousticmodel.getSenoneId("i", q));
+    ASSERT_EQ(tiedstatesacousticmodel.calc_logprob(symbol, q, frame.data()),
+              tiedstatesacousticmodel.calc_logprob("i-i", q, frame));
+  }
+  ASSERT_EQ(tiedstatesacousticmodel.getSenoneId(symbol, 56), -1);
+
+  ASSERT_EQ(tiedstatesacousticmodel.getStateTransType(symbol), "TransP");
+  ASSERT_EQ(tiedstatesacousticmodel.getStateTrans(symbol),
+            tiedstatesacousticmodel.getStateTrans("i"));
+}
+
 }  // namespace
+TEST_F(TiedStatesAcousticModelTests, TiedStatesBinaryReadWrite) {
+  TiedStatesAcousticModel tiedstatesacousticmodel(nameTiedModel);
+  ASSERT_EQ(tiedstatesacousticmodel.write_binary_model(nameBinaryModel), 0);
+
+  TiedStatesAcousticModel binarymodel(nameBinaryModel);
+  ASSERT_EQ(binarymodel.getNSymbols(), tiedstatesacousticmodel.getNSymbols());
+  ASSERT_EQ(binarymodel.getNSenones(), tiedstatesacousticmodel.getNSenones());
+  ASSERT_EQ(binarymodel.getStateTransType("e+a"), "TransP");
+
+  for (uint32_t s = 0; s < binarymodel.getNSenones(); s++)
+    ASSERT_EQ(binarymodel.calc_senone_logprob(s, frame.data()),
+              tiedstatesacousticmodel.calc_senone_logprob(s, frame.data()));
+
+  // Writing it back as text gives the original model.
+  ASSERT_EQ(binarymodel.write_model(nameWrittenModel), 0);
+  fileNameModel.open(nameTiedModel);
+  fileNameWrittenModel.open(nameWrittenModel);
+  std::string lineA, lineB;
+  while (getline(fileNameModel, lineA) && getline(fileNameWrittenModel, lineB))
+    ASSERT_EQ(lineA, lineB);
+  fileNameWrittenModel.close();
+  fileNameModel.close();
+  remove(nameWrittenModel.c_str());
+
+  // A mixture model is not read as a tied states one.
+  MixtureAcousticModel mixturemodel(
+      "./models/mixture_monophoneme_I32.example.model");
+  ASSERT_EQ(mixturemodel.write_binary_model(nameBinaryModel), 0);
+  TiedStatesAcousticModel wrong(nameBinaryModel);
+  ASSERT_EQ(wrong.getNSymbols(), 0);
+
+  remove(nameBinaryModel.c_str());
+}
+
+TEST_F(TiedStatesAcousticModelTests, TiedStatesCentralPhone) {
+  ASSERT_EQ(TiedStatesAcousticModel::getCentralPhone("ng_I-ng_E+ch_S"),
+            "ng_E");
+  ASSERT_EQ(TiedStatesAcousticModel::getCentralPhone("jh_S-jh_S"), "jh_S");
+  ASSERT_EQ(TiedStatesAcousticModel::getCentralPhone("aa_B+l_E"), "aa_B");
+  ASSERT_EQ(TiedStatesAcousticModel::getCentralPhone("a"), "a");
+}
+
+TEST_F(TiedStatesAcousticModelTests, TiedStatesTopologyTransP) {
+  TiedStatesAcousticModel tiedstatesacousticmodel(nameTiedModel);
+  const HMMTopology &topology = tiedstatesacousticmodel.getTopology();
+
+  // 'e+a' borrows the transitions of 'e'.
+  const uint32_t e = tiedstatesacousticmodel.getSymbolId("e");
+  const uint32_t ea = tiedstatesacousticmodel.getSymbolId("e+a");
+  ASSERT_EQ(topology.getNStates(ea), 3);
+  ASSERT_EQ(topology.getNStates(ea), topology.getNStates(e));
+  ASSERT_EQ(topology.getNEntries(ea), 1);
+  for (uint32_t q = 0; q < topology.getNStates(ea); q++) {
+    const HMMTopologyState &state = topology.getState(ea, q);
+    ASSERT_EQ(state.senone, topology.getState(e, q).senone);
+    ASSERT_EQ(state.forward, topology.getState(e, q).forward);
+    ASSERT_EQ(state.loop, topology.getState(e, q).loop);
+    ASSERT_EQ(state.n_arcs, 0);
+  }
+}
+
+TEST_F(TiedStatesAcousticModelTests, TiedStatesFastMatch) {
+  TiedStatesAcousticModel tiedstatesacousticmodel(nameTiedModel);
+
+  std::vector<float> expected(tiedstatesacousticmodel.getNSenones());
+  for (uint32_t s = 0; s < expected.size(); s++)
+    expected[s] =
+        tiedstatesacousticmodel.calc_senone_logprob(s, frame.data());
+
+  ASSERT_EQ(tiedstatesacousticmodel.read_fast_match("./models/none.model"),
+            1);
+  ASSERT_FALSE(tiedstatesacousticmodel.hasFastMatch());
+
+  ASSERT_EQ(tiedstatesacousticmodel.read_fast_match(nameCIModel, HUGE_VAL),
+            0);
+  ASSERT_TRUE(tiedstatesacousticmodel.hasFastMatch());
+  ASSERT_GE(tiedstatesacousticmodel.getFastMatchParent(
+                tiedstatesacousticmodel.getSenoneId("e", 0)),
+            0);
+
+  // Nothing is pruned with an infinite beam.
+  for (uint32_t s = 0; s < expected.size(); s++)
+    ASSERT_EQ(tiedstatesacousticmodel.calc_senone_logprob(s, frame.data()),
+              expected[s]);
+
+  // With no beam, only senones whose parent is the best one are scored.
+  MixtureAcousticModel fastmatch(nameCIModel);
+  std::vector<float> parents(fastmatch.getNSenones());
+  fastmatch.calc_logprob_block(frame.data(), 1, parents.data());
+  const float best = *std::max_element(parents.begin(), parents.end());
+
+  tiedstatesacousticmodel.setFastMatchBeam(0.0);
+  std::vector<float> out(expected.size());
+  tiedstatesacousticmodel.calc_logprob_block(frame.data(), 1, out.data());
+
+  uint32_t pruned = 0;
+  for (uint32_t s = 0; s < expected.size(); s++) {
+    int parent = tiedstatesacousticmodel.getFastMatchParent(s);
+    if (parent >= 0 && parents[parent] < best) {
+      ASSERT_FLOAT_EQ(out[s], parents[parent] + FM_DEFAULT_PENALTY);
+      pruned++;
+    } else {
+      ASSERT_EQ(out[s], expected[s]);
+    }
+  }
+  ASSERT_GT(pruned, 0);
+
+  // The fast match scores of a prepared block are read by frame index.
+  std::vector<float> frames(frame);
+  for (auto value : frame) frames.push_back(-value);
+  PreparedFrames prepared;
+  tiedstatesacousticmodel.prepare_frames(frames.data(), 2, &prepared);
+  ASSERT_EQ(prepared.fm_best.size(), 2);
+  ASSERT_EQ(prepared.n_fm_scores, fastmatch.getNSenones());
+  for (uint32_t f = 0; f < 2; f++)
+    for (uint32_t s = 0; s < expected.size(); s++)
+      ASSERT_EQ(tiedstatesacousticmodel.calc_prepared_logprob(s, prepared, f),
+                tiedstatesacousticmodel.calc_senone_logprob(
+                    s, &frames[f * frame.size()]));
+
+  // The parent scores of the previous log-add mode are not reused.
+  tiedstatesacousticmodel.setLogAddMode(LogAddMode::Max);
+  fastmatch.setLogAddMode(LogAddMode::Max);
+  fastmatch.calc_logprob_block(frame.data(), 1, parents.data());
+  const float best_max = *std::max_element(parents.begin(), parents.end());
+  tiedstatesacousticmodel.calc_logprob_block(frame.data(), 1, out.data());
+  for (uint32_t s = 0; s < expected.size(); s++) {
+    int parent = tiedstatesacousticmodel.getFastMatchParent(s);
+    if (parent >= 0 && parents[parent] < best_max)
+      ASSERT_FLOAT_EQ(out[s], parents[parent] + FM_DEFAULT_PENALTY);
+  }
+  tiedstatesacousticmodel.setLogAddMode(LogAddMode::Exact);
+
+  tiedstatesacousticmodel.clearFastMatch();
+  ASSERT_EQ(tiedstatesacousticmodel.getFastMatchParent(0), -1);
+  ASSERT_EQ(tiedstatesacousticmodel.calc_senone_logprob(0, frame.data()),
+            expected[0]);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
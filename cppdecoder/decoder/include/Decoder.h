@@ -10,7 +10,9 @@
 #include <HMM.h>
 #include <Sample.h>
 #include <SearchGraphLanguageModel.h>
+#include <ThreadPool.h>
 
+#include <algorithm>
 #include <cassert>
 #include <memory>
 #include <string>
@@ -149,6 +151,45 @@ class WordHyp {
   std::string word;
 };
 
+/**
+ * Maximum number of frames the decoder scores in one batch (see
+ * Decoder::setLookahead).
+ */
+const uint32_t DECODER_MAX_LOOKAHEAD = 16;
+
+/**
+ * Senones scored by each task of the scoring threads (see
+ * Decoder::setScoringThreads).
+ */
+const uint32_t DECODER_SCORING_CHUNK = 16;
+
+/**
+ * @brief How the decoder scores the senones of each frame (see
+ * Decoder::setScoringPolicy).
+ */
+enum class ScoringPolicy { Lazy, Eager, Auto };
+
+/**
+ * Default fraction of the senones of the model, active in the previous frame,
+ * from which ScoringPolicy::Auto scores every senone of the frame at once.
+ */
+const float DECODER_EAGER_THRESHOLD = 0.8;
+
+/**
+ * @brief How the frames decoded since the last Decoder::resetDecoder were
+ * scored.
+ */
+struct ScoringStats {
+  // Frames that only scored the senones the search asked for.
+  uint32_t lazy_frames;
+  // Frames that scored every senone of the model at once.
+  uint32_t eager_frames;
+  // Senones the search asked for, summed over the frames.
+  uint64_t active_senones;
+  // Fraction of the senones of the model active in the last frame.
+  float active_ratio;
+};
+
 class Decoder {
  public:
   /**
@@ -589,10 +630,17 @@ class Decoder {
   void viterbiIter(const Sample& sample, const int t, const bool finalIter);
 
   /**
-   * @brief Resets the acoustic model log probs cache.
+   * @brief Resets the acoustic model log probs cache. Only the generation of
+   * the cache changes, the scores are not freed.
    *
    */
-  void resetAMCache() { lprob_cache.clear(); }
+  void resetAMCache() {
+    if (nextGeneration(lprob_stamps, lprob_generation)) {
+      std::fill(active_stamps.begin(), active_stamps.end(), 0);
+      std::fill(bound_stamps.begin(), bound_stamps.end(), 0);
+      prepared_generation = 0;
+    }
+  }
 
   /**
    * @brief Sets the Language Model beam
@@ -615,6 +663,9 @@ class Decoder {
   void setFinalIter(bool final_iter) { this->final_iter = final_iter; }
 
   /**
+   * Scores are cached by senone for the current frame, so the symbols and HMM
+   * states tied to the same senone are scored once.
+   *
    * @brief Computes the emission log prob or score with a given frame
    * (n-dimensional vector), a symbol or senone and the state index of the HMM
    * model (q)
@@ -626,6 +677,181 @@ class Decoder {
    */
   float compute_lprob(const Frame& frame, const std::string& sym, const int q);
 
+  /**
+   * @brief compute_lprob for the symbol with a dense index in the acoustic
+   * model (see AcousticModel::getSymbolId).
+   *
+   * @param frame Frame to be used to compute the log prob score
+   * @param symbol Symbol index in the acoustic model
+   * @param q State of the HMM model.
+   * @param floor Score under which the caller drops the hypothesis, passed
+   * to the acoustic model (see AcousticModel::calc_prepared_logprob).
+   * @return float Log probability or log(p(x,HMM(symbol,q))), -HUGE_VAL if
+   * it is not above floor.
+   */
+  float compute_lprob(const Frame& frame, const uint32_t symbol, const int q,
+                      const float floor = -HUGE_VAL);
+
+  /**
+   * With a lookahead of n frames, the first time a senone is required inside
+   * the current block of n frames, it is scored for the frame t and every
+   * following frame up to the end of the block, in one call to the acoustic
+   * model, and kept until the search leaves the block. Senones that become
+   * active in the middle of a block are scored from there. With a
+   * lookahead of 1 this is compute_lprob for the frame t.
+   *
+   * The block belongs to the utterance being decoded, whatever the sample
+   * passed: viterbiInit and resetDecoder drop it, so one of them must start
+   * each new utterance.
+   *
+   * @brief Computes the emission log prob of the frame t of a sample for a
+   * symbol or senone and the state index of the HMM model (q).
+   *
+   * @param sample Sample being decoded
+   * @param t Position of the frame in the sample
+   * @param sym Symbol or senone, to index the HMM model
+   * @param q State of the HMM model.
+   * @return float Log probability or log(p(x_t,HMM(sym,q)))
+   */
+  float compute_lprob(const Sample& sample, const int t, const std::string& sym,
+                      const int q);
+
+  /**
+   * @brief compute_lprob for the frame t of a sample and the symbol with a
+   * dense index in the acoustic model.
+   *
+   * @param sample Sample being decoded
+   * @param t Position of the frame in the sample
+   * @param symbol Symbol index in the acoustic model
+   * @param q State of the HMM model.
+   * @param floor Score under which the caller drops the hypothesis, only
+   * used with a lookahead of 1.
+   * @return float Log probability or log(p(x_t,HMM(symbol,q)))
+   */
+  float compute_lprob(const Sample& sample, const int t, const uint32_t symbol,
+                      const int q, const float floor = -HUGE_VAL);
+
+  /**
+   * The search still advances frame by frame and the result is the same as
+   * without lookahead, but each Gaussian is loaded once per block instead of
+   * once per frame.
+   *
+   * @brief Set the number of frames scored in one batch.
+   *
+   * @param n Frames per block, from 1 (no lookahead, the default) to
+   * DECODER_MAX_LOOKAHEAD.
+   */
+  void setLookahead(const uint32_t n);
+
+  /**
+   * @brief Get the number of frames scored in one batch.
+   *
+   * @return uint32_t Frames per block.
+   */
+  uint32_t getLookahead() const { return lookahead; }
+
+  /**
+   * Before each frame, the senones of the HMM states to be expanded are
+   * collected and scored by a persistent pool of threads, and the search reads
+   * them from the score cache. The result is the same as with one thread. It
+   * only applies without lookahead, the lookahead blocks are scored on demand.
+   *
+   * @brief Set the number of threads that score each frame.
+   *
+   * @param n Threads, 1 (the default) scores on demand in the search thread.
+   */
+  void setScoringThreads(const uint32_t n);
+
+  /**
+   * @brief Get the number of threads that score each frame.
+   *
+   * @return uint32_t The number of threads.
+   */
+  uint32_t getScoringThreads() const {
+    return scoring_pool ? scoring_pool->getNThreads() : 1;
+  }
+
+  /**
+   * Lazy scoring only scores the senones the search asks for. Eager scoring
+   * scores every senone of the model at once with
+   * AcousticModel::calc_logprob_block, which is faster when most of them are
+   * active. ScoringPolicy::Auto chooses for each frame: eager when the
+   * fraction of senones active in the previous frame reaches the eager
+   * threshold, lazy otherwise. Both give the same scores with the direct
+   * scoring of the models. The lookahead blocks are always scored lazily.
+   *
+   * @brief Set how the senones of each frame are scored.
+   *
+   * @param policy ScoringPolicy::Lazy, ScoringPolicy::Eager or
+   * ScoringPolicy::Auto (default).
+   */
+  void setScoringPolicy(const ScoringPolicy policy) { scoring_policy = policy; }
+
+  ScoringPolicy getScoringPolicy() const { return scoring_policy; }
+
+  /**
+   * @brief Set the fraction of active senones from which ScoringPolicy::Auto
+   * scores every senone of the frame.
+   *
+   * @param ratio From 0 to 1, DECODER_EAGER_THRESHOLD by default.
+   */
+  void setEagerThreshold(const float ratio) { eager_threshold = ratio; }
+
+  float getEagerThreshold() const { return eager_threshold; }
+
+  /**
+   * @brief Get how the frames decoded since the last resetDecoder were scored.
+   *
+   * @return const ScoringStats& The counters.
+   */
+  const ScoringStats& getScoringStats() const { return scoring_stats; }
+
+  /**
+   * @brief Get the symbols of the search graph the decoder cannot search:
+   * missing from the acoustic model, with transitions it does not support or
+   * with an HMM state whose senone is missing. Their states are never
+   * entered.
+   *
+   * @return const std::vector<std::string>& The symbols, empty if the search
+   * graph and the acoustic model match.
+   */
+  const std::vector<std::string>& getUnboundSymbols() const {
+    return unbound_symbols;
+  }
+
+  /**
+   * The acoustic model belongs to this decoder, so other decoders keep their
+   * own mode.
+   *
+   * @brief Set how the acoustic model combines the components of a mixture,
+   * LogAddMode::Max scores each state by its best component only.
+   *
+   * @param mode LogAddMode::Exact (default), LogAddMode::FastExp or
+   * LogAddMode::Max.
+   */
+  void setLogAddMode(const LogAddMode mode);
+
+  /**
+   * @brief Get how the acoustic model combines the components of a mixture.
+   *
+   * @return LogAddMode The mode in use.
+   */
+  LogAddMode getLogAddMode() const { return amodel->getLogAddMode(); }
+
+  /**
+   * With LogAddMode::Max, each emission is also given the score under which
+   * its hypothesis falls out of the acoustic beam, so the Gaussians of the
+   * hopeless ones stop early. The result of the search does not change.
+   *
+   * @brief Use partial distance elimination in the acoustic model (see
+   * AcousticModel::setPartialDistance).
+   *
+   * @param enable True to use it, false (default) otherwise.
+   */
+  void setPartialDistance(const bool enable);
+
+  bool getPartialDistance() const { return amodel->getPartialDistance(); }
+
   /**
    * @brief Get the vector of WordHyps where the partial hypotheses are stored.
    *
@@ -669,30 +895,13 @@ class Decoder {
    */
   std::string getResult();
 
-  /** Acoustic Model cache related Hashing functions **/
-  class cacheLProbID {
-   public:
-    std::string sym;
-    uint32_t q;
-    cacheLProbID();
-    cacheLProbID(const std::string& sym, uint32_t q) : sym(sym), q(q) {}
-    bool operator==(const cacheLProbID& other) const {
-      return (sym == other.sym && q == other.q);
-    }
-  };
-
-  struct cacheLProbIDHasher {
-    std::size_t operator()(const cacheLProbID& k) const {
-      using std::hash;
-      using std::size_t;
-
-      return ((hash<std::string>()(k.sym) ^ (hash<uint32_t>()(k.q) << 1)));
-    }
-  };
-
  private:
   std::unique_ptr<SearchGraphLanguageModel> sgraph;
   std::unique_ptr<AcousticModel> amodel;
+  // Acoustic model symbol of each search graph state, -1 for null states and
+  // for states whose symbol is in unbound_symbols.
+  std::vector<int> sg_state_to_symbol;
+  std::vector<std::string> unbound_symbols;
   std::vector<int> actives;
   std::vector<std::unique_ptr<SGNode>> search_graph_null_nodes0;
   std::vector<std::unique_ptr<SGNode>> search_graph_null_nodes1;
@@ -700,7 +909,19 @@ class Decoder {
   std::vector<std::unique_ptr<SGNode>> search_graph_nodes1;
   std::unique_ptr<HMMMinHeap> hmm_minheap_nodes0;
   std::unique_ptr<HMMMinHeap> hmm_minheap_nodes1;
-  std::unordered_map<cacheLProbID, float, cacheLProbIDHasher> lprob_cache;
+  // Scores of the current frame, by senone: the symbols and HMM states that
+  // share a senone are scored once. lprob_cache[s] holds the score of senone s
+  // if lprob_stamps[s] is the current generation.
+  std::vector<float> lprob_cache;
+  std::vector<uint32_t> lprob_stamps;
+  uint32_t lprob_generation = 1;
+  // Senones dropped by the floor of compute_lprob: if bound_stamps[s] is the
+  // current generation, lprob_cache[s] is only an upper bound of the score.
+  std::vector<uint32_t> bound_stamps;
+  // The frame of the current generation, prepared by the acoustic model if
+  // prepared_generation is the current generation.
+  PreparedFrames prepared;
+  uint32_t prepared_generation = 0;
 
   std::vector<WordHyp> hypothesis;
   float v_thr = -HUGE_VAL;
@@ -718,6 +939,92 @@ class Decoder {
   int max_hyp = -1;
   float max_prob = -HUGE_VAL;
   int currentIteration = 0;
+
+  /**
+   * Each symbol of the graph is looked up once, however many states use it,
+   * and the symbols that cannot be searched are reported here instead of
+   * when the search reaches them.
+   *
+   * @brief Resolve the acoustic model symbol of every search graph state into
+   * sg_state_to_symbol, whose compiled topology the search follows.
+   */
+  void bindSearchGraph();
+
+  /**
+   * @brief Start a new lookahead block at frame t, copying its frames into a
+   * contiguous buffer, which the acoustic model prepares, and dropping the
+   * scores of the previous block.
+   */
+  void prepareLookaheadBlock(const Sample& sample, const int t);
+
+  /**
+   * @brief Drop the current lookahead block.
+   */
+  void resetLookaheadBlock();
+
+  /**
+   * @brief Invalidate every entry of a generation-stamped cache, clearing the
+   * stamps only when the generation wraps around.
+   *
+   * @return bool True if the generation wrapped around.
+   */
+  static bool nextGeneration(std::vector<uint32_t>& stamps,
+                             uint32_t& generation);
+
+  /**
+   * @brief Prepare the frame of the current generation of the score cache,
+   * the first time one of its senones is scored.
+   */
+  const PreparedFrames& prepareFrame(const Frame& frame);
+
+  // compute_lprob by senone index, INFINITY if it is negative.
+  float compute_senone_lprob(const Frame& frame, const int senone,
+                             const float floor);
+  float compute_senone_lprob(const Sample& sample, const int t,
+                             const int senone, const float floor);
+
+  /**
+   * @brief Score with the thread pool the senones of the HMM nodes to be
+   * expanded in this frame that are not in the score cache yet.
+   *
+   * @param frame Frame being decoded
+   * @param thr Nodes below this log prob are not expanded
+   */
+  void scoreActiveSenones(const Frame& frame, const float thr);
+
+  std::unique_ptr<ThreadPool> scoring_pool;
+  std::vector<uint32_t> active_senones;
+
+  /**
+   * @brief Score the senones of a frame before the search expands its nodes,
+   * every senone if the scoring policy is eager for this frame.
+   *
+   * @param frame Frame being decoded
+   * @param thr Nodes below this log prob are not expanded
+   */
+  void scoreFrame(const Frame& frame, const float thr);
+
+  ScoringPolicy scoring_policy = ScoringPolicy::Auto;
+  float eager_threshold = DECODER_EAGER_THRESHOLD;
+  ScoringStats scoring_stats = ScoringStats();
+  // Senones the search asked for in the current frame: active_stamps[s] is
+  // the current generation of the score cache.
+  std::vector<uint32_t> active_stamps;
+  uint32_t n_active_senones = 0;
+
+  uint32_t lookahead = 1;
+  // Frames [block_begin, block_begin + block_size) of the current utterance.
+  int block_begin = 0;
+  uint32_t block_size = 0;
+  uint32_t block_dim = 0;
+  std::vector<float> block_frames;
+  PreparedFrames block_prepared;
+  // Scores of senone s for the frames of the block start at block_offsets[s]
+  // in block_lprobs, if block_stamps[s] is the current generation.
+  std::vector<uint32_t> block_offsets;
+  std::vector<uint32_t> block_stamps;
+  uint32_t block_generation = 1;
+  std::vector<float> block_lprobs;
 };
 
 #include "Decoder.inl"
@@ -5,6 +5,8 @@
 
 #include <Decoder.h>
 
+#include <algorithm>
+
 /**
  * @brief Search Graph Node methods' definition
  *
@@ -40,10 +42,57 @@ Decoder::Decoder(std::unique_ptr<SearchGraphLanguageModel> sgraph,
 
   actives = std::vector<int>(this->sgraph->getNStates(), -1);
 
+  lprob_cache.assign(this->amodel->getNSenones(), 0.0);
+  lprob_stamps.assign(this->amodel->getNSenones(), 0);
+  active_stamps.assign(this->amodel->getNSenones(), 0);
+  bound_stamps.assign(this->amodel->getNSenones(), 0);
+  block_offsets.assign(this->amodel->getNSenones(), 0);
+  block_stamps.assign(this->amodel->getNSenones(), 0);
+
+  bindSearchGraph();
+
   hmm_minheap_nodes0 = std::unique_ptr<HMMMinHeap>(new HMMMinHeap(nmaxstates));
   hmm_minheap_nodes1 = std::unique_ptr<HMMMinHeap>(new HMMMinHeap(nmaxstates));
 }
 
+void Decoder::bindSearchGraph() {
+  const HMMTopology& topology = amodel->getTopology();
+
+  std::vector<int> graph_symbol_to_symbol(sgraph->getNSymbols(), -1);
+  unbound_symbols.clear();
+  for (uint32_t i = 0; i < sgraph->getNSymbols(); i++) {
+    if (i == SG_NULL_SYMBOL_ID) continue;
+
+    const std::string& name = sgraph->getSymbol(i);
+    const int symbol = amodel->getSymbolId(name);
+    bool bound = symbol >= 0 && topology.getNStates(symbol) > 0;
+    // A senone the model lacks would score INFINITY in the middle of the
+    // search.
+    for (uint32_t q = 0; bound && q < topology.getNStates(symbol); q++)
+      bound = topology.getState(symbol, q).senone >= 0;
+
+    if (!bound) {
+      unbound_symbols.push_back(name);
+      continue;
+    }
+    graph_symbol_to_symbol[i] = symbol;
+  }
+
+  if (!unbound_symbols.empty()) {
+    std::cout << "Symbols of the search graph missing from the acoustic model,"
+              << " with unsupported transitions or missing senones, never"
+              << " entered:";
+    for (const std::string& name : unbound_symbols) std::cout << " " << name;
+    std::cout << std::endl;
+  }
+
+  sg_state_to_symbol.resize(sgraph->getNStates());
+  for (uint32_t s = 0; s < sgraph->getNStates(); s++) {
+    sg_state_to_symbol[s] =
+        graph_symbol_to_symbol[sgraph->getSearchGraphState(s).symbol_id];
+  }
+}
+
 float Decoder::decode(Sample sample) {
   viterbiInit(sample);
   // TODO: Fix adaptative beam
@@ -85,8 +134,7 @@ void Decoder::expandSearchGraphNodes(
 
     float curr_lprob = node->getLProb();
     float curr_lmlprob = node->getLMLProb();
-    std::string wordInNode = sgraph->getIdToWord(node->getStateId());
-    local_wip = (wordInNode != "-" && wordInNode != ">") ? WIP : 0;
+    local_wip = sgraph->emitsWord(node->getStateId()) ? WIP : 0;
 
     SearchGraphLanguageModelState sgstate =
         sgraph->getSearchGraphState(node->getStateId());
@@ -97,7 +145,7 @@ void Decoder::expandSearchGraphNodes(
         if (sgedge.dst == sgraph->getFinalState()) {
           continue;
         }
-      } else if (sgraph->getIdToSym(sgedge.dst) != "-") {
+      } else if (!sgraph->isNullNode(sgedge.dst)) {
         continue;
       }
 
@@ -112,12 +160,10 @@ void Decoder::expandSearchGraphNodes(
 
 void Decoder::insertSearchGraphNode(std::unique_ptr<SGNode>& node) {
   int node_id = node->getStateId();
-  const std::string& symbol = sgraph->getIdToSym(node_id);
-  const std::string& word = sgraph->getIdToWord(node_id);
 
-  bool insertWord = word != "-" && word != ">";
+  bool insertWord = sgraph->emitsWord(node_id);
 
-  bool nullNode = symbol == "-";
+  bool nullNode = sgraph->isNullNode(node_id);
 
   if (node->getLProb() < v_lm_thr) return;
   if (WIP <= 0 && node->getLProb() < v_thr) return;
@@ -130,7 +176,8 @@ void Decoder::insertSearchGraphNode(std::unique_ptr<SGNode>& node) {
 
     if (insertWord) {
       // hypothesis.emplace_back(node->getHyp(), word);
-      hypothesis.push_back(WordHyp(node->getHyp(), word));
+      hypothesis.push_back(
+          WordHyp(node->getHyp(), sgraph->getIdToWord(node_id)));
       node->setHyp(hypothesis.size() - 1);
       node->setHMMLProb(0.0);
       node->setLMLProb(0.0);
@@ -261,24 +308,23 @@ void Decoder::getReadyNodes() {
 
 void Decoder::viterbiSg2HMM(const Sample& sample) {
   std::vector<std::unique_ptr<SGNode>>& nodes0 = getSearchGraphNodes0();
+  const HMMTopology& topology = amodel->getTopology();
 
   for (const auto& node : nodes0) {
-    // Create new node...
-    std::unique_ptr<HMMNode> new_node(new HMMNode(
-        node->getStateId(), 0, node->getLProb(), node->getHMMLProb(),
-        node->getLMLProb(), 0, node->getHyp()));
+    const int symbol = sg_state_to_symbol[node->getStateId()];
 
-    const std::string& symbol = sgraph->getIdToSym(new_node->getId().sg_state);
-    const std::string& transType = amodel->getStateTransType(symbol);
+    // Unbound, reported by bindSearchGraph.
+    if (symbol < 0) continue;
 
-    if (transType == "Trans") {
-      new_node->setIdQ(0);
-      new_node->setLogprob(node->getLProb());
-      new_node->setHMMLogProb(node->getHMMLProb());
+    // Left-to-right HMMs are only entered through their first state, TransL
+    // ones may be entered through any state with a transition from I.
+    for (uint32_t i = 0; i < topology.getNEntries(symbol); i++) {
+      const HMMTopologyArc& arc = topology.getEntry(symbol, i);
+      std::unique_ptr<HMMNode> new_node(new HMMNode(
+          node->getStateId(), arc.dst, node->getLProb() + arc.lprob,
+          node->getHMMLProb() + arc.lprob, node->getLMLProb(), 0,
+          node->getHyp()));
       insertHMMNode(std::move(new_node));
-    } else {
-      // TODO: alternative transition representation...
-      assert(false);
     }
   }
   // TODO: Think about preallocating the memory and manage these things
@@ -295,6 +341,8 @@ void Decoder::getReadyHMMNodes0() {
 }
 
 void Decoder::viterbiInit(const Sample& sample) {
+  resetLookaheadBlock();
+
   std::unique_ptr<SGNode> sgnodeIni(
       new SGNode(sgraph->getStartState(), 0.0, 0.0, 0.0, 0));
 
@@ -337,6 +385,11 @@ void Decoder::viterbiIter(const Sample& sample, const int t,
   this->v_lm_thr = -HUGE_VAL;
   bool inLastQ = false;
   float p0, p1;
+  const HMMTopology& topology = amodel->getTopology();
+
+  if (lookahead <= 1) {
+    scoreFrame(sample.getFrame(t), old_thr);
+  }
 
   // TODO
   // Iterate over nodes in hmm_nodes0 (this is a vector representation of a
@@ -352,10 +405,24 @@ void Decoder::viterbiIter(const Sample& sample, const int t,
     node->setLogprob(node->getLogProb() - old_max);
 
     // Get symbol
-    const std::string& symbol = sgraph->getIdToSym(node->getId().sg_state);
+    const int symbol = sg_state_to_symbol[node->getId().sg_state];
+
+    // Unbound, reported by bindSearchGraph.
+    if (symbol < 0) continue;
+
+    // Transitions only lower the score and v_thr only grows, so with no word
+    // insertion penalty an emission score that leaves the node under v_thr
+    // gets it pruned anyway.
+    const float floor = WIP <= 0 && v_thr > -HUGE_VAL
+                            ? v_thr - node->getLogProb()
+                            : -HUGE_VAL;
+
+    const uint32_t n_q = topology.getNStates(symbol);
+    const uint32_t q = node->getId().hmm_q_state;
+    const HMMTopologyState& state = topology.getState(symbol, q);
 
     // Compute Emission score
-    auxp = compute_lprob(sample.getFrame(t), symbol, node->getId().hmm_q_state);
+    auxp = compute_senone_lprob(sample, t, state.senone, floor);
     node->setLogprob(node->getLogProb() + auxp);
     node->setHMMLogProb(node->getHMMLogProb() + auxp);
 
@@ -363,46 +430,54 @@ void Decoder::viterbiIter(const Sample& sample, const int t,
       continue;
     }
 
-    const std::string& transType = amodel->getStateTransType(symbol);
-    if (transType == "Trans") {
-      std::vector<float> transVector = amodel->getStateTrans(symbol);
-      nodeSGstate = node->getId().sg_state;
-      current_p = node->getLogProb();
-      current_hmmp = node->getHMMLogProb();
-      current_lmp = node->getLMLogProb();
-      current_hyp = node->getH();
-
-      p1 = transVector[node->getId().hmm_q_state];
-      // TODO: This could be done when AM is loaded...
-      p0 = log(1 - exp(p1));
-
-      // TODO: Preallocate nodes and reuse them instead of creating them on the
-      // fly.
-      std::unique_ptr<HMMNode> new_node(new HMMNode(
-          node->getId().sg_state, node->getId().hmm_q_state, node->getLogProb(),
-          node->getHMMLogProb(), node->getLMLogProb(), 0, node->getH()));
+    nodeSGstate = node->getId().sg_state;
+    current_p = node->getLogProb();
+    current_hmmp = node->getHMMLogProb();
+    current_lmp = node->getLMLogProb();
+    current_hyp = node->getH();
 
-      if (p0 != -HUGE_VAL) {
-        node->setLogprob(current_p + p0);
-        node->setHMMLogProb(current_hmmp + p0);
-        insertHMMNode(std::move(node));
-        hmmNodesExpanded++;
-      }
+    p1 = state.forward;
+    p0 = state.loop;
+
+    // TODO: Preallocate nodes and reuse them instead of creating them on the
+    // fly.
+    std::unique_ptr<HMMNode> new_node(new HMMNode(
+        node->getId().sg_state, node->getId().hmm_q_state, node->getLogProb(),
+        node->getHMMLogProb(), node->getLMLogProb(), 0, node->getH()));
+
+    if (p0 != -HUGE_VAL) {
+      node->setLogprob(current_p + p0);
+      node->setHMMLogProb(current_hmmp + p0);
+      insertHMMNode(std::move(node));
+      hmmNodesExpanded++;
+    }
 
-      new_node->setLogprob(current_p + p1);
-      new_node->setHMMLogProb(current_hmmp + p1);
+    new_node->setLogprob(current_p + p1);
+    new_node->setHMMLogProb(current_hmmp + p1);
+
+    inLastQ = q + 1 == n_q && p1 != -HUGE_VAL;
+    if (q + 1 < n_q && p1 != -HUGE_VAL) {
+      hmmNodesExpanded++;
+      new_node->setIdQ(new_node->getId().hmm_q_state + 1);
+      if (!final_iter) insertHMMNode(std::move(new_node));
+    }
 
-      // TODO: Provide the proper param for number of Q
-      inLastQ = !((new_node->getId().hmm_q_state + 1) < transVector.size());
-      if (!inLastQ) {
+    // Skips and exits from the middle of TransL HMMs.
+    for (uint32_t a = 0; a < state.n_arcs; a++) {
+      const HMMTopologyArc& arc = topology.getArc(state, a);
+      if (arc.dst == n_q) {
+        std::unique_ptr<SGNode> sgnode(
+            new SGNode(nodeSGstate, current_p + arc.lprob,
+                       current_hmmp + arc.lprob, current_lmp, current_hyp));
+        sgNodesExpanded++;
+        insertSearchGraphNode(sgnode);
+      } else if (!final_iter) {
+        std::unique_ptr<HMMNode> arc_node(
+            new HMMNode(nodeSGstate, arc.dst, current_p + arc.lprob,
+                        current_hmmp + arc.lprob, current_lmp, 0, current_hyp));
         hmmNodesExpanded++;
-        new_node->setIdQ(new_node->getId().hmm_q_state + 1);
-        if (!final_iter) insertHMMNode(std::move(new_node));
+        insertHMMNode(std::move(arc_node));
       }
-
-    } else {
-      // TODO: alternative transition representation...
-      assert(false);
     }
 
     // If final, do some stuff
@@ -427,14 +502,225 @@ void Decoder::viterbiIter(const Sample& sample, const int t,
 
 float Decoder::compute_lprob(const Frame& frame, const std::string& sym,
                              const int q) {
-  auto it = lprob_cache.find(cacheLProbID(sym, q));
-  if (it != lprob_cache.end()) {
-    return it->second;
+  const int symbol = amodel->getSymbolId(sym);
+
+  if (symbol < 0) return INFINITY;
+
+  return compute_lprob(frame, static_cast<uint32_t>(symbol), q);
+}
+
+float Decoder::compute_lprob(const Frame& frame, const uint32_t symbol,
+                             const int q, const float floor) {
+  return compute_senone_lprob(frame, amodel->getSenoneId(symbol, q), floor);
+}
+
+float Decoder::compute_senone_lprob(const Frame& frame, const int senone,
+                                    const float floor) {
+  if (senone < 0 || frame.getDim() != amodel->getDim()) return INFINITY;
+
+  if (active_stamps[senone] != lprob_generation) {
+    active_stamps[senone] = lprob_generation;
+    n_active_senones++;
+    scoring_stats.active_senones++;
+  }
+
+  if (lprob_stamps[senone] == lprob_generation) {
+    if (bound_stamps[senone] != lprob_generation) return lprob_cache[senone];
+    // Not above the floor it was scored with, nor above this one.
+    if (floor >= lprob_cache[senone]) return -HUGE_VAL;
+  }
+
+  float lprob =
+      this->amodel->calc_prepared_logprob(senone, prepareFrame(frame), 0, floor);
+  lprob_stamps[senone] = lprob_generation;
+
+  if (lprob == -HUGE_VAL && floor > -HUGE_VAL) {
+    lprob_cache[senone] = floor;
+    bound_stamps[senone] = lprob_generation;
   } else {
-    float lprob = this->amodel->calc_logprob(sym, q, frame.getFeatures());
-    lprob_cache[cacheLProbID(sym, q)] = lprob;
-    return lprob;
+    lprob_cache[senone] = lprob;
+    bound_stamps[senone] = 0;
   }
+  return lprob;
+}
+
+float Decoder::compute_lprob(const Sample& sample, const int t,
+                             const std::string& sym, const int q) {
+  const int symbol = amodel->getSymbolId(sym);
+
+  if (symbol < 0) return INFINITY;
+
+  return compute_lprob(sample, t, static_cast<uint32_t>(symbol), q);
+}
+
+float Decoder::compute_lprob(const Sample& sample, const int t,
+                             const uint32_t symbol, const int q,
+                             const float floor) {
+  return compute_senone_lprob(sample, t, amodel->getSenoneId(symbol, q),
+                              floor);
+}
+
+float Decoder::compute_senone_lprob(const Sample& sample, const int t,
+                                    const int senone, const float floor) {
+  const Frame& frame = sample.getFrame(t);
+
+  if (lookahead <= 1 || frame.getDim() != amodel->getDim()) {
+    return compute_senone_lprob(frame, senone, floor);
+  }
+
+  if (senone < 0) return INFINITY;
+
+  if (t < block_begin || t >= block_begin + static_cast<int>(block_size)) {
+    prepareLookaheadBlock(sample, t);
+  }
+
+  const uint32_t pos = t - block_begin;
+
+  if (block_stamps[senone] == block_generation) {
+    return block_lprobs[block_offsets[senone] + pos];
+  }
+
+  // Scored from this frame to the end of the block.
+  const uint32_t offset = block_lprobs.size();
+  block_lprobs.resize(offset + block_size, NAN);
+  amodel->calc_prepared_logprob_block(senone, block_prepared, pos,
+                                      block_size - pos,
+                                      &block_lprobs[offset + pos]);
+  block_offsets[senone] = offset;
+  block_stamps[senone] = block_generation;
+  return block_lprobs[offset + pos];
+}
+
+void Decoder::setLookahead(const uint32_t n) {
+  lookahead = std::max(1u, std::min(n, DECODER_MAX_LOOKAHEAD));
+  resetLookaheadBlock();
+}
+
+void Decoder::setScoringThreads(const uint32_t n) {
+  if (n <= 1) {
+    scoring_pool.reset();
+  } else if (n != getScoringThreads()) {
+    scoring_pool.reset(new ThreadPool(n));
+  }
+}
+
+void Decoder::scoreFrame(const Frame& frame, const float thr) {
+  const uint32_t n_senones = amodel->getNSenones();
+
+  // Senones asked for in the previous frame.
+  scoring_stats.active_ratio =
+      n_senones > 0 ? static_cast<float>(n_active_senones) / n_senones : 0.0;
+  n_active_senones = 0;
+
+  const bool eager =
+      scoring_policy == ScoringPolicy::Eager ||
+      (scoring_policy == ScoringPolicy::Auto &&
+       scoring_stats.active_ratio >= eager_threshold);
+
+  if (eager && frame.getDim() == amodel->getDim()) {
+    amodel->calc_logprob_block(frame.getFeatures().data(), 1,
+                               lprob_cache.data());
+    std::fill(lprob_stamps.begin(), lprob_stamps.end(), lprob_generation);
+    scoring_stats.eager_frames++;
+    return;
+  }
+
+  scoring_stats.lazy_frames++;
+
+  if (scoring_pool) scoreActiveSenones(frame, thr);
+}
+
+void Decoder::scoreActiveSenones(const Frame& frame, const float thr) {
+  if (frame.getDim() != amodel->getDim()) return;
+
+  std::vector<std::unique_ptr<HMMNode>>& nodes0 = this->getHMMNodes0();
+
+  // Same nodes as viterbiIter, each senone once.
+  active_senones.clear();
+  for (uint32_t i = this->getNumberActiveHMMNodes0(); i > 0; i--) {
+    const std::unique_ptr<HMMNode>& node = nodes0[i];
+    if (!final_iter && node->getLogProb() < thr) continue;
+
+    const int symbol = sg_state_to_symbol[node->getId().sg_state];
+    if (symbol < 0) continue;
+
+    const int senone = amodel->getSenoneId(symbol, node->getId().hmm_q_state);
+    if (senone < 0 || lprob_stamps[senone] == lprob_generation) continue;
+
+    lprob_stamps[senone] = lprob_generation;
+    active_senones.push_back(senone);
+  }
+
+  if (active_senones.empty()) return;
+
+  const PreparedFrames& frames = prepareFrame(frame);
+
+  const uint32_t n_senones = active_senones.size();
+  scoring_pool->run(
+      (n_senones + DECODER_SCORING_CHUNK - 1) / DECODER_SCORING_CHUNK,
+      [this, &frames, n_senones](uint32_t chunk) {
+        const uint32_t end =
+            std::min(n_senones, (chunk + 1) * DECODER_SCORING_CHUNK);
+        for (uint32_t i = chunk * DECODER_SCORING_CHUNK; i < end; i++) {
+          const uint32_t senone = active_senones[i];
+          lprob_cache[senone] = amodel->calc_prepared_logprob(senone, frames, 0);
+        }
+      });
+}
+
+void Decoder::setLogAddMode(const LogAddMode mode) {
+  amodel->setLogAddMode(mode);
+  // Scores computed with the previous mode.
+  resetAMCache();
+  resetLookaheadBlock();
+}
+
+void Decoder::setPartialDistance(const bool enable) {
+  amodel->setPartialDistance(enable);
+  resetAMCache();
+  resetLookaheadBlock();
+}
+
+const PreparedFrames& Decoder::prepareFrame(const Frame& frame) {
+  if (prepared_generation != lprob_generation) {
+    amodel->prepare_frames(frame.getFeatures().data(), 1, &prepared);
+    prepared_generation = lprob_generation;
+  }
+  return prepared;
+}
+
+void Decoder::prepareLookaheadBlock(const Sample& sample, const int t) {
+  block_begin = t;
+  block_size = std::min(lookahead, sample.getNFrames() - t);
+  block_dim = sample.getFrame(t).getDim();
+
+  block_frames.resize(block_size * block_dim);
+  for (uint32_t f = 0; f < block_size; f++) {
+    const std::vector<float>& features = sample.getFrame(t + f).getFeatures();
+    std::copy(features.begin(), features.end(),
+              block_frames.begin() + f * block_dim);
+  }
+  amodel->prepare_frames(block_frames.data(), block_size, &block_prepared);
+
+  nextGeneration(block_stamps, block_generation);
+  block_lprobs.clear();
+}
+
+void Decoder::resetLookaheadBlock() {
+  block_begin = 0;
+  block_size = 0;
+  nextGeneration(block_stamps, block_generation);
+  block_lprobs.clear();
+}
+
+bool Decoder::nextGeneration(std::vector<uint32_t>& stamps,
+                             uint32_t& generation) {
+  if (++generation == 0) {
+    std::fill(stamps.begin(), stamps.end(), 0);
+    generation = 1;
+    return true;
+  }
+  return false;
 }
 
 void Decoder::resetDecoder() {
@@ -463,7 +749,10 @@ void Decoder::resetDecoder() {
   hmm_minheap_nodes0.reset();
   hmm_minheap_nodes1.reset();
 
-  lprob_cache.clear();
+  resetAMCache();
+  resetLookaheadBlock();
+  scoring_stats = ScoringStats();
+  n_active_senones = 0;
   hypothesis.clear();
 
   actives = std::vector<int>(this->sgraph->getNStates(), -1);
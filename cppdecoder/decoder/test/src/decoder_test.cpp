@@ -7,9 +7,11 @@
 #include <HMM.h>
 #include <MixtureAcousticModel.h>
 #include <SearchGraphLanguageModel.h>
+#include <TiedStatesAcousticModel.h>
 #include <Utils.h>
 #include <stdio.h>
 
+#include <fstream>
 #include <iomanip>  // std::setprecision
 #include <memory>
 
@@ -581,6 +583,41 @@ TEST_F(DecoderTests, DecoderViterbiIter_test1) {
             decoder->getResult());
 }
 
+TEST_F(DecoderTests, DecoderComputeLProbSenoneCache) {
+  MixtureAcousticModel mixturemodel(nameModelMixture);
+  const Frame& frame = sample.getFrame(0);
+
+  for (int q = 0; q < 3; q++) {
+    float lprob = mixturemodel.calc_logprob("a", q, frame.getFeatures());
+    ASSERT_EQ(decoder->compute_lprob(frame, "a", q), lprob);
+    // From the cache.
+    ASSERT_EQ(decoder->compute_lprob(frame, "a", q), lprob);
+  }
+
+  ASSERT_FLOAT_EQ(decoder->compute_lprob(frame, "aaaaaaaaaa", 0), INFINITY);
+  ASSERT_FLOAT_EQ(decoder->compute_lprob(frame, "a", 56), INFINITY);
+
+  decoder->resetAMCache();
+}
+
+TEST_F(DecoderTests, DecoderResetAMCache) {
+  MixtureAcousticModel mixturemodel(nameModelMixture);
+  const Frame& frame0 = sample.getFrame(0);
+  const Frame& frame1 = sample.getFrame(1);
+
+  float lprob0 = mixturemodel.calc_logprob("a", 0, frame0.getFeatures());
+  float lprob1 = mixturemodel.calc_logprob("a", 0, frame1.getFeatures());
+  ASSERT_NE(lprob0, lprob1);
+
+  // Every frame invalidates the scores of the previous one.
+  for (uint32_t i = 0; i < 3; i++) {
+    ASSERT_EQ(decoder->compute_lprob(frame0, "a", 0), lprob0);
+    decoder->resetAMCache();
+    ASSERT_EQ(decoder->compute_lprob(frame1, "a", 0), lprob1);
+    decoder->resetAMCache();
+  }
+}
+
 TEST_F(DecoderTests, DecoderDecode) {
   decoder->decode(sample);
 
@@ -605,6 +642,366 @@ TEST_F(DecoderTests, DecoderDecode) {
             decoder->getResult());
 }
 
+TEST_F(DecoderTests, DecoderDecodeBinarySearchGraph) {
+  const float lprob = decoder->decode(sample);
+  const std::string result = decoder->getResult();
+
+  // The same search over the states and edges of the mapped graph.
+  const std::string searchGraphBinary = "./models/2.gram.graph.decoder.bin";
+  SearchGraphLanguageModel textgraph;
+  textgraph.read_model(searchGraphFile);
+  ASSERT_EQ(textgraph.write_binary_model(searchGraphBinary), 0);
+
+  std::unique_ptr<SearchGraphLanguageModel> sgraph(
+      new SearchGraphLanguageModel());
+  ASSERT_EQ(sgraph->read_model(searchGraphBinary), 0);
+  std::unique_ptr<AcousticModel> mixturemodel(
+      new MixtureAcousticModel(nameModelMixture));
+  Decoder binary(std::move(sgraph), std::move(mixturemodel));
+  ASSERT_EQ(binary.decode(sample), lprob);
+  ASSERT_EQ(binary.getResult(), result);
+
+  remove(searchGraphBinary.c_str());
+}
+
+TEST_F(DecoderTests, DecoderDecodeLookahead) {
+  float lprob = decoder->decode(sample);
+  std::string result = decoder->getResult();
+
+  const uint32_t lookaheads[] = {4, 16};
+
+  for (auto n : lookaheads) {
+    decoder->resetDecoder();
+    decoder->setLookahead(n);
+    ASSERT_EQ(decoder->getLookahead(), n);
+
+    ASSERT_EQ(decoder->decode(sample), lprob);
+    ASSERT_EQ(decoder->getResult(), result);
+  }
+
+  decoder->setLookahead(DECODER_MAX_LOOKAHEAD + 1);
+  ASSERT_EQ(decoder->getLookahead(), DECODER_MAX_LOOKAHEAD);
+}
+
+TEST_F(DecoderTests, DecoderLookaheadNewUtterance) {
+  MixtureAcousticModel mixturemodel(nameModelMixture);
+  const Frame& frame0 = sample.getFrame(0);
+  const Frame& frame1 = sample.getFrame(1);
+  float lprob0 = mixturemodel.calc_logprob("a", 0, frame0.getFeatures());
+  float lprob1 = mixturemodel.calc_logprob("a", 0, frame1.getFeatures());
+  ASSERT_NE(lprob0, lprob1);
+
+  decoder->setLookahead(4);
+  Sample utterance = sample;
+  ASSERT_EQ(decoder->compute_lprob(utterance, 0, "a", 0), lprob0);
+
+  // The next utterance, in the same object, starts at the second frame.
+  Sample next;
+  for (uint32_t i = 1; i < sample.getNFrames(); i++)
+    next.addFrame(sample.getFrame(i).getFeatures());
+  utterance = next;
+
+  decoder->resetDecoder();
+  ASSERT_EQ(decoder->compute_lprob(utterance, 0, "a", 0), lprob1);
+}
+
+TEST_F(DecoderTests, DecoderDecodeScoringThreads) {
+  float lprob = decoder->decode(sample);
+  std::string result = decoder->getResult();
+
+  const uint32_t threads[] = {2, 4};
+
+  for (auto n : threads) {
+    decoder->resetDecoder();
+    decoder->setScoringThreads(n);
+    ASSERT_EQ(decoder->getScoringThreads(), n);
+
+    ASSERT_EQ(decoder->decode(sample), lprob);
+    ASSERT_EQ(decoder->getResult(), result);
+  }
+
+  decoder->setScoringThreads(1);
+  ASSERT_EQ(decoder->getScoringThreads(), 1);
+}
+
+TEST_F(DecoderTests, DecoderDecodeScoringPolicy) {
+  decoder->setScoringPolicy(ScoringPolicy::Lazy);
+  float lprob = decoder->decode(sample);
+  std::string result = decoder->getResult();
+
+  const ScoringStats& stats = decoder->getScoringStats();
+  ASSERT_EQ(stats.lazy_frames, sample.getNFrames());
+  ASSERT_EQ(stats.eager_frames, 0);
+  ASSERT_GT(stats.active_senones, 0);
+
+  decoder->resetDecoder();
+  decoder->setScoringPolicy(ScoringPolicy::Eager);
+  ASSERT_EQ(decoder->decode(sample), lprob);
+  ASSERT_EQ(decoder->getResult(), result);
+  ASSERT_EQ(stats.lazy_frames, 0);
+  ASSERT_EQ(stats.eager_frames, sample.getNFrames());
+
+  // Every frame reaches a threshold of 0, none reaches one over 1.
+  decoder->setScoringPolicy(ScoringPolicy::Auto);
+  const float thresholds[] = {0.0, 1.1, DECODER_EAGER_THRESHOLD};
+
+  for (auto threshold : thresholds) {
+    decoder->resetDecoder();
+    decoder->setEagerThreshold(threshold);
+    ASSERT_EQ(decoder->decode(sample), lprob);
+    ASSERT_EQ(decoder->getResult(), result);
+    ASSERT_EQ(stats.lazy_frames + stats.eager_frames, sample.getNFrames());
+    if (threshold == 0.0) ASSERT_EQ(stats.eager_frames, sample.getNFrames());
+    if (threshold > 1.0) ASSERT_EQ(stats.lazy_frames, sample.getNFrames());
+  }
+}
+
+TEST_F(DecoderTests, DecoderDecodeMaxComponent) {
+  const std::string sampleFiles[] = {"./samples/AAFA0016.features",
+                                     "./samples/AAFA0002.features"};
+
+  for (auto& sampleFile_local : sampleFiles) {
+    Sample sample_local;
+    sample_local.read_sample(sampleFile_local);
+
+    decoder->resetDecoder();
+    decoder->setLogAddMode(LogAddMode::Exact);
+    float lprob = decoder->decode(sample_local);
+    std::string result = decoder->getResult();
+
+    decoder->resetDecoder();
+    decoder->setLogAddMode(LogAddMode::Max);
+    ASSERT_EQ(decoder->getLogAddMode(), LogAddMode::Max);
+    float max_lprob = decoder->decode(sample_local);
+
+    std::cout << sampleFile_local << ": full " << lprob << " (" << result
+              << "), max component " << max_lprob << " ("
+              << decoder->getResult() << ")" << std::endl;
+
+    // The best component is a lower bound of the full mixture.
+    ASSERT_LE(max_lprob, lprob);
+    ASSERT_EQ(decoder->getResult(), result);
+  }
+}
+
+TEST_F(DecoderTests, DecoderDecodePartialDistance) {
+  Sample sample;
+  sample.read_sample(sampleFile);
+
+  decoder->setLogAddMode(LogAddMode::Max);
+  float lprob = decoder->decode(sample);
+  std::string result = decoder->getResult();
+
+  // The emissions dropped under the beam threshold were pruned anyway.
+  decoder->resetDecoder();
+  decoder->setPartialDistance(true);
+  ASSERT_TRUE(decoder->getPartialDistance());
+  ASSERT_EQ(decoder->decode(sample), lprob);
+  ASSERT_EQ(decoder->getResult(), result);
+
+  // Same search with the dimensions sorted, up to rounding.
+  std::unique_ptr<SearchGraphLanguageModel> sgraph(
+      new SearchGraphLanguageModel());
+  sgraph->read_model(searchGraphFile);
+  std::unique_ptr<MixtureAcousticModel> mixturemodel(
+      new MixtureAcousticModel(nameModelMixture));
+  ASSERT_EQ(mixturemodel->sortDimensions(), 0);
+  Decoder sorted(std::move(sgraph), std::move(mixturemodel));
+  sorted.setLogAddMode(LogAddMode::Max);
+  sorted.setPartialDistance(true);
+  ASSERT_NEAR(sorted.decode(sample), lprob, 1e-4 * fabs(lprob));
+  ASSERT_EQ(sorted.getResult(), result);
+}
+
+TEST_F(DecoderTests, DecoderDecodeQuantized) {
+  const std::string sampleFiles[] = {"./samples/AAFA0016.features",
+                                     "./samples/AAFA0002.features"};
+  const ParamFormat formats[] = {ParamFormat::Int16, ParamFormat::Int8,
+                                 ParamFormat::Float16, ParamFormat::BFloat16};
+  const char* names[] = {"Int16", "Int8", "Float16", "BFloat16"};
+  const float tolerances[] = {0.01, 0.05, 0.001, 0.05};
+
+  std::vector<float> lprobs;
+  std::vector<std::string> results;
+  for (auto& sampleFile_local : sampleFiles) {
+    Sample sample_local;
+    sample_local.read_sample(sampleFile_local);
+    decoder->resetDecoder();
+    lprobs.push_back(decoder->decode(sample_local));
+    results.push_back(decoder->getResult());
+  }
+
+  for (uint32_t k = 0; k < 4; k++) {
+    const ParamFormat format = formats[k];
+    std::unique_ptr<SearchGraphLanguageModel> sgraph(
+        new SearchGraphLanguageModel());
+    sgraph->read_model(searchGraphFile);
+    std::unique_ptr<AcousticModel> mixturemodel(
+        new MixtureAcousticModel(nameModelMixture, format));
+    Decoder quantized(std::move(sgraph), std::move(mixturemodel));
+
+    for (uint32_t i = 0; i < 2; i++) {
+      Sample sample_local;
+      sample_local.read_sample(sampleFiles[i]);
+      quantized.resetDecoder();
+      float lprob = quantized.decode(sample_local);
+
+      std::cout << sampleFiles[i] << ": float " << lprobs[i] << ", "
+                << names[k] << " " << lprob << " (" << quantized.getResult() << ")" << std::endl;
+
+      ASSERT_NEAR(lprob, lprobs[i], tolerances[k] * fabs(lprobs[i]));
+      ASSERT_EQ(quantized.getResult(), results[i]);
+    }
+  }
+}
+
+// Write a search graph with a single path: the symbols, one word and the
+// final state.
+void write_linear_graph(const std::string& filename,
+                        const std::vector<std::string>& symbols,
+                        const std::string& word) {
+  const uint32_t n = symbols.size();
+  std::ofstream fileO(filename);
+  fileO << "SG\nNStates " << n + 3 << "\nNEdges " << n + 2
+        << "\nStart 0\nFinal 1\nStates\n";
+  fileO << "0 - - 0 1\n";
+  fileO << "1 - - " << n + 2 << " " << n + 2 << "\n";
+  for (uint32_t i = 0; i < n; i++)
+    fileO << i + 2 << " '" << symbols[i] << "' - " << i + 1 << " " << i + 2
+          << "\n";
+  fileO << n + 2 << " - '" << word << "' " << n + 1 << " " << n + 2 << "\n";
+  fileO << "Edges\n";
+  for (uint32_t i = 0; i <= n; i++) fileO << i << " " << i + 2 << " 0\n";
+  fileO << n + 1 << " 1 0\n";
+}
+
+// Tied-state model with single-Gaussian senones for 'a' and 'e', 'e+a' with
+// the transitions ("TransP") of 'e', and 'o', whose second senone is missing.
+void write_tied_model(const std::string& filename, const uint32_t dim) {
+  const std::vector<std::string> senones = {"a_0", "a_1", "a_2",
+                                            "e_0", "e_1", "e_2"};
+  std::ofstream fileO(filename);
+  fileO << "AMODEL\nTiedStates\nMixture\nDGaussian\nD " << dim << "\nSMOOTH";
+  for (uint32_t d = 0; d < dim; d++) fileO << " 0.001";
+  fileO << "\nN " << senones.size() << "\nStates\n";
+  for (uint32_t i = 0; i < senones.size(); i++) {
+    fileO << senones[i] << "\nI 1\nPMembers 0\nMembers\nMU";
+    for (uint32_t d = 0; d < dim; d++) fileO << " " << 0.1 * i - 0.2;
+    fileO << "\nVAR";
+    for (uint32_t d = 0; d < dim; d++) fileO << " " << 1 + 0.1 * i;
+    fileO << "\n";
+  }
+  fileO << "N 4\n";
+  fileO << "'a'\nQ 3\nTrans\n-0.5 -0.7 -0.9\na_0 a_1 a_2\n";
+  fileO << "'e'\nQ 3\nTrans\n-0.6 -0.8 -1.0\ne_0 e_1 e_2\n";
+  fileO << "'e+a'\nQ 3\nTransP e\ne_0 e_1 e_2\n";
+  fileO << "'o'\nQ 3\nTrans\n-0.5 -0.7 -0.9\na_0 o_1 a_2\n";
+}
+
+float decode_linear_graph(const std::string& filename,
+                          std::unique_ptr<AcousticModel> amodel,
+                          const Sample& sample, std::string* result) {
+  std::unique_ptr<SearchGraphLanguageModel> sgraph(
+      new SearchGraphLanguageModel());
+  sgraph->read_model(filename);
+  Decoder decoder(std::move(sgraph), std::move(amodel));
+  float lprob = decoder.decode(sample);
+  *result = decoder.getResult();
+  return lprob;
+}
+
+TEST_F(DecoderTests, DecoderDecodeTransL) {
+  const std::string graphFile = "./models/transl.graph";
+  write_linear_graph(graphFile, {"a", "SP", "a"}, "asa");
+
+  std::string result;
+  float lprob = decode_linear_graph(
+      graphFile,
+      std::unique_ptr<AcousticModel>(new MixtureAcousticModel(nameModelMixture)),
+      sample, &result);
+
+  ASSERT_GT(lprob, -HUGE_VAL);
+  ASSERT_EQ(result, "asa ");
+  remove(graphFile.c_str());
+}
+
+TEST_F(DecoderTests, DecoderDecodeTransP) {
+  const std::string nameModelTied = "./models/transp.model";
+  const std::string graphFile = "./models/transp.graph";
+  write_tied_model(nameModelTied, sample.getFrame(0).getDim());
+
+  // 'e+a' has the transitions and the senones of 'e'.
+  std::string result, result_transp;
+  write_linear_graph(graphFile, {"a", "e", "a"}, "aea");
+  float lprob = decode_linear_graph(
+      graphFile,
+      std::unique_ptr<AcousticModel>(new TiedStatesAcousticModel(nameModelTied)),
+      sample, &result);
+
+  write_linear_graph(graphFile, {"a", "e+a", "a"}, "aea");
+  float lprob_transp = decode_linear_graph(
+      graphFile,
+      std::unique_ptr<AcousticModel>(new TiedStatesAcousticModel(nameModelTied)),
+      sample, &result_transp);
+
+  remove(graphFile.c_str());
+  remove(nameModelTied.c_str());
+
+  ASSERT_GT(lprob, -HUGE_VAL);
+  ASSERT_EQ(lprob_transp, lprob);
+  ASSERT_EQ(result, "aea ");
+  ASSERT_EQ(result_transp, result);
+}
+
+TEST_F(DecoderTests, DecoderDecodeRenumberedSearchGraph) {
+  const float lprob = decoder->decode(sample);
+  const std::string result = decoder->getResult();
+
+  for (int breadth_first = 0; breadth_first < 2; breadth_first++) {
+    std::unique_ptr<SearchGraphLanguageModel> sgraph(
+        new SearchGraphLanguageModel());
+    sgraph->read_model(searchGraphFile);
+    ASSERT_EQ(sgraph->renumberStates(breadth_first
+                                         ? sgraph->getBreadthFirstOrder()
+                                         : sgraph->getDepthFirstOrder()),
+              0);
+    std::unique_ptr<AcousticModel> mixturemodel(
+        new MixtureAcousticModel(nameModelMixture));
+    Decoder renumbered(std::move(sgraph), std::move(mixturemodel));
+    ASSERT_EQ(renumbered.decode(sample), lprob);
+    ASSERT_EQ(renumbered.getResult(), result);
+  }
+}
+
+TEST_F(DecoderTests, DecoderBindSearchGraph) {
+  ASSERT_TRUE(decoder->getUnboundSymbols().empty());
+
+  // 'zz' is not in the model: reported when the decoder is built.
+  const std::string graphFile = "./models/unbound.graph";
+  write_linear_graph(graphFile, {"a", "zz", "a"}, "aza");
+  std::unique_ptr<SearchGraphLanguageModel> sgraph(
+      new SearchGraphLanguageModel());
+  sgraph->read_model(graphFile);
+  std::unique_ptr<AcousticModel> mixturemodel(
+      new MixtureAcousticModel(nameModelMixture));
+  Decoder unbound(std::move(sgraph), std::move(mixturemodel));
+  ASSERT_EQ(unbound.getUnboundSymbols(), std::vector<std::string>{"zz"});
+
+  // 'o' is in the model, but one of its senones is not.
+  const std::string nameModelTied = "./models/unbound.model";
+  write_tied_model(nameModelTied, sample.getFrame(0).getDim());
+  write_linear_graph(graphFile, {"a", "o", "a"}, "aoa");
+  sgraph.reset(new SearchGraphLanguageModel());
+  sgraph->read_model(graphFile);
+  std::unique_ptr<AcousticModel> tiedmodel(
+      new TiedStatesAcousticModel(nameModelTied));
+  Decoder missing(std::move(sgraph), std::move(tiedmodel));
+  ASSERT_EQ(missing.getUnboundSymbols(), std::vector<std::string>{"o"});
+
+  remove(graphFile.c_str());
+  remove(nameModelTied.c_str());
+}
+
 }  // namespace
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
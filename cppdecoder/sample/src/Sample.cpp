@@ -62,11 +62,14 @@ int Sample::write_sample(const std::string &filename) {
 }
 
 int Sample::read_sample(const std::string &filename) {
-  std::ifstream fileI(filename, std::ifstream::in);
+  // Read with a single read, then split into lines in memory.
+  std::string contents;
+  const bool opened = read_file(filename, &contents) == 0;
+  LineCursor fileI(contents);
 
   std::string line;
 
-  if (fileI.is_open()) {
+  if (opened) {
     uint32_t dim, n_frames;
     getline(fileI, line);
 
@@ -77,22 +80,22 @@ int Sample::read_sample(const std::string &filename) {
 
     ss >> dim;
     ss >> temp_n_frames;
-    std::vector<float> values;
+    std::vector<float> values(dim);
 
     frames.reserve(temp_n_frames);
 
     for (uint32_t i = 0; i < temp_n_frames; i++) {
-      getline(fileI, line);
-      values = read_vector<float>(line);
+      const char *begin = nullptr, *end = nullptr;
+      fileI.next(&begin, &end);
+      values.resize(parse_floats(begin, end, values.data(), dim));
       addFrame(values);
+      values.resize(dim);
     }
 
     if (temp_n_frames != num_frames) {
       std::cout << "number of frames differ" << std::endl;
       return 1;
     }
-
-    fileI.close();
   } else {
     std::cout << "Unable to open the file " << filename << " for reading."
               << std::endl;
@@ -6,6 +6,7 @@
 #ifndef SEARCHGRAPHLANGUAGEMODEL_H_
 #define SEARCHGRAPHLANGUAGEMODEL_H_
 
+#include <BinaryModel.h>
 #include <Utils.h>
 
 #include <cmath>
@@ -18,16 +19,31 @@
 #include <unordered_map>
 #include <vector>
 
+/**
+ * Ids reserved in the tables of every graph, so the decoder tells null nodes
+ * and nodes that emit a word by their ids instead of comparing names.
+ */
+const uint32_t SG_NULL_SYMBOL_ID = 0;  // "-"
+const uint32_t SG_NO_WORD_ID = 0;      // "-"
+const uint32_t SG_END_WORD_ID = 1;     // ">", not a word either
+
+/**
+ * @brief State of the search graph, its id is its position: the indices of its
+ * symbol and word in the tables of the graph (see getIdToSym and getIdToWord)
+ * and its edges, [edge_begin, edge_end). The edges of a state are contiguous,
+ * but the ranges do not have to follow the order of the states.
+ */
 struct SearchGraphLanguageModelState {
-  int id;
-  std::string symbol;
-  std::string word;
-  int edge_begin, edge_end;
+  uint32_t symbol_id;
+  uint32_t word_id;
+  uint32_t edge_begin, edge_end;
 };
 
+/**
+ * @brief Edge of the search graph, its id is its position.
+ */
 struct SearchGraphLanguageModelEdge {
-  int id;
-  int dst;
+  uint32_t dst;
   float weight;
 };
 
@@ -39,7 +55,8 @@ class SearchGraphLanguageModel {
    */
   SearchGraphLanguageModel();
   /**
-   * @brief Reads a Search Graph Language model from disk
+   * @brief Reads a Search Graph Language model from disk, either the text
+   * format or the binary one (see write_binary_model).
    *
    * @param[in] filename File location
    * @return int 0 if everything is OK, 1 if there was a problem.
@@ -52,20 +69,108 @@ class SearchGraphLanguageModel {
    * @return int 0 if everything is OK, 1 if there was a problem.
    */
   int write_model(const std::string& filename);
+  /**
+   * The states and edges are written as they are kept in memory, so reading
+   * the binary model maps them instead of parsing them: loading takes the time
+   * to check the ranges of the states and edges, and the graph is shared by
+   * every decoder reading it through the page cache. Only the symbol and word
+   * tables are copied.
+   *
+   * @brief Write a Search Graph Language model in the binary format.
+   *
+   * @param[in] filename File location, overwritten if it exists.
+   * @return int 0 if everything is OK, 1 if there was a problem.
+   */
+  int write_binary_model(const std::string& filename) const;
+  /**
+   * @brief Get an order of the states from a breadth-first search from the
+   * start state, followed by the states it does not reach (also breadth-first,
+   * from each one not visited yet). The states at the same distance from the
+   * start, i.e: the first phonemes of every word, are next to each other.
+   *
+   * @return std::vector<uint32_t> Old id of the state at each position.
+   */
+  std::vector<uint32_t> getBreadthFirstOrder() const;
+  /**
+   * @brief Get an order of the states from a depth-first search (preorder)
+   * from the start state, followed by the states it does not reach. Each
+   * state is followed by the first state it goes to, so the states of a word
+   * in a lexical tree are next to each other.
+   *
+   * @return std::vector<uint32_t> Old id of the state at each position.
+   */
+  std::vector<uint32_t> getDepthFirstOrder() const;
+  /**
+   * The decoder indexes its per-state arrays by state id, so numbering the
+   * states that are expanded together next to each other keeps their states,
+   * edges and entries in those arrays in the same cache lines.
+   *
+   * @brief Renumber the states and rewrite the edges to match: the edges of
+   * each state, in their order, follow the ones of the previous state, and
+   * edges no state uses are dropped. Symbols and words are kept.
+   *
+   * @param[in] order Old id of the state at each position, a permutation of
+   * the states (i.e: from getDepthFirstOrder).
+   * @return int 0 if everything is OK, 1 if there was a problem.
+   */
+  int renumberStates(const std::vector<uint32_t>& order);
   /**
    * @brief Get the symbol with the provided id
    *
    * @param[in] id Symbol's id
-   * @return const std::string& Symbol with this id
+   * @return const std::string& Symbol with this id, empty if there is no state
+   * with this id
    */
-  const std::string& getIdToSym(const int id) { return id_to_symbol[id]; }
+  const std::string& getIdToSym(const int id) const {
+    return static_cast<uint32_t>(id) < nstates
+               ? symbols[sg_lm_states[id].symbol_id]
+               : no_name;
+  }
   /**
    * @brief Get the word with the provided id
    *
    * @param[in] id word's id
-   * @return const std::string& word with this id
+   * @return const std::string& word with this id, empty if there is no state
+   * with this id
    */
-  const std::string& getIdToWord(const int id) { return id_to_word[id]; }
+  const std::string& getIdToWord(const int id) const {
+    return static_cast<uint32_t>(id) < nstates ? words[sg_lm_states[id].word_id]
+                                               : no_name;
+  }
+  /**
+   * @brief Check whether a state is a null node, without symbol, which the
+   * search goes through without consuming frames.
+   *
+   * @param[in] id search graph state's id
+   * @return bool True if its symbol is "-"
+   */
+  bool isNullNode(const uint32_t id) const {
+    return sg_lm_states[id].symbol_id == SG_NULL_SYMBOL_ID;
+  }
+  /**
+   * @brief Check whether reaching a state adds a word to the hypothesis.
+   *
+   * @param[in] id search graph state's id
+   * @return bool True if its word is not "-" nor ">"
+   */
+  bool emitsWord(const uint32_t id) const {
+    return sg_lm_states[id].word_id > SG_END_WORD_ID;
+  }
+  /**
+   * @brief Get the number of different symbols, the size of the symbol table
+   *
+   * @return uint32_t number of symbols
+   */
+  uint32_t getNSymbols() const { return symbols.size(); }
+  /**
+   * @brief Get a symbol of the symbol table
+   *
+   * @param[in] symbol_id symbol's index, see SearchGraphLanguageModelState
+   * @return const std::string& the symbol
+   */
+  const std::string& getSymbol(const uint32_t symbol_id) const {
+    return symbols[symbol_id];
+  }
   /**
    * @brief Get the search graph state with the provided id
    *
@@ -73,7 +178,8 @@ class SearchGraphLanguageModel {
    * @return const SearchGraphLanguageModelState& search graph state with this
    * id
    */
-  const SearchGraphLanguageModelState& getSearchGraphState(const uint32_t id) {
+  const SearchGraphLanguageModelState& getSearchGraphState(
+      const uint32_t id) const {
     return sg_lm_states[id];
   }
   /**
@@ -82,7 +188,8 @@ class SearchGraphLanguageModel {
    * @param[in] id search graph edge's id
    * @return const SearchGraphLanguageModelEdge& search graph state with this id
    */
-  const SearchGraphLanguageModelEdge& getSearchGraphEdge(const uint32_t id) {
+  const SearchGraphLanguageModelEdge& getSearchGraphEdge(
+      const uint32_t id) const {
     return sg_lm_edges[id];
   }
   /**
@@ -111,16 +218,40 @@ class SearchGraphLanguageModel {
   uint32_t getFinalState() const { return final; }
 
  private:
-  std::unordered_map<std::string, int> symbol_to_id;
-  std::unordered_map<int, std::string> id_to_symbol;
+  /**
+   * @brief Read a model written by write_binary_model, its states and edges
+   * stay in the mapped file.
+   *
+   * @param[in] filename File location.
+   * @return int 0 if everything is OK, 1 if there was a problem.
+   */
+  int read_binary_model(const std::string& filename);
+
+  /**
+   * @brief Check that the reserved symbols and words are in place and that
+   * the start and final states, the symbols and words of the states and the
+   * ranges and destinations of the edges exist, so the decoder can follow
+   * them without checks.
+   *
+   * @return int 0 if everything is OK, 1 if there was a problem.
+   */
+  int check_graph() const;
 
-  std::unordered_map<std::string, int> word_to_id;
-  std::unordered_map<int, std::string> id_to_word;
+  // Each different symbol and word once, indexed by the ids of the states,
+  // starting with the reserved ones.
+  std::vector<std::string> symbols;
+  std::vector<std::string> words;
+  std::string no_name;
 
   uint32_t nstates, nedges, start, final;
 
-  std::vector<SearchGraphLanguageModelState> sg_lm_states;
-  std::vector<SearchGraphLanguageModelEdge> sg_lm_edges;
+  // Point to the owned states and edges when read from text or renumbered,
+  // to mapped_file, read-only, when read from binary.
+  const SearchGraphLanguageModelState *sg_lm_states;
+  const SearchGraphLanguageModelEdge *sg_lm_edges;
+  AlignedVector<SearchGraphLanguageModelState> owned_states;
+  AlignedVector<SearchGraphLanguageModelEdge> owned_edges;
+  MappedFile mapped_file;
 };
 
 #endif  // SEARCHGRAPHLANGUAGEMODEL_H_
@@ -5,8 +5,36 @@
 
 #include "SearchGraphLanguageModel.h"
 
+#include <limits>
+
+// Index of name in table, appended the first time it is seen.
+static uint32_t intern(const std::string& name,
+                       std::unordered_map<std::string, uint32_t>* ids,
+                       std::vector<std::string>* table) {
+  auto it = ids->find(name);
+  if (it != ids->end()) return it->second;
+  ids->emplace(name, table->size());
+  table->push_back(name);
+  return table->size() - 1;
+}
+
+// Read a table of at most max names written with putString.
+static int read_names(BinaryModelReader* reader, const uint32_t max,
+                      std::vector<std::string>* names) {
+  const uint32_t n = reader->getU32();
+  if (reader->failed() || n > max) return 1;
+  names->resize(n);
+  for (std::string& name : *names) name = reader->getString();
+  return reader->failed() ? 1 : 0;
+}
+
 SearchGraphLanguageModel::SearchGraphLanguageModel()
-    : nstates(0), nedges(0), start(-1), final(-1) {}
+    : nstates(0),
+      nedges(0),
+      start(-1),
+      final(-1),
+      sg_lm_states(nullptr),
+      sg_lm_edges(nullptr) {}
 
 int SearchGraphLanguageModel::write_model(const std::string& filename) {
   std::cout << "Writing model in " << filename << std::endl;
@@ -19,20 +47,24 @@ int SearchGraphLanguageModel::write_model(const std::string& filename) {
     fileO << "Final " << final << std::endl;
     fileO << "States" << std::endl;
 
-    for (SearchGraphLanguageModelState state : sg_lm_states) {
-      fileO << state.id << " ";
-      if (state.symbol == "-") {
-        fileO << state.symbol << " ";
+    for (uint32_t i = 0; i < nstates; i++) {
+      const SearchGraphLanguageModelState& state = sg_lm_states[i];
+      const std::string& symbol = symbols[state.symbol_id];
+      const std::string& word = words[state.word_id];
+
+      fileO << i << " ";
+      if (symbol == "-") {
+        fileO << symbol << " ";
 
       } else {
-        fileO << "'" << state.symbol << "' ";
+        fileO << "'" << symbol << "' ";
       }
 
-      if (state.word == "-") {
-        fileO << state.word << " ";
+      if (word == "-") {
+        fileO << word << " ";
 
       } else {
-        fileO << "'" << state.word << "' ";
+        fileO << "'" << word << "' ";
       }
 
       fileO << state.edge_begin << " ";
@@ -40,10 +72,10 @@ int SearchGraphLanguageModel::write_model(const std::string& filename) {
     }
 
     fileO << "Edges" << std::endl;
-    for (SearchGraphLanguageModelEdge edge : sg_lm_edges) {
-      fileO << edge.id << " ";
-      fileO << edge.dst << " ";
-      fileO << edge.weight << std::endl;
+    for (uint32_t i = 0; i < nedges; i++) {
+      fileO << i << " ";
+      fileO << sg_lm_edges[i].dst << " ";
+      fileO << sg_lm_edges[i].weight << std::endl;
     }
 
   } else {
@@ -53,7 +85,31 @@ int SearchGraphLanguageModel::write_model(const std::string& filename) {
   return 0;
 }
 
+int SearchGraphLanguageModel::write_binary_model(
+    const std::string& filename) const {
+  std::cout << "Writing binary model in " << filename << std::endl;
+
+  BinaryModelWriter writer;
+  writer.putU32(nstates);
+  writer.putU32(nedges);
+  writer.putU32(start);
+  writer.putU32(final);
+
+  writer.putU32(symbols.size());
+  for (const std::string& symbol : symbols) writer.putString(symbol);
+  writer.putU32(words.size());
+  for (const std::string& word : words) writer.putString(word);
+
+  writer.putU64(writer.putBlock(sg_lm_states, nstates));
+  writer.putU64(writer.putBlock(sg_lm_edges, nedges));
+
+  return writer.write(filename, BinaryModelKind::SearchGraph);
+}
+
 int SearchGraphLanguageModel::read_model(const std::string& filename) {
+  if (BinaryModelReader::isBinaryModel(filename))
+    return read_binary_model(filename);
+
   std::cout << "Reading language model..." << std::endl;
 
   std::ifstream fileI(filename, std::ifstream::in);
@@ -70,9 +126,18 @@ int SearchGraphLanguageModel::read_model(const std::string& filename) {
 
     getline(fileI, line);  // States
 
-    int state_id, edge_begin, edge_end;
+    uint32_t state_id, edge_begin, edge_end;
 
     std::string symbol, word;
+    std::unordered_map<std::string, uint32_t> symbol_ids, word_ids;
+
+    symbols.clear();
+    words.clear();
+    intern("-", &symbol_ids, &symbols);  // SG_NULL_SYMBOL_ID
+    intern("-", &word_ids, &words);      // SG_NO_WORD_ID
+    intern(">", &word_ids, &words);      // SG_END_WORD_ID
+    owned_states.assign(nstates, SearchGraphLanguageModelState());
+    sg_lm_states = owned_states.data();
 
     for (uint32_t i = 0; i < nstates; i++) {
       getline(fileI, line);
@@ -83,6 +148,11 @@ int SearchGraphLanguageModel::read_model(const std::string& filename) {
       ss >> edge_begin;
       ss >> edge_end;
 
+      if (state_id != i) {
+        std::cout << "The state " << i << " is out of order." << std::endl;
+        return 1;
+      }
+
       if (symbol != "-") {
         symbol.erase(0, 1);
         symbol.erase(symbol.size() - 1, symbol.size());
@@ -93,20 +163,18 @@ int SearchGraphLanguageModel::read_model(const std::string& filename) {
         word.erase(word.size() - 1, word.size());
       }
 
-      SearchGraphLanguageModelState state = {state_id, symbol, word, edge_begin,
-                                             edge_end};
-
-      sg_lm_states.push_back(state);
-
-      id_to_symbol[state_id] = symbol;
-      symbol_to_id[symbol] = state_id;
-      id_to_word[state_id] = word;
+      owned_states[i] = {intern(symbol, &symbol_ids, &symbols),
+                         intern(word, &word_ids, &words), edge_begin,
+                         edge_end};
     }
 
     getline(fileI, line);  // Edges
-    int id, dst;
+    uint32_t id, dst;
     float weight;
 
+    owned_edges.assign(nedges, SearchGraphLanguageModelEdge());
+    sg_lm_edges = owned_edges.data();
+
     for (uint32_t i = 0; i < nedges; i++) {
       getline(fileI, line);
       std::istringstream ss(line);
@@ -114,9 +182,12 @@ int SearchGraphLanguageModel::read_model(const std::string& filename) {
       ss >> dst;
       ss >> weight;
 
-      SearchGraphLanguageModelEdge e = {id, dst, weight};
+      if (id != i) {
+        std::cout << "The edge " << i << " is out of order." << std::endl;
+        return 1;
+      }
 
-      sg_lm_edges.push_back(e);
+      owned_edges[i] = {dst, weight};
     }
 
   } else {
@@ -124,5 +195,196 @@ int SearchGraphLanguageModel::read_model(const std::string& filename) {
               << std::endl;
     return 1;
   }
+  return check_graph();
+}
+
+int SearchGraphLanguageModel::read_binary_model(const std::string& filename) {
+  std::cout << "Reading binary language model..." << std::endl;
+
+  // The graph is never written, so it is mapped read-only.
+  BinaryModelReader reader;
+  if (reader.open(filename, BinaryModelKind::SearchGraph,
+                  MapMode::ReadOnly) != 0)
+    return 1;
+  const BinaryModelReader& blocks = reader;
+
+  const uint32_t n_states = reader.getU32();
+  const uint32_t n_edges = reader.getU32();
+  start = reader.getU32();
+  final = reader.getU32();
+
+  // There cannot be more different symbols or words than states, besides the
+  // reserved ones.
+  if (read_names(&reader, n_states + 1, &symbols) != 0 ||
+      read_names(&reader, n_states + 2, &words) != 0) {
+    std::cout << "The symbols or words of " << filename << " are not valid."
+              << std::endl;
+    return 1;
+  }
+
+  const uint64_t states_offset = reader.getU64();
+  const uint64_t edges_offset = reader.getU64();
+  const SearchGraphLanguageModelState* states =
+      blocks.getBlock<SearchGraphLanguageModelState>(states_offset, n_states);
+  const SearchGraphLanguageModelEdge* edges =
+      blocks.getBlock<SearchGraphLanguageModelEdge>(edges_offset, n_edges);
+
+  if (reader.failed()) {
+    std::cout << "The file " << filename << " is not a valid search graph."
+              << std::endl;
+    return 1;
+  }
+
+  nstates = n_states;
+  nedges = n_edges;
+  AlignedVector<SearchGraphLanguageModelState>().swap(owned_states);
+  AlignedVector<SearchGraphLanguageModelEdge>().swap(owned_edges);
+  sg_lm_states = states;
+  sg_lm_edges = edges;
+  mapped_file = reader.release();
+
+  return check_graph();
+}
+
+std::vector<uint32_t> SearchGraphLanguageModel::getBreadthFirstOrder() const {
+  std::vector<uint32_t> order;
+  std::vector<bool> visited(nstates, false);
+  order.reserve(nstates);
+
+  // order is also the queue, the states from head on are not expanded yet.
+  auto visit = [this, &order, &visited](const uint32_t root) {
+    std::size_t head = order.size();
+    visited[root] = true;
+    order.push_back(root);
+    while (head < order.size()) {
+      const SearchGraphLanguageModelState& state = sg_lm_states[order[head++]];
+      for (uint32_t i = state.edge_begin; i < state.edge_end; i++) {
+        const uint32_t dst = sg_lm_edges[i].dst;
+        if (visited[dst]) continue;
+        visited[dst] = true;
+        order.push_back(dst);
+      }
+    }
+  };
+
+  if (start < nstates) visit(start);
+  for (uint32_t s = 0; s < nstates; s++) {
+    if (!visited[s]) visit(s);
+  }
+  return order;
+}
+
+std::vector<uint32_t> SearchGraphLanguageModel::getDepthFirstOrder() const {
+  std::vector<uint32_t> order, pending;
+  std::vector<bool> visited(nstates, false);
+  order.reserve(nstates);
+
+  // A state may be pending more than once, it is visited the first time.
+  auto visit = [this, &order, &pending, &visited](const uint32_t root) {
+    pending.push_back(root);
+    while (!pending.empty()) {
+      const uint32_t s = pending.back();
+      pending.pop_back();
+      if (visited[s]) continue;
+      visited[s] = true;
+      order.push_back(s);
+
+      // In reverse, so the first edge is followed first.
+      const SearchGraphLanguageModelState& state = sg_lm_states[s];
+      for (uint32_t i = state.edge_end; i > state.edge_begin; i--) {
+        const uint32_t dst = sg_lm_edges[i - 1].dst;
+        if (!visited[dst]) pending.push_back(dst);
+      }
+    }
+  };
+
+  if (start < nstates) visit(start);
+  for (uint32_t s = 0; s < nstates; s++) {
+    if (!visited[s]) visit(s);
+  }
+  return order;
+}
+
+int SearchGraphLanguageModel::renumberStates(
+    const std::vector<uint32_t>& order) {
+  if (order.size() != nstates) {
+    std::cout << "The order has " << order.size() << " states, the graph "
+              << nstates << "." << std::endl;
+    return 1;
+  }
+
+  std::vector<uint32_t> new_id(nstates, nstates);
+  uint64_t n_edges = 0;
+  for (uint32_t i = 0; i < nstates; i++) {
+    if (order[i] >= nstates || new_id[order[i]] != nstates) {
+      std::cout << "The order is not a permutation of the states."
+                << std::endl;
+      return 1;
+    }
+    new_id[order[i]] = i;
+    const SearchGraphLanguageModelState& state = sg_lm_states[order[i]];
+    n_edges += state.edge_end - state.edge_begin;
+  }
+
+  if (n_edges > std::numeric_limits<uint32_t>::max()) {
+    std::cout << "The states share too many edges to be renumbered."
+              << std::endl;
+    return 1;
+  }
+
+  AlignedVector<SearchGraphLanguageModelState> states(nstates);
+  AlignedVector<SearchGraphLanguageModelEdge> edges(n_edges);
+
+  uint32_t e = 0;
+  for (uint32_t i = 0; i < nstates; i++) {
+    const SearchGraphLanguageModelState& old_state = sg_lm_states[order[i]];
+    states[i] = {old_state.symbol_id, old_state.word_id, e,
+                 e + (old_state.edge_end - old_state.edge_begin)};
+    for (uint32_t j = old_state.edge_begin; j < old_state.edge_end; j++)
+      edges[e++] = {new_id[sg_lm_edges[j].dst], sg_lm_edges[j].weight};
+  }
+
+  // The old states and edges, owned or mapped, are not needed any more.
+  owned_states.swap(states);
+  owned_edges.swap(edges);
+  sg_lm_states = owned_states.data();
+  sg_lm_edges = owned_edges.data();
+  mapped_file.close();
+  nedges = n_edges;
+  if (start < nstates) start = new_id[start];
+  if (final < nstates) final = new_id[final];
+  return 0;
+}
+
+int SearchGraphLanguageModel::check_graph() const {
+  if (symbols.size() <= SG_NULL_SYMBOL_ID ||
+      symbols[SG_NULL_SYMBOL_ID] != "-" || words.size() <= SG_END_WORD_ID ||
+      words[SG_NO_WORD_ID] != "-" || words[SG_END_WORD_ID] != ">") {
+    std::cout << "The reserved symbols or words are missing." << std::endl;
+    return 1;
+  }
+
+  if (start >= nstates || final >= nstates) {
+    std::cout << "The start or final state does not exist." << std::endl;
+    return 1;
+  }
+
+  for (uint32_t i = 0; i < nstates; i++) {
+    const SearchGraphLanguageModelState& state = sg_lm_states[i];
+    if (state.symbol_id >= symbols.size() || state.word_id >= words.size() ||
+        state.edge_begin > state.edge_end || state.edge_end > nedges) {
+      std::cout << "The state " << i << " is not valid." << std::endl;
+      return 1;
+    }
+  }
+
+  for (uint32_t i = 0; i < nedges; i++) {
+    if (sg_lm_edges[i].dst >= nstates) {
+      std::cout << "The edge " << i << " goes to a state that does not exist."
+                << std::endl;
+      return 1;
+    }
+  }
+
   return 0;
 }
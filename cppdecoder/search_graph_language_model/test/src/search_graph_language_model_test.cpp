@@ -8,6 +8,7 @@
 #include <stdio.h>
 
 #include <iomanip>  // std::setprecision
+#include <set>
 
 #include "gtest/gtest.h"
 
@@ -17,6 +18,7 @@ class SearchGraphLanguageModelTests : public ::testing::Test {
  protected:
   const std::string SearchGraphFile = "./models/2.gram.graph";
   const std::string SearchGraphFileWritten = "./models/2.gram.graph.test";
+  const std::string SearchGraphFileBinary = "./models/2.gram.graph.bin";
 
   std::ifstream fileStreamSearchGraph;
   std::ifstream fileStreamWrittenSearchGraph;
@@ -75,6 +77,125 @@ TEST_F(SearchGraphLanguageModelTests, SearchGraphLanguageModelgetIdToWord) {
   ASSERT_EQ(sgraph.getIdToWord(2546), "empezamos");
 }
 
+TEST_F(SearchGraphLanguageModelTests, SearchGraphLanguageModelNodeFlags) {
+  SearchGraphLanguageModel sgraph;
+  sgraph.read_model(SearchGraphFile);
+
+  ASSERT_EQ(sgraph.getSymbol(SG_NULL_SYMBOL_ID), "-");
+  ASSERT_TRUE(sgraph.isNullNode(0));
+  ASSERT_FALSE(sgraph.emitsWord(0));
+  ASSERT_FALSE(sgraph.isNullNode(592));
+  ASSERT_FALSE(sgraph.emitsWord(592));
+  ASSERT_TRUE(sgraph.isNullNode(2487));
+  ASSERT_TRUE(sgraph.emitsWord(2487));
+
+  // Each different symbol is in the table once.
+  std::set<std::string> symbols;
+  for (uint32_t i = 0; i < sgraph.getNSymbols(); i++)
+    ASSERT_TRUE(symbols.insert(sgraph.getSymbol(i)).second);
+  for (uint32_t i = 0; i < sgraph.getNStates(); i++) {
+    ASSERT_EQ(sgraph.isNullNode(i), sgraph.getIdToSym(i) == "-");
+    ASSERT_EQ(symbols.count(sgraph.getIdToSym(i)), 1);
+  }
+}
+
+TEST_F(SearchGraphLanguageModelTests, SearchGraphLanguageModelBinaryReadWrite) {
+  SearchGraphLanguageModel sgraph;
+  ASSERT_EQ(sgraph.read_model(SearchGraphFile), 0);
+  ASSERT_EQ(sgraph.write_binary_model(SearchGraphFileBinary), 0);
+  ASSERT_TRUE(BinaryModelReader::isBinaryModel(SearchGraphFileBinary));
+
+  SearchGraphLanguageModel binarygraph;
+  ASSERT_EQ(binarygraph.read_model(SearchGraphFileBinary), 0);
+  ASSERT_EQ(binarygraph.getNStates(), sgraph.getNStates());
+  ASSERT_EQ(binarygraph.getNEdges(), sgraph.getNEdges());
+  ASSERT_EQ(binarygraph.getStartState(), sgraph.getStartState());
+  ASSERT_EQ(binarygraph.getFinalState(), sgraph.getFinalState());
+  ASSERT_EQ(binarygraph.getIdToSym(2440), "J^");
+  ASSERT_EQ(binarygraph.getIdToWord(2487), "bueno");
+  ASSERT_EQ(binarygraph.getIdToSym(1500000), "");
+
+  for (uint32_t i = 0; i < sgraph.getNStates(); i++) {
+    ASSERT_EQ(binarygraph.getIdToSym(i), sgraph.getIdToSym(i));
+    ASSERT_EQ(binarygraph.getIdToWord(i), sgraph.getIdToWord(i));
+    ASSERT_EQ(binarygraph.getSearchGraphState(i).edge_begin,
+              sgraph.getSearchGraphState(i).edge_begin);
+    ASSERT_EQ(binarygraph.getSearchGraphState(i).edge_end,
+              sgraph.getSearchGraphState(i).edge_end);
+  }
+  for (uint32_t i = 0; i < sgraph.getNEdges(); i++) {
+    ASSERT_EQ(binarygraph.getSearchGraphEdge(i).dst,
+              sgraph.getSearchGraphEdge(i).dst);
+    ASSERT_EQ(binarygraph.getSearchGraphEdge(i).weight,
+              sgraph.getSearchGraphEdge(i).weight);
+  }
+
+  // An edge to a state that does not exist is rejected.
+  std::fstream file(SearchGraphFileBinary,
+                    std::ios::in | std::ios::out | std::ios::binary);
+  file.seekg(0, std::ios::end);
+  file.seekp(static_cast<std::streamoff>(file.tellg()) - 8);
+  const uint32_t dst = sgraph.getNStates();
+  file.write(reinterpret_cast<const char*>(&dst), sizeof(dst));
+  file.close();
+  SearchGraphLanguageModel corrupted;
+  ASSERT_EQ(corrupted.read_model(SearchGraphFileBinary), 1);
+
+  remove(SearchGraphFileBinary.c_str());
+}
+
+TEST_F(SearchGraphLanguageModelTests, SearchGraphLanguageModelRenumberStates) {
+  SearchGraphLanguageModel sgraph, renumbered;
+  sgraph.read_model(SearchGraphFile);
+  renumbered.read_model(SearchGraphFile);
+
+  const std::vector<uint32_t> order = renumbered.getBreadthFirstOrder();
+  ASSERT_EQ(order.size(), sgraph.getNStates());
+  ASSERT_EQ(order[0], sgraph.getStartState());
+  ASSERT_EQ(renumbered.renumberStates(order), 0);
+  ASSERT_EQ(renumbered.getStartState(), 0);
+  ASSERT_EQ(order[renumbered.getFinalState()], sgraph.getFinalState());
+
+  std::vector<uint32_t> new_id(order.size());
+  for (uint32_t i = 0; i < order.size(); i++) new_id[order[i]] = i;
+
+  // Same states and edges, the edges of each state after the previous ones.
+  uint32_t next_edge = 0;
+  for (uint32_t i = 0; i < renumbered.getNStates(); i++) {
+    const SearchGraphLanguageModelState& state =
+        renumbered.getSearchGraphState(i);
+    const SearchGraphLanguageModelState& old_state =
+        sgraph.getSearchGraphState(order[i]);
+    ASSERT_EQ(renumbered.getIdToSym(i), sgraph.getIdToSym(order[i]));
+    ASSERT_EQ(renumbered.getIdToWord(i), sgraph.getIdToWord(order[i]));
+    ASSERT_EQ(state.edge_begin, next_edge);
+    ASSERT_EQ(state.edge_end - state.edge_begin,
+              old_state.edge_end - old_state.edge_begin);
+    for (uint32_t j = 0; j < state.edge_end - state.edge_begin; j++) {
+      const SearchGraphLanguageModelEdge& edge =
+          renumbered.getSearchGraphEdge(state.edge_begin + j);
+      const SearchGraphLanguageModelEdge& old_edge =
+          sgraph.getSearchGraphEdge(old_state.edge_begin + j);
+      ASSERT_EQ(edge.dst, new_id[old_edge.dst]);
+      ASSERT_EQ(edge.weight, old_edge.weight);
+    }
+    next_edge = state.edge_end;
+  }
+  ASSERT_EQ(renumbered.getNEdges(), next_edge);
+
+  ASSERT_EQ(renumbered.renumberStates({0, 0}), 1);
+
+  // Depth-first, each state is followed by the first state it goes to (if
+  // it was not visited before).
+  const std::vector<uint32_t> depth_order = sgraph.getDepthFirstOrder();
+  ASSERT_EQ(std::set<uint32_t>(depth_order.begin(), depth_order.end()).size(),
+            sgraph.getNStates());
+  ASSERT_EQ(depth_order[0], sgraph.getStartState());
+  const SearchGraphLanguageModelState& start =
+      sgraph.getSearchGraphState(sgraph.getStartState());
+  ASSERT_EQ(depth_order[1], sgraph.getSearchGraphEdge(start.edge_begin).dst);
+}
+
 }  // namespace
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2020 Javier Jorge. All rights reserved.
+ * License: https://github.com/JJorgeDSIC/CppDecoder#license
+ */
+
+#include <MixtureAcousticModel.h>
+#include <Utils.h>
+
+#include <chrono>
+#include <locale>
+
+/**
+ * Times the parsing of the numbers of a text model with a stream (what
+ * read_vector did before parse_float) and with read_vector, then the load of
+ * the whole model:
+ *
+ * BenchmarkModelLoading <mixture model> [repetitions]
+ */
+
+static double elapsed_ms(const std::chrono::steady_clock::time_point &start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+static std::vector<float> stream_read_vector(const std::string &line) {
+  std::istringstream stm(line);
+  return {std::istream_iterator<float>(stm), std::istream_iterator<float>()};
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::cout << "Usage: " << argv[0] << " <mixture model> [repetitions]"
+              << std::endl;
+    return 1;
+  }
+
+  const std::string model_file = argv[1];
+  uint32_t repetitions = 5;
+  if (argc > 2) std::stringstream(argv[2]) >> repetitions;
+
+  std::string contents;
+  if (read_file(model_file, &contents) != 0) {
+    std::cout << "Unable to open the file " << model_file << " for reading."
+              << std::endl;
+    return 1;
+  }
+
+  // The lines with the values of the Gaussians, without their tag.
+  std::vector<std::string> lines;
+  std::istringstream fileI(contents);
+  std::string line;
+  while (getline(fileI, line)) {
+    if (line.compare(0, 3, "MU ") == 0 || line.compare(0, 4, "VAR ") == 0)
+      lines.push_back(line.substr(line.find(' ') + 1));
+  }
+
+  std::size_t n_values = 0, mismatches = 0;
+  double stream_ms = 0.0, parser_ms = 0.0;
+
+  for (uint32_t r = 0; r < repetitions; r++) {
+    std::vector<std::vector<float>> expected(lines.size());
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < lines.size(); i++)
+      expected[i] = stream_read_vector(lines[i]);
+    stream_ms += elapsed_ms(start);
+
+    std::vector<std::vector<float>> values(lines.size());
+    start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < lines.size(); i++)
+      values[i] = read_vector<float>(lines[i]);
+    parser_ms += elapsed_ms(start);
+
+    if (r > 0) continue;
+    for (std::size_t i = 0; i < lines.size(); i++) {
+      n_values += values[i].size();
+      if (values[i] != expected[i]) mismatches++;
+    }
+  }
+
+  std::cout << lines.size() << " lines, " << n_values << " values"
+            << std::endl;
+  std::cout << "Stream parsing: " << stream_ms / repetitions << " ms"
+            << std::endl;
+  std::cout << "read_vector: " << parser_ms / repetitions << " ms"
+            << std::endl;
+  std::cout << "Lines parsed differently: " << mismatches << std::endl;
+
+  double load_ms = 0.0;
+  for (uint32_t r = 0; r < repetitions; r++) {
+    auto start = std::chrono::steady_clock::now();
+    MixtureAcousticModel model(model_file);
+    load_ms += elapsed_ms(start);
+  }
+  std::cout << "Model load: " << load_ms / repetitions << " ms" << std::endl;
+
+  return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+/*
+ * Copyright 2020 Javier Jorge. All rights reserved.
+ * License: https://github.com/JJorgeDSIC/CppDecoder#license
+ */
+
+#include <Decoder.h>
+#include <MixtureAcousticModel.h>
+#include <Sample.h>
+#include <SearchGraphLanguageModel.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Decodes a sample with the states of the search graph in their original
+ * order, in breadth-first order and in depth-first order (see
+ * SearchGraphLanguageModel::renumberStates), reporting how far the edges jump
+ * in each numbering, the decoding time and, where the kernel allows it, the
+ * cache misses:
+ *
+ * BenchmarkSearchGraphOrder <graph> <mixture model> <sample> [repetitions]
+ */
+
+static double elapsed_ms(const std::chrono::steady_clock::time_point &start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// Counter of the cache misses of this thread, -1 if it is not available.
+static int open_cache_miss_counter() {
+#ifdef __linux__
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = PERF_COUNT_HW_CACHE_MISSES;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+  return -1;
+#endif
+}
+
+static void start_counter(const int fd) {
+#ifdef __linux__
+  if (fd < 0) return;
+  ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+  ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+}
+
+static uint64_t stop_counter(const int fd) {
+  uint64_t count = 0;
+#ifdef __linux__
+  if (fd < 0) return 0;
+  ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  if (read(fd, &count, sizeof(count)) != sizeof(count)) count = 0;
+#endif
+  return count;
+}
+
+// Mean distance between the id of a state and the ids its edges go to, and
+// fraction of edges to a state in the same cache line of states or the next.
+static void edge_distances(const SearchGraphLanguageModel &sgraph,
+                           double *mean, double *near) {
+  const uint32_t line_states = 64 / sizeof(SearchGraphLanguageModelState);
+  double distance = 0.0, n_near = 0.0;
+  for (uint32_t s = 0; s < sgraph.getNStates(); s++) {
+    const SearchGraphLanguageModelState &state = sgraph.getSearchGraphState(s);
+    for (uint32_t i = state.edge_begin; i < state.edge_end; i++) {
+      const uint32_t dst = sgraph.getSearchGraphEdge(i).dst;
+      const uint32_t d = dst > s ? dst - s : s - dst;
+      distance += d;
+      if (d <= line_states) n_near++;
+    }
+  }
+  const uint32_t n = std::max(sgraph.getNEdges(), 1u);
+  *mean = distance / n;
+  *near = n_near / n;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 4) {
+    std::cout << "Usage: " << argv[0]
+              << " <graph> <mixture model> <sample> [repetitions]"
+              << std::endl;
+    return 1;
+  }
+
+  const std::string graph_file = argv[1];
+  const std::string model_file = argv[2];
+  uint32_t repetitions = 5;
+  if (argc > 4) std::stringstream(argv[4]) >> repetitions;
+
+  Sample sample;
+  if (sample.read_sample(argv[3]) != 0) return 1;
+
+  const int counter = open_cache_miss_counter();
+  const char *names[] = {"Original order", "Breadth-first order",
+                         "Depth-first order"};
+  float lprobs[3];
+  std::string results[3];
+  bool same = true;
+
+  for (int o = 0; o < 3; o++) {
+    std::unique_ptr<SearchGraphLanguageModel> sgraph(
+        new SearchGraphLanguageModel());
+    if (sgraph->read_model(graph_file) != 0) return 1;
+    if (o > 0) {
+      const std::vector<uint32_t> order = o == 1
+                                              ? sgraph->getBreadthFirstOrder()
+                                              : sgraph->getDepthFirstOrder();
+      if (sgraph->renumberStates(order) != 0) return 1;
+    }
+    double distance, near;
+    edge_distances(*sgraph, &distance, &near);
+
+    std::unique_ptr<AcousticModel> amodel(new MixtureAcousticModel(model_file));
+    Decoder decoder(std::move(sgraph), std::move(amodel));
+
+    double decode_ms = 0.0;
+    uint64_t misses = 0;
+    for (uint32_t r = 0; r < repetitions; r++) {
+      decoder.resetDecoder();
+      start_counter(counter);
+      auto start = std::chrono::steady_clock::now();
+      lprobs[o] = decoder.decode(sample);
+      decode_ms += elapsed_ms(start);
+      misses += stop_counter(counter);
+    }
+    results[o] = decoder.getResult();
+    same = same && lprobs[o] == lprobs[0] && results[o] == results[0];
+
+    std::cout << names[o] << ": mean edge distance " << distance << ", "
+              << 100.0 * near << "% of edges within a cache line, decoding "
+              << decode_ms / repetitions << " ms, cache misses ";
+    if (counter < 0)
+      std::cout << "not available";
+    else
+      std::cout << misses / repetitions;
+    std::cout << std::endl;
+  }
+
+#ifdef __linux__
+  if (counter >= 0) close(counter);
+#endif
+
+  std::cout << "Same result: " << (same ? "yes" : "no") << std::endl;
+  return same ? 0 : 1;
+}
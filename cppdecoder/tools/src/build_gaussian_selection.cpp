@@ -0,0 +1,73 @@
+/*
+ * Copyright 2020 Javier Jorge. All rights reserved.
+ * License: https://github.com/JJorgeDSIC/CppDecoder#license
+ */
+
+#include <GaussianSelection.h>
+#include <MixtureAcousticModel.h>
+#include <TiedStatesAcousticModel.h>
+#include <Utils.h>
+
+#include <memory>
+
+/**
+ * Builds the Gaussian selection codebook and shortlists of a mixture or tied
+ * states model:
+ *
+ * BuildGaussianSelection <model> <output> [codewords] [beam] [iterations]
+ *
+ * The output is read with read_gaussian_selection on the same model.
+ */
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    std::cout << "Usage: " << argv[0]
+              << " <model> <output> [codewords] [beam] [iterations]"
+              << std::endl;
+    return 1;
+  }
+
+  const std::string model_file = argv[1];
+  const std::string output_file = argv[2];
+  uint32_t n_codewords = GS_DEFAULT_CODEWORDS;
+  float beam = GS_DEFAULT_BEAM;
+  uint32_t iterations = GS_DEFAULT_ITERATIONS;
+
+  if (argc > 3) std::stringstream(argv[3]) >> n_codewords;
+  if (argc > 4) std::stringstream(argv[4]) >> beam;
+  if (argc > 5) std::stringstream(argv[5]) >> iterations;
+
+  // The second line of the model tells its type.
+  std::ifstream fileI(model_file, std::ifstream::in);
+  std::string line;
+  if (!fileI.is_open()) {
+    std::cout << "Unable to open the file " << model_file << " for reading."
+              << std::endl;
+    return 1;
+  }
+  getline(fileI, line);  // AMODEL
+  getline(fileI, line);  // Mixture / TiedStates
+  fileI.close();
+
+  GaussianSelection gselection;
+  int result;
+
+  if (line == "Mixture") {
+    MixtureAcousticModel model(model_file);
+    result = gselection.build(model.getSenoneStates(), n_codewords, beam,
+                              iterations);
+  } else if (line == "TiedStates") {
+    TiedStatesAcousticModel model(model_file);
+    result = gselection.build(model.getSenoneStates(), n_codewords, beam,
+                              iterations);
+  } else {
+    std::cout << "Unsupported model type: " << line << std::endl;
+    return 1;
+  }
+
+  if (result != 0) return result;
+
+  std::cout << gselection.getNCodewords() << " codewords for "
+            << gselection.getNSenones() << " senones" << std::endl;
+
+  return gselection.write_selection(output_file);
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright 2020 Javier Jorge. All rights reserved.
+ * License: https://github.com/JJorgeDSIC/CppDecoder#license
+ */
+
+#include <SearchGraphLanguageModel.h>
+
+#include <cstdio>
+
+/**
+ * Renumbers the states of a search graph in depth-first (default) or
+ * breadth-first order from the start state and writes it, as text or as a
+ * binary graph:
+ *
+ * RenumberSearchGraph <graph> <renumbered graph> [depth|breadth] [binary]
+ */
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    std::cout << "Usage: " << argv[0]
+              << " <graph> <renumbered graph> [depth|breadth] [binary]"
+              << std::endl;
+    return 1;
+  }
+
+  const std::string graph_file = argv[1];
+  const std::string output_file = argv[2];
+  bool breadth_first = false, binary = false;
+  for (int i = 3; i < argc; i++) {
+    const std::string option = argv[i];
+    if (option == "breadth") {
+      breadth_first = true;
+    } else if (option == "binary") {
+      binary = true;
+    } else if (option != "depth") {
+      std::cout << "Unknown option " << option << "." << std::endl;
+      return 1;
+    }
+  }
+
+  SearchGraphLanguageModel sgraph;
+  if (sgraph.read_model(graph_file) != 0) return 1;
+
+  const std::vector<uint32_t> order = breadth_first
+                                          ? sgraph.getBreadthFirstOrder()
+                                          : sgraph.getDepthFirstOrder();
+  if (sgraph.renumberStates(order) != 0) return 1;
+
+  if (binary) return sgraph.write_binary_model(output_file);
+
+  // write_model appends to the file.
+  std::remove(output_file.c_str());
+  return sgraph.write_model(output_file);
+}
@@ -0,0 +1,218 @@
+/*
+ * Copyright 2020 Javier Jorge. All rights reserved.
+ * License: https://github.com/JJorgeDSIC/CppDecoder#license
+ */
+
+#ifndef BINARYMODEL_H_
+#define BINARYMODEL_H_
+
+#include <Utils.h>
+
+#include <limits>
+#include <string>
+#include <vector>
+
+/**
+ * First bytes of a binary model, acoustic models or search graphs (the kind in
+ * the header tells them apart). Text acoustic models start with "AMODEL" and
+ * text search graphs with "SG".
+ */
+const char BINARY_MODEL_MAGIC[8] = {'A', 'M', 'O', 'D', 'E', 'L', 'B', 'N'};
+
+/**
+ * Version of the layout, models written with another one are rejected.
+ */
+const uint32_t BINARY_MODEL_VERSION = 1;
+
+/**
+ * Written in the native byte order, so a model written on a machine with the
+ * other byte order is rejected instead of misread.
+ */
+const uint32_t BINARY_MODEL_BYTE_ORDER = 0x01020304;
+
+enum class BinaryModelKind : uint32_t {
+  Mixture = 1,
+  TiedStates = 2,
+  SearchGraph = 3
+};
+
+/**
+ * @brief Header of a binary model. The file is the header, the metadata
+ * (sizes, names, transitions and weights, parsed when the model is read) and
+ * the data: arrays in blocks aligned to PARAMS_ALIGNMENT (the Gaussian
+ * parameters, the states and edges of a search graph), laid out exactly as the
+ * model keeps them in memory, so they are used in place from the mapped file.
+ * The checksum covers the header and the metadata, not the data: checking it
+ * would read the whole model before the first frame is decoded.
+ */
+struct BinaryModelHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t kind;
+  uint32_t alignment;
+  uint64_t meta_offset;
+  uint64_t meta_bytes;
+  uint64_t data_offset;
+  uint64_t data_bytes;
+  // FNV-1a of the header, with the checksum set to 0, and the metadata.
+  uint64_t checksum;
+};
+
+/**
+ * @brief Builds a binary model in memory, then writes it.
+ */
+class BinaryModelWriter {
+ public:
+  void putU32(const uint32_t value) { putBytes(&value, sizeof(value)); }
+
+  void putU64(const uint64_t value) { putBytes(&value, sizeof(value)); }
+
+  void putFloat(const float value) { putBytes(&value, sizeof(value)); }
+
+  void putString(const std::string &value);
+
+  void putFloats(const std::vector<float> &values);
+
+  /**
+   * @brief Append values to the data, starting at an aligned offset.
+   *
+   * @tparam T Type of the values, trivially copyable.
+   * @param[in] values First value.
+   * @param[in] n Number of values.
+   * @return uint64_t The offset of the block in the data.
+   */
+  template <typename T>
+  uint64_t putBlock(const T *values, const std::size_t n) {
+    return putBytesBlock(values, n * sizeof(T));
+  }
+
+  /**
+   * @brief Write the model.
+   *
+   * @param[in] filename File location, overwritten if it exists.
+   * @param[in] kind Acoustic model that reads it.
+   * @return int 0 if everything is OK, 1 if there was a problem.
+   */
+  int write(const std::string &filename, const BinaryModelKind kind) const;
+
+ private:
+  void putBytes(const void *bytes, const std::size_t n);
+
+  uint64_t putBytesBlock(const void *bytes, const std::size_t n);
+
+  std::vector<char> meta;
+  std::vector<char> data;
+};
+
+/**
+ * @brief Maps a binary model and reads its metadata in order. A read
+ * past the end of the metadata returns zeros and sets failed(), so the caller
+ * checks it once after a group of reads.
+ */
+class BinaryModelReader {
+ public:
+  BinaryModelReader();
+
+  /**
+   * @brief Check whether a file is a binary model.
+   *
+   * @param[in] filename File location.
+   * @return bool True if it starts with BINARY_MODEL_MAGIC.
+   */
+  static bool isBinaryModel(const std::string &filename);
+
+  /**
+   * @brief Map a model and check its header and checksum.
+   *
+   * @param[in] filename File location.
+   * @param[in] kind Model expected.
+   * @param[in] mode Whether the blocks can be written (see getBlock).
+   * @return int 0 if everything is OK, 1 if there was a problem.
+   */
+  int open(const std::string &filename, const BinaryModelKind kind,
+           const MapMode mode = MapMode::CopyOnWrite);
+
+  uint32_t getU32();
+
+  uint64_t getU64();
+
+  float getFloat();
+
+  std::string getString();
+
+  std::vector<float> getFloats();
+
+  /**
+   * @brief Get the number of items that follow in the metadata, so that it can
+   * size an allocation: a count larger than the metadata left could hold is
+   * an error.
+   *
+   * @param[in] item_bytes Fewest metadata bytes an item takes.
+   * @return uint32_t The count, 0 (and failed()) if there is no room for it.
+   */
+  uint32_t getCount(const std::size_t item_bytes);
+
+  /**
+   * @brief Get a block of the data, in the mapped file.
+   *
+   * @tparam T Type of the values.
+   * @param[in] offset Offset of the block in the data, from putBlock.
+   * @param[in] n Number of values.
+   * @return T* The block, nullptr (and failed()) if it is not aligned, not
+   * inside the data or the file is mapped read-only.
+   */
+  template <typename T>
+  T *getBlock(const uint64_t offset, const std::size_t n) {
+    if (!file.isWritable()) {
+      error = true;
+      return nullptr;
+    }
+    const BinaryModelReader &reader = *this;
+    return const_cast<T *>(reader.getBlock<T>(offset, n));
+  }
+
+  /**
+   * @brief Get a block of the data, in the mapped file, to be only read.
+   *
+   * @tparam T Type of the values.
+   * @param[in] offset Offset of the block in the data, from putBlock.
+   * @param[in] n Number of values.
+   * @return const T* The block, nullptr (and failed()) if it is not aligned or
+   * not inside the data.
+   */
+  template <typename T>
+  const T *getBlock(const uint64_t offset, const std::size_t n) const {
+    if (n > std::numeric_limits<std::size_t>::max() / sizeof(T)) {
+      error = true;
+      return nullptr;
+    }
+    return reinterpret_cast<const T *>(getBytesBlock(offset, n * sizeof(T)));
+  }
+
+  bool failed() const { return error; }
+
+  /**
+   * @brief Hand the mapped file over to the model, which keeps it as long as
+   * it uses the blocks.
+   *
+   * @return MappedFile The mapping.
+   */
+  MappedFile release() { return std::move(file); }
+
+ private:
+  void getBytes(void *bytes, const std::size_t n);
+
+  const char *getBytesBlock(const uint64_t offset, const std::size_t n) const;
+
+  MappedFile file;
+  const char *meta;
+  uint64_t meta_bytes;
+  uint64_t pos;
+  const char *data;
+  uint64_t data_bytes;
+  // Set by the const getBlock too, like the state of a stream.
+  mutable bool error;
+};
+
+#endif  // BINARYMODEL_H_
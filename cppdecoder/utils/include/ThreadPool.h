@@ -0,0 +1,79 @@
+/*
+ * Copyright 2020 Javier Jorge. All rights reserved.
+ * License: https://github.com/JJorgeDSIC/CppDecoder#license
+ */
+
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Persistent pool of worker threads. The workers are created once and
+ * sleep between runs, so a run only costs waking them up and waiting for them
+ * at the end, which makes it cheap enough to be used for every frame.
+ */
+class ThreadPool {
+ public:
+  /**
+   * @brief Start the workers.
+   *
+   * @param[in] n_threads Threads taking part in each run, counting the one
+   * that calls run, so n_threads - 1 workers are created.
+   */
+  explicit ThreadPool(const uint32_t n_threads);
+
+  /**
+   * @brief Stop and join the workers.
+   */
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  /**
+   * @brief Get the number of threads taking part in each run.
+   *
+   * @return uint32_t The number of threads.
+   */
+  uint32_t getNThreads() const { return workers.size() + 1; }
+
+  /**
+   * @brief Call task(i) for every i in [0, n_tasks), spread over the workers
+   * and the calling thread, and return once every call has finished.
+   *
+   * @param[in] n_tasks Number of tasks.
+   * @param[in] task Task to call with each index, from several threads at
+   * once.
+   */
+  void run(const uint32_t n_tasks, const std::function<void(uint32_t)> &task);
+
+ private:
+  void work();
+
+  void do_tasks();
+
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable start_cv;
+  std::condition_variable done_cv;
+
+  // Current run: the workers take the next task index until n_tasks.
+  const std::function<void(uint32_t)> *task = nullptr;
+  uint32_t n_tasks = 0;
+  std::atomic<uint32_t> next_task;
+
+  // Incremented by each run, so the workers know there is a new one.
+  uint64_t generation = 0;
+  // Workers still inside the current run.
+  uint32_t running = 0;
+  bool stop = false;
+};
+
+#endif  // THREADPOOL_H_
@@ -7,16 +7,298 @@
 #define UTILS_H_
 
 #include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <iterator>
+#include <new>
 #include <sstream>
 #include <string>
+#include <utility>
 #include <vector>
 
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
 const float LOG2PI = 1.83787706641f;
 const float LOGEPS = -36.0437;
 
+/**
+ * Alignment (in bytes) of the packed model parameters: a cache line, which is
+ * also the width of the widest SIMD registers in use.
+ */
+const std::size_t PARAMS_ALIGNMENT = 64;
+
+/**
+ * @brief Allocator that returns memory aligned to Alignment bytes, to be used
+ * with std::vector for the parameters read by SIMD kernels.
+ *
+ * @tparam T Type of the elements.
+ * @tparam Alignment Alignment in bytes, a power of two.
+ */
+template <typename T, std::size_t Alignment = PARAMS_ALIGNMENT>
+class AlignedAllocator {
+ public:
+  typedef T value_type;
+
+  template <typename U>
+  struct rebind {
+    typedef AlignedAllocator<U, Alignment> other;
+  };
+
+  AlignedAllocator() noexcept {}
+
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment> &) noexcept {}
+
+  T *allocate(const std::size_t n) {
+    if (n == 0) return nullptr;
+    void *ptr = nullptr;
+#ifdef _WIN32
+    ptr = _aligned_malloc(n * sizeof(T), Alignment);
+#else
+    if (posix_memalign(&ptr, Alignment, n * sizeof(T)) != 0) ptr = nullptr;
+#endif
+    if (ptr == nullptr) throw std::bad_alloc();
+    return static_cast<T *>(ptr);
+  }
+
+  void deallocate(T *ptr, const std::size_t) noexcept {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+  }
+
+  template <typename U>
+  bool operator==(const AlignedAllocator<U, Alignment> &) const noexcept {
+    return true;
+  }
+
+  template <typename U>
+  bool operator!=(const AlignedAllocator<U, Alignment> &) const noexcept {
+    return false;
+  }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+/**
+ * @brief Aligned array that either owns its values, kept in an AlignedVector,
+ * or views values aligned to PARAMS_ALIGNMENT that belong to someone else
+ * (i.e: the parameters of a mapped model file, see MappedFile), who must
+ * outlive it. Elements are read through a plain pointer in both cases.
+ * Resizing or clearing a view first turns it into an owned array; writing
+ * through operator[] writes into the viewed memory.
+ *
+ * @tparam T Type of the elements.
+ */
+template <typename T>
+class AlignedArray {
+ public:
+  AlignedArray() : values(nullptr), length(0), is_view(false) {}
+
+  AlignedArray(const AlignedArray &other)
+      : owned(other.owned), length(other.length), is_view(other.is_view) {
+    values = is_view ? other.values : owned.data();
+  }
+
+  AlignedArray(AlignedArray &&other) noexcept : AlignedArray() { swap(other); }
+
+  AlignedArray &operator=(AlignedArray other) {
+    swap(other);
+    return *this;
+  }
+
+  void swap(AlignedArray &other) noexcept {
+    // Swapping the vectors keeps their buffers, so the pointers stay valid.
+    owned.swap(other.owned);
+    std::swap(values, other.values);
+    std::swap(length, other.length);
+    std::swap(is_view, other.is_view);
+  }
+
+  /**
+   * @brief Drop the owned values and view size values at data instead.
+   *
+   * @param[in] data First value, aligned to PARAMS_ALIGNMENT.
+   * @param[in] size Number of values.
+   */
+  void view(T *data, const std::size_t size) {
+    AlignedVector<T>().swap(owned);
+    values = data;
+    length = size;
+    is_view = true;
+  }
+
+  bool isView() const { return is_view; }
+
+  void resize(const std::size_t size, const T &value = T()) {
+    own();
+    owned.resize(size, value);
+    sync();
+  }
+
+  void assign(const std::size_t size, const T &value) {
+    is_view = false;
+    owned.assign(size, value);
+    sync();
+  }
+
+  void clear() {
+    is_view = false;
+    owned.clear();
+    sync();
+  }
+
+  T *data() { return values; }
+  const T *data() const { return values; }
+  std::size_t size() const { return length; }
+  bool empty() const { return length == 0; }
+  T &operator[](const std::size_t i) { return values[i]; }
+  const T &operator[](const std::size_t i) const { return values[i]; }
+  T *begin() { return values; }
+  T *end() { return values + length; }
+  const T *begin() const { return values; }
+  const T *end() const { return values + length; }
+
+ private:
+  // Copy the viewed values into owned memory.
+  void own() {
+    if (!is_view) return;
+    owned.assign(values, values + length);
+    is_view = false;
+    sync();
+  }
+
+  void sync() {
+    values = owned.data();
+    length = owned.size();
+  }
+
+  AlignedVector<T> owned;
+  T *values;
+  std::size_t length;
+  bool is_view;
+};
+
+/**
+ * @brief How a file is mapped: read-only, so a write through the mapping
+ * faults, or privately writable, so a write copies the page written and never
+ * reaches the file.
+ */
+enum class MapMode { ReadOnly, CopyOnWrite };
+
+/**
+ * @brief A whole file mapped in memory: the pages are read from the file the
+ * first time they are touched. Mapped copy-on-write, writing to them (i.e: to
+ * reorder the parameters of a model in place) copies only the pages written,
+ * never the file. Without mmap (Windows) the file is read into memory instead,
+ * always writable.
+ */
+class MappedFile {
+ public:
+  MappedFile();
+
+  ~MappedFile();
+
+  MappedFile(MappedFile &&other) noexcept;
+
+  MappedFile &operator=(MappedFile &&other) noexcept;
+
+  MappedFile(const MappedFile &) = delete;
+
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  /**
+   * @brief Map a file, unmapping the one mapped before.
+   *
+   * @param[in] filename File location.
+   * @param[in] mode Whether the mapping can be written.
+   * @return int 0 if everything is OK, 1 if there was a problem (the file
+   * does not exist or is empty).
+   */
+  int open(const std::string &filename,
+           const MapMode mode = MapMode::CopyOnWrite);
+
+  void close();
+
+  bool isOpen() const { return addr != nullptr; }
+
+  bool isWritable() const { return writable; }
+
+  /**
+   * @brief Get the first byte of the file, aligned to a page.
+   */
+  char *data() const { return addr; }
+
+  std::size_t size() const { return length; }
+
+ private:
+  char *addr;
+  std::size_t length;
+  bool writable;
+#ifdef _WIN32
+  AlignedVector<char> buffer;
+#endif
+};
+
+/**
+ * @brief 64-bit FNV-1a hash of a range of bytes.
+ *
+ * @param[in] data First byte.
+ * @param[in] n Number of bytes.
+ * @param[in] hash Hash of the bytes before, to hash several ranges as one.
+ * @return uint64_t The hash.
+ */
+uint64_t fnv1a_hash(const void *data, const std::size_t n,
+                    uint64_t hash = 14695981039346656037ULL);
+
+/**
+ * @brief Get the number of elements of a padded row, so every row of a packed
+ * matrix starts aligned to PARAMS_ALIGNMENT.
+ *
+ * @param[in] dim Number of elements in the row.
+ * @return uint32_t dim rounded up to a multiple of the floats per alignment.
+ */
+inline uint32_t aligned_stride(const uint32_t dim) {
+  const uint32_t n = PARAMS_ALIGNMENT / sizeof(float);
+  return (dim + n - 1) / n * n;
+}
+
+/**
+ * @brief Read-only view of a contiguous range of values that belong to a
+ * larger structure (i.e: a row of a packed matrix). It can be copied into a
+ * std::vector when an owned copy is required.
+ *
+ * @tparam T Type of the elements.
+ */
+template <typename T>
+class VectorView {
+ public:
+  VectorView(const T *data, const std::size_t size)
+      : values(data), length(size) {}
+
+  const T *data() const { return values; }
+  std::size_t size() const { return length; }
+  const T &operator[](const std::size_t i) const { return values[i]; }
+  const T *begin() const { return values; }
+  const T *end() const { return values + length; }
+
+  operator std::vector<T>() const {
+    return std::vector<T>(values, values + length);
+  }
+
+ private:
+  const T *values;
+  std::size_t length;
+};
+
 template <typename T>
 std::vector<T> read_vector(const std::string &line);
 
@@ -35,6 +317,175 @@ std::vector<T> read_vector(const std::string &line) {
   return {std::istream_iterator<T>(stm), std::istream_iterator<T>()};
 }
 
+/**
+ * @brief read_vector for floats, with parse_float instead of a stream.
+ */
+template <>
+std::vector<float> read_vector<float>(const std::string &line);
+
+/**
+ * Decimal numbers with up to 19 significant digits and exponents up to 22
+ * (every number written by the models and samples) are converted with a
+ * single exact double operation, longer ones go through a stream with the
+ * classic locale. Either way the result does not depend on the locale.
+ *
+ * @brief Parse the next float of a buffer, skipping the whitespace before it.
+ *
+ * @param[in] begin First character.
+ * @param[in] end One past the last character.
+ * @param[out] value The number.
+ * @return const char* One past the number, or nullptr if the next characters
+ * are not a number (or there are none).
+ */
+const char *parse_float(const char *begin, const char *end, float *value);
+
+/**
+ * @brief Parse up to n whitespace separated floats into a buffer.
+ *
+ * @param[in] begin First character.
+ * @param[in] end One past the last character.
+ * @param[out] values Room for n values.
+ * @param[in] n Number of values wanted.
+ * @return uint32_t The number of values parsed, less than n if a character
+ * that is not part of a number or the end of the buffer came first.
+ */
+uint32_t parse_floats(const char *begin, const char *end, float *values,
+                      const uint32_t n);
+
+inline uint32_t parse_floats(const std::string &line, float *values,
+                             const uint32_t n) {
+  return parse_floats(line.data(), line.data() + line.size(), values, n);
+}
+
+/**
+ * @brief Read a whole file with a single read.
+ *
+ * @param[in] filename File location.
+ * @param[out] contents The bytes of the file.
+ * @return int 0 if everything is OK, 1 if there was a problem.
+ */
+int read_file(const std::string &filename, std::string *contents);
+
+/**
+ * @brief Cursor over the lines of a buffer (i.e: a file read by read_file),
+ * so it is split in place instead of through a stream over a copy of it.
+ */
+class LineCursor {
+ public:
+  LineCursor(const char *begin, const char *end) : p(begin), end(end) {}
+
+  explicit LineCursor(const std::string &contents)
+      : LineCursor(contents.data(), contents.data() + contents.size()) {}
+
+  /**
+   * @brief Move past the next delimiter, or to the end of the buffer if there
+   * is none.
+   *
+   * @param[out] line_begin First character before the delimiter.
+   * @param[out] line_end One past the last character before the delimiter.
+   * @param[in] delim Delimiter.
+   * @return bool false if the cursor was already at the end of the buffer.
+   */
+  bool next(const char **line_begin, const char **line_end,
+            const char delim = '\n');
+
+  /**
+   * @brief Move past the next n lines.
+   */
+  void skip_lines(const uint32_t n);
+
+  /**
+   * @brief Get the first character not read yet.
+   */
+  const char *position() const { return p; }
+
+ private:
+  const char *p;
+  const char *end;
+};
+
+/**
+ * @brief std::getline for a LineCursor.
+ */
+inline bool getline(LineCursor &cursor, std::string &line,
+                    const char delim = '\n') {
+  const char *begin, *end;
+  if (!cursor.next(&begin, &end, delim)) return false;
+  line.assign(begin, end);
+  return true;
+}
+
+/**
+ * Bound of the relative error of fast_exp in [-87, 88] (the measured maximum
+ * over every float in that range is 2.6e-7). Once inside a log-sum-exp it is
+ * also the bound of the absolute error of the result.
+ */
+const float FAST_EXP_TOLERANCE = 5e-7;
+
+/**
+ * How the exponentials of a log-sum-exp (robust_add) are computed.
+ */
+enum class LogAddMode {
+  Exact,    // std::exp, the reference.
+  FastExp,  // fast_exp, branch-free so the sum vectorizes.
+  Max       // Only the largest term (Viterbi approximation), no exp or log.
+};
+
+/**
+ * @brief Approximation of exp(x): x = k*ln(2) + r, with |r| <= ln(2)/2, and
+ * exp(r) is a degree 6 polynomial. Relative error below FAST_EXP_TOLERANCE;
+ * inputs below -87 return 0 and inputs over 88 are clamped.
+ *
+ * @param[in] x Exponent.
+ * @return float exp(x).
+ */
+inline float fast_exp(const float x) {
+  const float xc = x > 88.0f ? 88.0f : (x < -87.0f ? -87.0f : x);
+  // Truncation of a positive value: k = round(xc / ln(2)).
+  const int32_t k = static_cast<int32_t>(xc * 1.44269504f + 128.5f) - 128;
+  const float kf = static_cast<float>(k);
+  // ln(2) split in two parts, so k * ln(2) is exact in the first product.
+  const float r = (xc - kf * 0.693145751953125f) - kf * 1.428606765330187e-6f;
+  const float p =
+      1.0f +
+      r * (1.0f +
+           r * (0.5f +
+                r * (1.6666667e-1f +
+                     r * (4.1666668e-2f +
+                          r * (8.3333338e-3f + r * 1.3888889e-3f)))));
+  const uint32_t bits = static_cast<uint32_t>(k + 127) << 23;
+  float scale;
+  std::memcpy(&scale, &bits, sizeof(scale));
+  return x < -87.0f ? 0.0f : p * scale;
+}
+
+/**
+ * @brief Sum of exp(pprobs[i] - max), skipping the terms below LOGEPS. With
+ * LogAddMode::Max only the largest term counts, so the sum is 1.
+ *
+ * @param[in] pprobs Log values.
+ * @param[in] max Maximum of pprobs.
+ * @param[in] components Number of values.
+ * @param[in] mode How the exponentials are computed.
+ * @return float The sum, in linear domain.
+ */
+float exp_sum(const float *pprobs, const float max, const uint32_t components,
+              const LogAddMode mode = LogAddMode::Exact);
+
+/**
+ * @brief Log-sum-exp of pprobs, given its maximum. With LogAddMode::Max it is
+ * the maximum itself.
+ *
+ * @param[in] pprobs Log values.
+ * @param[in] max Maximum of pprobs.
+ * @param[in] components Number of values.
+ * @param[in] mode How the exponentials are computed.
+ * @return float log(sum(exp(pprobs))).
+ */
+float robust_add(const float *pprobs, const float max,
+                 const uint32_t components,
+                 const LogAddMode mode = LogAddMode::Exact);
+
 float robust_add(const std::vector<float> &pprobs, const float &max,
                  const uint32_t &components);
 
@@ -0,0 +1,216 @@
+/*
+ * Copyright 2020 Javier Jorge. All rights reserved.
+ * License: https://github.com/JJorgeDSIC/CppDecoder#license
+ */
+
+#include "BinaryModel.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// Offset rounded up to a multiple of PARAMS_ALIGNMENT.
+static uint64_t aligned_offset(const uint64_t offset) {
+  return (offset + PARAMS_ALIGNMENT - 1) / PARAMS_ALIGNMENT * PARAMS_ALIGNMENT;
+}
+
+void BinaryModelWriter::putBytes(const void *bytes, const std::size_t n) {
+  const char *begin = static_cast<const char *>(bytes);
+  meta.insert(meta.end(), begin, begin + n);
+}
+
+void BinaryModelWriter::putString(const std::string &value) {
+  putU32(value.size());
+  putBytes(value.data(), value.size());
+}
+
+void BinaryModelWriter::putFloats(const std::vector<float> &values) {
+  putU32(values.size());
+  putBytes(values.data(), values.size() * sizeof(float));
+}
+
+uint64_t BinaryModelWriter::putBytesBlock(const void *bytes,
+                                          const std::size_t n) {
+  const uint64_t offset = aligned_offset(data.size());
+  const char *begin = static_cast<const char *>(bytes);
+  data.resize(offset, 0);
+  data.insert(data.end(), begin, begin + n);
+  return offset;
+}
+
+int BinaryModelWriter::write(const std::string &filename,
+                             const BinaryModelKind kind) const {
+  BinaryModelHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, BINARY_MODEL_MAGIC, sizeof(header.magic));
+  header.version = BINARY_MODEL_VERSION;
+  header.byte_order = BINARY_MODEL_BYTE_ORDER;
+  header.kind = static_cast<uint32_t>(kind);
+  header.alignment = PARAMS_ALIGNMENT;
+  header.meta_offset = sizeof(header);
+  header.meta_bytes = meta.size();
+  header.data_offset = aligned_offset(header.meta_offset + meta.size());
+  header.data_bytes = data.size();
+  header.checksum = fnv1a_hash(meta.data(), meta.size(),
+                               fnv1a_hash(&header, sizeof(header)));
+
+  std::ofstream fileO(filename, std::ios::binary | std::ios::trunc);
+  if (!fileO.is_open()) {
+    std::cout << "Unable to open the file " << filename << " for writing."
+              << std::endl;
+    return 1;
+  }
+
+  const std::vector<char> padding(
+      header.data_offset - header.meta_offset - meta.size(), 0);
+  fileO.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  fileO.write(meta.data(), meta.size());
+  fileO.write(padding.data(), padding.size());
+  fileO.write(data.data(), data.size());
+
+  if (!fileO) {
+    std::cout << "Unable to write the file " << filename << "." << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+BinaryModelReader::BinaryModelReader()
+    : meta(nullptr),
+      meta_bytes(0),
+      pos(0),
+      data(nullptr),
+      data_bytes(0),
+      error(false) {}
+
+bool BinaryModelReader::isBinaryModel(const std::string &filename) {
+  std::ifstream fileI(filename, std::ios::binary);
+  char magic[sizeof(BINARY_MODEL_MAGIC)];
+  return fileI.read(magic, sizeof(magic)) &&
+         std::memcmp(magic, BINARY_MODEL_MAGIC, sizeof(magic)) == 0;
+}
+
+int BinaryModelReader::open(const std::string &filename,
+                            const BinaryModelKind kind, const MapMode mode) {
+  error = true;
+
+  if (file.open(filename, mode) != 0) {
+    std::cout << "Unable to map the file " << filename << "." << std::endl;
+    return 1;
+  }
+
+  BinaryModelHeader header;
+  if (file.size() < sizeof(header)) {
+    std::cout << "The file " << filename << " is too short." << std::endl;
+    return 1;
+  }
+  std::memcpy(&header, file.data(), sizeof(header));
+
+  if (std::memcmp(header.magic, BINARY_MODEL_MAGIC, sizeof(header.magic)) !=
+          0 ||
+      header.version != BINARY_MODEL_VERSION ||
+      header.byte_order != BINARY_MODEL_BYTE_ORDER ||
+      header.alignment != PARAMS_ALIGNMENT ||
+      header.kind != static_cast<uint32_t>(kind)) {
+    std::cout << "The file " << filename
+              << " is not a binary model of this version and kind."
+              << std::endl;
+    return 1;
+  }
+
+  if (header.meta_offset != sizeof(header) ||
+      header.meta_bytes > file.size() - header.meta_offset ||
+      header.data_offset % PARAMS_ALIGNMENT != 0 ||
+      header.data_offset > file.size() ||
+      header.data_bytes > file.size() - header.data_offset) {
+    std::cout << "The file " << filename << " is truncated." << std::endl;
+    return 1;
+  }
+
+  const uint64_t checksum = header.checksum;
+  header.checksum = 0;
+  if (fnv1a_hash(file.data() + header.meta_offset, header.meta_bytes,
+                 fnv1a_hash(&header, sizeof(header))) != checksum) {
+    std::cout << "The checksum of the file " << filename << " does not match."
+              << std::endl;
+    return 1;
+  }
+
+  meta = file.data() + header.meta_offset;
+  meta_bytes = header.meta_bytes;
+  pos = 0;
+  data = file.data() + header.data_offset;
+  data_bytes = header.data_bytes;
+  error = false;
+  return 0;
+}
+
+void BinaryModelReader::getBytes(void *bytes, const std::size_t n) {
+  if (error || n > meta_bytes - pos) {
+    error = true;
+    std::memset(bytes, 0, n);
+    return;
+  }
+  std::memcpy(bytes, meta + pos, n);
+  pos += n;
+}
+
+uint32_t BinaryModelReader::getU32() {
+  uint32_t value;
+  getBytes(&value, sizeof(value));
+  return value;
+}
+
+uint64_t BinaryModelReader::getU64() {
+  uint64_t value;
+  getBytes(&value, sizeof(value));
+  return value;
+}
+
+float BinaryModelReader::getFloat() {
+  float value;
+  getBytes(&value, sizeof(value));
+  return value;
+}
+
+std::string BinaryModelReader::getString() {
+  const uint32_t n = getU32();
+  if (error || n > meta_bytes - pos) {
+    error = true;
+    return std::string();
+  }
+  std::string value(meta + pos, n);
+  pos += n;
+  return value;
+}
+
+std::vector<float> BinaryModelReader::getFloats() {
+  const uint32_t n = getU32();
+  if (error || n > (meta_bytes - pos) / sizeof(float)) {
+    error = true;
+    return std::vector<float>();
+  }
+  std::vector<float> values(n);
+  if (n > 0) getBytes(values.data(), n * sizeof(float));
+  return values;
+}
+
+uint32_t BinaryModelReader::getCount(const std::size_t item_bytes) {
+  const uint32_t n = getU32();
+  if (error || n > (meta_bytes - pos) / std::max<std::size_t>(item_bytes, 1)) {
+    error = true;
+    return 0;
+  }
+  return n;
+}
+
+const char *BinaryModelReader::getBytesBlock(const uint64_t offset,
+                                            const std::size_t n) const {
+  if (error || offset % PARAMS_ALIGNMENT != 0 || offset > data_bytes ||
+      n > data_bytes - offset) {
+    error = true;
+    return nullptr;
+  }
+  return data + offset;
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2020 Javier Jorge. All rights reserved.
+ * License: https://github.com/JJorgeDSIC/CppDecoder#license
+ */
+
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(const uint32_t n_threads) : next_task(0) {
+  for (uint32_t i = 1; i < n_threads; i++)
+    workers.emplace_back(&ThreadPool::work, this);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = true;
+  }
+  start_cv.notify_all();
+
+  for (auto &worker : workers) worker.join();
+}
+
+void ThreadPool::run(const uint32_t n_tasks,
+                     const std::function<void(uint32_t)> &task) {
+  if (n_tasks == 0) return;
+
+  if (workers.empty() || n_tasks == 1) {
+    for (uint32_t i = 0; i < n_tasks; i++) task(i);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->task = &task;
+    this->n_tasks = n_tasks;
+    next_task.store(0);
+    running = workers.size();
+    generation++;
+  }
+  start_cv.notify_all();
+
+  do_tasks();
+
+  // Barrier: the task and its captures must outlive every worker call.
+  std::unique_lock<std::mutex> lock(mutex);
+  done_cv.wait(lock, [this] { return running == 0; });
+  this->task = nullptr;
+}
+
+void ThreadPool::do_tasks() {
+  uint32_t i;
+  while ((i = next_task.fetch_add(1)) < n_tasks) (*task)(i);
+}
+
+void ThreadPool::work() {
+  uint64_t seen = 0;
+
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      start_cv.wait(lock, [this, seen] { return stop || generation != seen; });
+      if (stop) return;
+      seen = generation;
+    }
+
+    do_tasks();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--running == 0) done_cv.notify_one();
+  }
+}
@@ -5,18 +5,58 @@
 
 #include "Utils.h"
 
-float robust_add(const std::vector<float> &pprobs, const float &max,
-                 const uint32_t &components) {
-  if (max == -HUGE_VAL) return -HUGE_VAL;
+#include <locale>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
+float exp_sum(const float *pprobs, const float max, const uint32_t components,
+              const LogAddMode mode) {
   uint32_t n;
   float res = 0.0;
-  for (n = 0; n < components; ++n) {
-    float aux = pprobs[n] - max;
-    if (aux >= LOGEPS) res += exp(aux);
+  if (mode == LogAddMode::Max) {
+    // exp(max - max), the only term of the approximation.
+    return components > 0 ? 1.0 : 0.0;
+  } else if (mode == LogAddMode::FastExp) {
+    // One partial sum per lane: the compiler does not reorder a float
+    // reduction, but it vectorizes this one.
+    const uint32_t lanes = 8;
+    float partial[lanes] = {0.0f};
+    for (n = 0; n + lanes <= components; n += lanes) {
+      for (uint32_t j = 0; j < lanes; j++) {
+        float aux = pprobs[n + j] - max;
+        float value = fast_exp(aux);
+        partial[j] += aux >= LOGEPS ? value : 0.0f;
+      }
+    }
+    for (; n < components; ++n) {
+      float aux = pprobs[n] - max;
+      if (aux >= LOGEPS) res += fast_exp(aux);
+    }
+    for (uint32_t j = 0; j < lanes; j++) res += partial[j];
+  } else {
+    for (n = 0; n < components; ++n) {
+      float aux = pprobs[n] - max;
+      if (aux >= LOGEPS) res += exp(aux);
+    }
   }
+  return res;
+}
+
+float robust_add(const float *pprobs, const float max,
+                 const uint32_t components, const LogAddMode mode) {
+  if (max == -HUGE_VAL) return -HUGE_VAL;
+
+  return max + log(exp_sum(pprobs, max, components, mode));
+}
 
-  return max + log(res);
+float robust_add(const std::vector<float> &pprobs, const float &max,
+                 const uint32_t &components) {
+  return robust_add(pprobs.data(), max, components);
 }
 
 uint32_t read_header_line(std::ifstream &fileI, std::string line,
@@ -27,3 +67,209 @@ uint32_t read_header_line(std::ifstream &fileI, std::string line,
   std::stringstream(line) >> value;
   return value;
 }
+
+MappedFile::MappedFile() : addr(nullptr), length(0), writable(false) {}
+
+MappedFile::~MappedFile() { close(); }
+
+MappedFile::MappedFile(MappedFile &&other) noexcept : MappedFile() {
+  *this = std::move(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+  if (this != &other) {
+    close();
+    std::swap(addr, other.addr);
+    std::swap(length, other.length);
+    std::swap(writable, other.writable);
+#ifdef _WIN32
+    buffer.swap(other.buffer);
+#endif
+  }
+  return *this;
+}
+
+int MappedFile::open(const std::string &filename, const MapMode mode) {
+  close();
+
+#ifdef _WIN32
+  std::ifstream fileI(filename, std::ios::binary | std::ios::ate);
+  if (!fileI.is_open() || fileI.tellg() <= 0) return 1;
+  buffer.resize(fileI.tellg());
+  fileI.seekg(0);
+  if (!fileI.read(buffer.data(), buffer.size())) {
+    AlignedVector<char>().swap(buffer);
+    return 1;
+  }
+  addr = buffer.data();
+  length = buffer.size();
+  writable = true;
+#else
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) return 1;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    ::close(fd);
+    return 1;
+  }
+
+  const int prot =
+      mode == MapMode::ReadOnly ? PROT_READ : PROT_READ | PROT_WRITE;
+  void *ptr = mmap(nullptr, st.st_size, prot, MAP_PRIVATE, fd, 0);
+  // The mapping keeps its own reference to the file.
+  ::close(fd);
+  if (ptr == MAP_FAILED) return 1;
+
+  addr = static_cast<char *>(ptr);
+  length = st.st_size;
+  writable = mode != MapMode::ReadOnly;
+#endif
+  return 0;
+}
+
+void MappedFile::close() {
+  if (addr == nullptr) return;
+#ifdef _WIN32
+  AlignedVector<char>().swap(buffer);
+#else
+  munmap(addr, length);
+#endif
+  addr = nullptr;
+  length = 0;
+  writable = false;
+}
+
+uint64_t fnv1a_hash(const void *data, const std::size_t n, uint64_t hash) {
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  for (std::size_t i = 0; i < n; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// Same set as std::isspace in the classic locale.
+static inline bool is_space(const char c) {
+  return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' ||
+         c == '\f';
+}
+
+static inline bool is_digit(const char c) { return c >= '0' && c <= '9'; }
+
+const char *parse_float(const char *begin, const char *end, float *value) {
+  // Powers of ten exactly representable as doubles.
+  static const double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                  1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                  1e18, 1e19, 1e20, 1e21, 1e22};
+
+  const char *p = begin;
+  while (p < end && is_space(*p)) p++;
+  const char *start = p;
+
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+  // The significant digits in mantissa, value = mantissa * 10^exponent.
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  bool any = false;
+
+  for (; p < end && is_digit(*p); p++, any = true) {
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+      if (mantissa != 0) digits++;
+    } else {
+      exponent++;
+    }
+  }
+
+  if (p < end && *p == '.') {
+    for (p++; p < end && is_digit(*p); p++, any = true) {
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        if (mantissa != 0) digits++;
+        exponent--;
+      }
+    }
+  }
+
+  if (!any) return nullptr;
+
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char *q = p + 1;
+    bool negative_exp = false;
+    if (q < end && (*q == '-' || *q == '+')) negative_exp = *q++ == '-';
+    if (q < end && is_digit(*q)) {
+      int e = 0;
+      for (; q < end && is_digit(*q); q++)
+        if (e < 100000) e = e * 10 + (*q - '0');
+      exponent += negative_exp ? -e : e;
+      p = q;
+    }
+  }
+
+  if (mantissa < (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+    double result = static_cast<double>(mantissa);
+    result = exponent < 0 ? result / powers[-exponent]
+                          : result * powers[exponent];
+    *value = static_cast<float>(negative ? -result : result);
+    return p;
+  }
+
+  std::istringstream stm(std::string(start, p));
+  stm.imbue(std::locale::classic());
+  if (!(stm >> *value)) return nullptr;
+  return p;
+}
+
+uint32_t parse_floats(const char *begin, const char *end, float *values,
+                      const uint32_t n) {
+  uint32_t i = 0;
+  for (; i < n; i++) {
+    begin = parse_float(begin, end, &values[i]);
+    if (begin == nullptr) break;
+  }
+  return i;
+}
+
+template <>
+std::vector<float> read_vector<float>(const std::string &line) {
+  std::vector<float> values;
+  const char *p = line.data();
+  const char *end = p + line.size();
+  float value;
+  while ((p = parse_float(p, end, &value)) != nullptr) values.push_back(value);
+  return values;
+}
+
+int read_file(const std::string &filename, std::string *contents) {
+  std::ifstream fileI(filename, std::ios::binary | std::ios::ate);
+  if (!fileI.is_open()) return 1;
+
+  const std::streamoff size = fileI.tellg();
+  if (size < 0) return 1;
+
+  contents->resize(size);
+  fileI.seekg(0);
+  if (size > 0 && !fileI.read(&(*contents)[0], size)) return 1;
+  return 0;
+}
+
+bool LineCursor::next(const char **line_begin, const char **line_end,
+                      const char delim) {
+  if (p == end) return false;
+  const char *found = static_cast<const char *>(memchr(p, delim, end - p));
+  *line_begin = p;
+  *line_end = found != nullptr ? found : end;
+  p = found != nullptr ? found + 1 : end;
+  return true;
+}
+
+void LineCursor::skip_lines(const uint32_t n) {
+  const char *begin, *line_end;
+  for (uint32_t i = 0; i < n; i++)
+    if (!next(&begin, &line_end)) break;
+}
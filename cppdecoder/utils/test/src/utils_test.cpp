@@ -3,8 +3,12 @@
  * License: https://github.com/JJorgeDSIC/CppDecoder#license
  */
 
+#include <BinaryModel.h>
+#include <ThreadPool.h>
 #include <Utils.h>
 
+#include <cstdio>
+#include <random>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -30,7 +34,146 @@ TEST(Utils, RobustAddTest) {
             resutlTrue);
 }
 
+TEST(Utils, FastExpTest) {
+  for (float x = -87.0; x <= 88.0; x += 0.001) {
+    double expected = std::exp(static_cast<double>(x));
+    ASSERT_NEAR(fast_exp(x), expected, FAST_EXP_TOLERANCE * expected) << x;
+  }
+  ASSERT_EQ(fast_exp(-100.0), 0.0);
+  ASSERT_EQ(fast_exp(0.0), 1.0);
+}
+
+TEST(Utils, RobustAddFastExpTest) {
+  std::mt19937 gen(1234);
+  std::uniform_real_distribution<float> uniform(-60.0, 0.0);
+
+  std::vector<float> values(256);
+  for (auto &value : values) value = uniform(gen);
+  values[17] = 0.0;
+
+  float exact = robust_add(values, 0.0, values.size());
+
+  ASSERT_EQ(robust_add(values.data(), 0.0, values.size()), exact);
+  ASSERT_NEAR(robust_add(values.data(), 0.0, values.size(),
+                         LogAddMode::FastExp),
+              exact, FAST_EXP_TOLERANCE);
+  ASSERT_EQ(robust_add(values.data(), 0.0, values.size(), LogAddMode::Max),
+            0.0);
+}
+
+TEST(Utils, ParseFloatTest) {
+  const std::string line =
+      "0.611003 -0.341059\t1e-3 -2.5E+2 +7 .5 0.000123456789 "
+      "12345678901234567890123 1.17549435e-38 3.4028234e38";
+  std::istringstream stm(line);
+  const std::vector<float> expected = {std::istream_iterator<float>(stm),
+                                       std::istream_iterator<float>()};
+  ASSERT_EQ(expected.size(), 10);
+  ASSERT_EQ(read_vector<float>(line), expected);
+
+  // Up to n values, stopping at the first thing that is not a number.
+  float values[4];
+  ASSERT_EQ(parse_floats(line, values, 2), 2);
+  ASSERT_EQ(values[1], expected[1]);
+  ASSERT_EQ(parse_floats("1.5 2,5 3", values, 4), 2);
+  ASSERT_EQ(values[1], 2.0f);
+  ASSERT_EQ(parse_floats("  ", values, 4), 0);
+  ASSERT_EQ(parse_floats("- 1", values, 4), 0);
+}
+
+TEST(Utils, AlignedArrayViewTest) {
+  AlignedVector<float> storage(16, 1.0);
+
+  AlignedArray<float> owned;
+  owned.resize(4, 2.0);
+  AlignedArray<float> copy(owned);
+  copy[0] = 3.0;
+  ASSERT_EQ(owned[0], 2.0);
+
+  // Copies of a view share the viewed values.
+  AlignedArray<float> view;
+  view.view(storage.data(), storage.size());
+  AlignedArray<float> shared(view);
+  ASSERT_TRUE(shared.isView());
+  ASSERT_EQ(shared.data(), storage.data());
+
+  // Resizing copies them first.
+  shared.resize(20, 5.0);
+  ASSERT_FALSE(shared.isView());
+  ASSERT_EQ(shared[0], 1.0);
+  ASSERT_EQ(shared[19], 5.0);
+  ASSERT_EQ(view.data(), storage.data());
+}
+
+TEST(Utils, BinaryModelReadOnlyTest) {
+  const std::string filename = "./read_only.bin";
+  const float values[4] = {1.0, 2.0, 3.0, 4.0};
+  BinaryModelWriter writer;
+  writer.putU64(writer.putBlock(values, 4));
+  ASSERT_EQ(writer.write(filename, BinaryModelKind::Mixture), 0);
+
+  // A read-only mapping gives its blocks only to be read.
+  BinaryModelReader reader;
+  ASSERT_EQ(reader.open(filename, BinaryModelKind::Mixture, MapMode::ReadOnly),
+            0);
+  const uint64_t offset = reader.getU64();
+  const BinaryModelReader &blocks = reader;
+  const float *block = blocks.getBlock<float>(offset, 4);
+  ASSERT_FALSE(reader.failed());
+  ASSERT_EQ(block[3], 4.0);
+  ASSERT_EQ(reader.getBlock<float>(offset, 4), nullptr);
+  ASSERT_TRUE(reader.failed());
+
+  BinaryModelReader writable;
+  ASSERT_EQ(writable.open(filename, BinaryModelKind::Mixture), 0);
+  float *copy = writable.getBlock<float>(writable.getU64(), 4);
+  ASSERT_FALSE(writable.failed());
+  copy[3] = 5.0;
+  ASSERT_EQ(copy[3], 5.0);
+
+  std::remove(filename.c_str());
+}
+
+TEST(Utils, BinaryModelCountTest) {
+  const std::string filename = "./count.bin";
+  BinaryModelWriter writer;
+  writer.putU32(2);
+  writer.putString("a");
+  writer.putString("b");
+  writer.putU32(1000000);
+  ASSERT_EQ(writer.write(filename, BinaryModelKind::Mixture), 0);
+
+  // Two names fit in what is left, a million do not.
+  BinaryModelReader reader;
+  ASSERT_EQ(reader.open(filename, BinaryModelKind::Mixture), 0);
+  ASSERT_EQ(reader.getCount(sizeof(uint32_t)), 2);
+  ASSERT_EQ(reader.getString(), "a");
+  ASSERT_EQ(reader.getString(), "b");
+  ASSERT_FALSE(reader.failed());
+  ASSERT_EQ(reader.getCount(sizeof(uint32_t)), 0);
+  ASSERT_TRUE(reader.failed());
+
+  std::remove(filename.c_str());
+}
+
+TEST(ThreadPool, RunEveryTask) {
+  ThreadPool pool(4);
+  ASSERT_EQ(pool.getNThreads(), 4);
+
+  std::vector<uint32_t> counts(1000);
+
+  // The pool is reused, each run waits for all of its tasks.
+  for (uint32_t run = 1; run <= 50; run++) {
+    pool.run(counts.size(), [&counts](uint32_t i) { counts[i]++; });
+    for (auto count : counts) ASSERT_EQ(count, run);
+  }
+
+  pool.run(0, [&counts](uint32_t i) { counts[i]++; });
+  ASSERT_EQ(counts[0], 50);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
 }
+